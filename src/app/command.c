@@ -0,0 +1,268 @@
+#include "command.h"
+
+#include <stdarg.h>
+
+#include "command_hash.h"
+#include "dbg_print.h"
+#include "fmt.h"
+#include "static_task.h"
+#include "usb_comm.h"
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+const command_t *commandLookup(const char *name, size_t nameLen);
+int commandTokenize(char *line, char **argv, int argvMax);
+int32_t commandExecute(char *line);
+int32_t commandReply(const char *format, ...);
+
+// ハンドラの宣言
+#define COMMAND(name, handler, help) int32_t handler(int argc, char **argv);
+#include "command_list.h"
+#undef COMMAND
+
+// コマンド表(command_list.hの順)
+#define COMMAND(name, handler, help) {name, sizeof(name) - 1, handler, help},
+static const command_t s_commands[] = {
+#include "command_list.h"
+};
+#undef COMMAND
+
+#define COMMAND_NUM (sizeof(s_commands) / sizeof(s_commands[0]))
+
+// command_list.hを変更したのに生成した表が古い場合はビルドエラーにする
+_Static_assert(COMMAND_NUM == COMMAND_HASH_COMMAND_NUM,
+               "command_hash.h is out of date");
+
+// tools/gen_command_hash.pyのhash_base/hash_mixと同じ計算
+static uint32_t commandHashBase(const char *name, size_t nameLen)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < nameLen; i++)
+    {
+        h ^= (uint8_t)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t commandHashMix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// 名前からコマンドを探す。見つからなければNULL
+// nameは'\0'終端でなくてよい
+const command_t *commandLookup(const char *name, size_t nameLen)
+{
+    if (name == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t base = commandHashBase(name, nameLen);
+    uint32_t bucket = commandHashMix(base) & (COMMAND_HASH_BUCKET_NUM - 1);
+    uint32_t displace = command_hash_displace[bucket];
+    uint32_t slot = commandHashMix(base ^ (displace * 0x9E3779B9u)) &
+                    (COMMAND_HASH_SLOT_NUM - 1);
+
+    uint16_t index = command_hash_slot[slot];
+    if (index == COMMAND_HASH_SLOT_EMPTY)
+    {
+        return NULL;
+    }
+    // 登録されていない名前も何れかのスロットに当たるため、名前を比較する
+    const command_t *command = &s_commands[index];
+    if (command->nameLen != nameLen ||
+        memcmp(command->name, name, nameLen) != 0)
+    {
+        return NULL;
+    }
+    return command;
+}
+
+// lineを空白(' ', '\t')で区切り、各引数の先頭をargvに入れる
+// 区切りを'\0'で上書きするため、lineは書き換え可能であること
+// 引数の数を返す。argvMaxを超える場合はE_ARGUMENT
+int commandTokenize(char *line, char **argv, int argvMax)
+{
+    int argc = 0;
+    char *p = line;
+    while (1)
+    {
+        while (*p == ' ' || *p == '\t')
+        {
+            p++;
+        }
+        if (*p == '\0')
+        {
+            return argc;
+        }
+        if (argc >= argvMax)
+        {
+            return E_ARGUMENT;
+        }
+        argv[argc++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t')
+        {
+            p++;
+        }
+        if (*p != '\0')
+        {
+            *p++ = '\0';
+        }
+    }
+}
+
+// 1行のコマンドを実行し、ハンドラの戻り値を返す
+// 空行はE_SUCCESS、未登録のコマンドや引数が多すぎる場合はE_ARGUMENT
+int32_t commandExecute(char *line)
+{
+    if (line == NULL)
+    {
+        return E_ARGUMENT;
+    }
+
+    char *argv[COMMAND_ARGV_MAX];
+    int argc = commandTokenize(line, argv, COMMAND_ARGV_MAX);
+    if (argc <= 0)
+    {
+        return (argc == 0) ? E_SUCCESS : E_ARGUMENT;
+    }
+
+    const command_t *command = commandLookup(argv[0], strlen(argv[0]));
+    if (command == NULL)
+    {
+        return E_ARGUMENT;
+    }
+    return command->handler(argc, argv);
+}
+
+// コマンドの応答を出力する
+// ログではないため出力レベルによらず、usbTx()で1レコードとして送信する
+// COMMAND_REPLY_MAXを超える分は切り詰める
+int32_t commandReply(const char *format, ...)
+{
+    char reply[COMMAND_REPLY_MAX + 1];
+    va_list args;
+    va_start(args, format);
+    int32_t len = fmtFormatV(reply, sizeof(reply), format, args);
+    va_end(args);
+    if (len <= 0)
+    {
+        return len;
+    }
+    if (len > COMMAND_REPLY_MAX)
+    {
+        len = COMMAND_REPLY_MAX;
+    }
+    return usbTx(reply, len);
+}
+
+/****************************************************
+ * 組み込みのコマンド
+ * 応答(使い方の表示を含む)はcommandReply()で出力する
+ ****************************************************/
+
+int32_t cmdHelp(int argc, char **argv)
+{
+    for (size_t i = 0; i < COMMAND_NUM; i++)
+    {
+        commandReply("%s\r\n", s_commands[i].help);
+    }
+    return E_SUCCESS;
+}
+
+// log <module> <level> : モジュールの出力レベルを変更する
+//                        例) "log usb warn", "log app none"
+int32_t cmdLog(int argc, char **argv)
+{
+    if (argc != 3 || dbgSetModuleLevelByName(argv[1], argv[2]) != E_SUCCESS)
+    {
+        commandReply("usage: log <module> <debug|info|warn|error|none>\r\n");
+        return E_ARGUMENT;
+    }
+    commandReply("log level: %s=%s\r\n", argv[1], argv[2]);
+    return E_SUCCESS;
+}
+
+// affinity [pin|float] : タスクのコア固定を切り替える
+//                        引数なしは現在の設定を表示する
+int32_t cmdAffinity(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "pin") == 0)
+    {
+        taskSetPinned(true);
+    }
+    else if (argc == 2 && strcmp(argv[1], "float") == 0)
+    {
+        taskSetPinned(false);
+    }
+    else if (argc != 1)
+    {
+        commandReply("usage: affinity [pin|float]\r\n");
+        return E_ARGUMENT;
+    }
+    commandReply("affinity: %s\r\n", taskIsPinned() ? "pin" : "float");
+    return E_SUCCESS;
+}
+
+// isrcost [reset] : DBG_PRINT_FROM_ISR()の処理時間(最大/平均)を表示する
+//                   resetで統計を0に戻す
+int32_t cmdIsrCost(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "reset") == 0)
+    {
+        dbgResetIsrCost();
+    }
+    else if (argc != 1)
+    {
+        commandReply("usage: isrcost [reset]\r\n");
+        return E_ARGUMENT;
+    }
+
+    dbgIsrCost_t cost;
+    dbgGetIsrCost(&cost);
+    commandReply("isrcost: %u calls, max %u avg %u " DBG_ISR_COST_UNIT "\r\n",
+                 cost.count, cost.max,
+                 (cost.count > 0) ? cost.total / cost.count : 0);
+    return E_SUCCESS;
+}
+
+// usbtx [block|drop] : 送信バッファがいっぱいの場合の動作を切り替える
+//                      (block: 空くまで待つ, drop: 待たずに新しいデータを破棄)
+//                      引数なしは現在の設定と、破棄/送信の統計を表示する
+int32_t cmdUsbTx(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "block") == 0)
+    {
+        usbTxSetOverflowPolicy(USB_TX_OVERFLOW_BLOCK);
+    }
+    else if (argc == 2 && strcmp(argv[1], "drop") == 0)
+    {
+        usbTxSetOverflowPolicy(USB_TX_OVERFLOW_DROP_NEW);
+    }
+    else if (argc != 1)
+    {
+        commandReply("usage: usbtx [block|drop]\r\n");
+        return E_ARGUMENT;
+    }
+
+    usbTxDropStats_t drop;
+    usbTxFlushStats_t flush;
+    usbTxGetDropStats(&drop);
+    usbTxGetFlushStats(&flush);
+    commandReply("usbtx: %s, dropped %u bytes %u records, "
+                 "sent %u bytes %u transfers %u errors\r\n",
+                 (usbTxGetOverflowPolicy() == USB_TX_OVERFLOW_DROP_NEW)
+                     ? "drop"
+                     : "block",
+                 drop.droppedBytes, drop.droppedRecords, flush.bytes,
+                 flush.transfers, flush.errors);
+    return E_SUCCESS;
+}
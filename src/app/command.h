@@ -0,0 +1,31 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "typedef.h"
+
+// テキストコマンドの処理
+// コマンドはcommand_list.hの表に登録する。名前の検索はビルド時に生成した
+// 完全ハッシュで行い、登録数によらずハッシュ1回と文字列比較1回で済む
+
+// 1行の引数の最大数(コマンド名を含む)
+#define COMMAND_ARGV_MAX 8
+
+// commandReply()で1回に出力できる最大の文字数(超えた分は切り詰める)
+#define COMMAND_REPLY_MAX 128
+
+typedef int32_t (*commandHandler_t)(int argc, char **argv);
+
+typedef struct
+{
+    const char *name;
+    uint8_t nameLen;
+    commandHandler_t handler;
+    const char *help;
+} command_t;
+
+extern const command_t *commandLookup(const char *name, size_t nameLen);
+extern int commandTokenize(char *line, char **argv, int argvMax);
+extern int32_t commandExecute(char *line);
+extern int32_t commandReply(const char *format, ...);
+
+#endif // COMMAND_H
@@ -0,0 +1,15 @@
+// コマンド表
+// COMMAND(名前, ハンドラ, ヘルプ)
+//  - ハンドラは int32_t handler(int argc, char **argv) (argv[0]はコマンド名)
+//  - 名前からハンドラへの完全ハッシュはビルド時に
+//    tools/gen_command_hash.pyがこのファイルから生成する
+// インクルードガードは付けない(command.cで展開方法を変えて複数回読む)
+
+COMMAND("help", cmdHelp, "help : list commands")
+COMMAND("log", cmdLog, "log <module> <debug|info|warn|error|none>")
+COMMAND("affinity", cmdAffinity, "affinity [pin|float]")
+COMMAND("usbbench", cmdUsbBench, "usbbench [frames]")
+COMMAND("isrcost", cmdIsrCost, "isrcost [reset]")
+COMMAND("usbtx", cmdUsbTx, "usbtx [block|drop]")
+COMMAND("ringbench", cmdRingBench, "ringbench [rounds]")
+COMMAND("upload", cmdUpload, "upload [reset|delay <ms>]")
@@ -1,20 +1,47 @@
 #include "dbg_print.h"
 
 #include <stdarg.h>
+#include <stdatomic.h>
 
+#include "fmt.h"
+#include "log_ring.h"
 #include "pico/time.h"
 #include "rtos_wrapper.h"
 #include "typedef.h"
 #include "usb_comm.h"
 
+#if PICO_RP2350
+#include "hardware/structs/m33.h"
+#endif
+
 /****************************************************
  * forward declaration
  ****************************************************/
 bool init_dbgPrint(void);
 int32_t dbgPrint(dbg_level_t level, const char *format, ...);
+int32_t dbgPrintDeferred(dbg_level_t level, const char *format,
+                         uint32_t argCount, ...);
+int32_t dbgPrintFromISR(dbg_level_t level, const char *format,
+                        uint32_t argCount, ...);
+void dbgFormat_task(void *params);
+static int32_t dbgTokenWrite(dbg_level_t level, const char *format,
+                             uint32_t argCount, va_list args, bool fromISR);
+static int32_t dbgLinePrefix(uint8_t *line, size_t size, dbg_level_t level,
+                             uint32_t clock);
+static int32_t dbgLineReserve(dbg_level_t level, uint32_t clock,
+                              int32_t *msg_len, uint8_t **line);
+static void dbgLineCommit(uint8_t *line, int32_t prefix_len, int32_t msg_len);
+static void dbgFormatTokenRecord(const dbgTokenRecord_t *record);
+static usbTxLane_t dbgLevelLane(dbg_level_t level);
+int32_t dbgSetModuleLevel(dbg_module_t module, dbg_level_t level);
+int32_t dbgSetModuleLevelByName(const char *module, const char *level);
+void dbgGetIsrCost(dbgIsrCost_t *cost);
+void dbgResetIsrCost(void);
+static uint32_t dbgIsrClock(void);
+static void dbgIsrCostAdd(uint32_t cost);
 
-#define DBG_PRINT_BUFFER_SIZE 1024
-uint8_t s_buffer[DBG_PRINT_BUFFER_SIZE];
+// 1行の最大長(色コード、プレフィックスを含む)
+#define DBG_PRINT_LINE_MAX USB_TX_RECORD_MAX
 const char *dbg_level_strings[4] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
 
 // テキスト色
@@ -33,85 +60,337 @@ const char *dbg_level_colors[4] = {
     ANSI_COLOR_RED     // ERROR
 };
 
-// dbg bufferのmutex資源
-rtos_mutex_t s_mtxDbgPrint = NULL;
+// モジュールごとの出力レベル(初期値は全てDEBUG)
+atomic_uchar dbg_module_levels[DBG_MODULE_MAX];
+const char *dbg_module_names[DBG_MODULE_MAX] = {"system", "usb", "app"};
+const char *dbg_level_names[DBG_LEVEL_NONE + 1] = {"debug", "info", "warn",
+                                                   "error", "none"};
+
+// 本文の最大長(色リセット分を残しておく)
+#define DBG_PRINT_BODY_SIZE                                                    \
+    (DBG_PRINT_LINE_MAX - (int32_t)(sizeof(ANSI_COLOR_RESET) - 1))
+
+// トークン化ログ用リングバッファ
+// 書式化前のレコード(dbgTokenRecord_t)を格納し、dbgFormat_taskで書式化する
+#define DBG_TOKEN_RING_SIZE 2048
+LOG_RING_DEFINE(s_dbgTokenRing, DBG_TOKEN_RING_SIZE);
+static _Atomic(rtos_task_handle_t) s_dbgFormatTask = NULL;
+static atomic_uint s_dbgTokenDropped; // リングがいっぱいで破棄した数
+
+// DBG_PRINT_FROM_ISR()の処理時間の統計(単位はDBG_ISR_COST_UNIT)
+static atomic_uint s_dbgIsrCount;
+static atomic_uint s_dbgIsrMaxCost;
+static atomic_uint s_dbgIsrTotalCost;
 
 bool init_dbgPrint(void)
 {
-    s_mtxDbgPrint = rtos_mutex_create();
-    if (s_mtxDbgPrint == NULL)
+    // 通常のdbgPrintは送信リングバッファに直接書き込むため資源は不要
+    // トークン化ログ用のリングバッファのみ初期化する
+    if (!LOG_RING_INIT(s_dbgTokenRing))
     {
-        // TODO: Assert
         return false;
     }
+
+#if PICO_RP2350
+    // ISRの処理時間の計測用にサイクルカウンタを有効にする
+    // DWTはコアごとにあるため、USBの割り込みが動くcore0で呼ぶこと
+    m33_hw->demcr |= M33_DEMCR_TRCENA_BITS;
+    m33_hw->dwt_ctrl |= M33_DWT_CTRL_CYCCNTENA_BITS;
+#endif
     return true;
 }
 
-int32_t dbgPrint(dbg_level_t level, const char *format, ...)
+// ISRの処理時間の計測に使う時刻(単位はDBG_ISR_COST_UNIT)
+static uint32_t dbgIsrClock(void)
 {
-    rtos_mutex_take(s_mtxDbgPrint);
-    int32_t ret = E_OTHER;
+#if PICO_RP2350
+    return m33_hw->dwt_cyccnt;
+#else
+    return time_us_32();
+#endif
+}
 
-    memset(s_buffer, 0, DBG_PRINT_BUFFER_SIZE);
+// ERRORはHIGHレーンで送信し、大量の出力があっても待たされないようにする
+// (HIGHレーンは集約も待たずに送信される)
+static usbTxLane_t dbgLevelLane(dbg_level_t level)
+{
+    return (level >= DBG_LEVEL_ERROR) ? USB_TX_LANE_HIGH : USB_TX_LANE_NORMAL;
+}
 
-    // [LEVEL][{clock}] のプレフィックスを追加
-    // levelに合わせて色付けも行う
-    uint32_t clock = to_ms_since_boot(get_absolute_time());
-    int32_t prefix_len =
-        snprintf((char *)s_buffer, DBG_PRINT_BUFFER_SIZE, "%s[%s][%06u] ",
-                 dbg_level_colors[level], dbg_level_strings[level], clock);
+// [LEVEL][{clock}] のプレフィックスをlineに書き込み、その長さを返す
+// levelに合わせて色付けも行う。lineがNULL(sizeが0)の場合は長さだけを求める
+static int32_t dbgLinePrefix(uint8_t *line, size_t size, dbg_level_t level,
+                             uint32_t clock)
+{
+    return fmtFormat((char *)line, size, "%s[%s][%06u] ",
+                     dbg_level_colors[level], dbg_level_strings[level], clock);
+}
 
-    if (prefix_len < 0 || prefix_len >= DBG_PRINT_BUFFER_SIZE)
+// 本文がmsg_lenバイトの1行分の領域を確保し、プレフィックスを書き込む
+// 確保するのは実際の長さだけ(DBG_PRINT_LINE_MAX固定では確保しない)
+// 本文はDBG_PRINT_BODY_SIZEに収まるよう切り詰め、その長さをmsg_lenに返す
+// 戻り値: プレフィックスの長さ。DROP_NEWで破棄された場合はE_WOULDBLOCK
+static int32_t dbgLineReserve(dbg_level_t level, uint32_t clock,
+                              int32_t *msg_len, uint8_t **line)
+{
+    const int32_t suffix_len = sizeof(ANSI_COLOR_RESET) - 1;
+    int32_t prefix_len = dbgLinePrefix(NULL, 0, level, clock);
+    if (prefix_len < 0 || prefix_len >= DBG_PRINT_BODY_SIZE)
     {
-        ret = E_BUFSIZE; // バッファ不足
-        goto exit;
+        return E_BUFSIZE; // バッファ不足
     }
+    if (prefix_len + *msg_len >= DBG_PRINT_BODY_SIZE)
+    {
+        *msg_len = DBG_PRINT_BODY_SIZE - prefix_len - 1;
+    }
+
+    // fmtFormatが書き込むnull終端は、後ろに続く本文/色リセットで上書きされる
+    *line = usbTxRecordReserveLane(dbgLevelLane(level),
+                                   prefix_len + *msg_len + suffix_len);
+    if (*line == NULL)
+    {
+        return E_WOULDBLOCK; // DROP_NEWで破棄された
+    }
+    dbgLinePrefix(*line, prefix_len + 1, level, clock);
+    return prefix_len;
+}
 
-    // 残りのバッファにユーザーメッセージを追加
+// 本文の後ろに色リセットを書き込み(null終端は不要)、行を確定する
+static void dbgLineCommit(uint8_t *line, int32_t prefix_len, int32_t msg_len)
+{
+    const int32_t suffix_len = sizeof(ANSI_COLOR_RESET) - 1;
+    memcpy(line + prefix_len + msg_len, ANSI_COLOR_RESET, suffix_len);
+    usbTxRecordCommit(line, prefix_len + msg_len + suffix_len);
+}
+
+int32_t dbgPrint(dbg_level_t level, const char *format, ...)
+{
+    // 先に本文の長さを求め、送信リングバッファ上にその行の分だけ確保して
+    // 直接書き込む(中間バッファとmutexは使用しない)
     va_list args;
     va_start(args, format);
-    int32_t msg_len =
-        vsnprintf((char *)s_buffer + prefix_len,
-                  DBG_PRINT_BUFFER_SIZE - prefix_len, format, args);
+    va_list measure;
+    va_copy(measure, args);
+    int32_t msg_len = fmtFormatV(NULL, 0, format, measure);
+    va_end(measure);
+    if (msg_len < 0)
+    {
+        va_end(args);
+        return E_OTHER;
+    }
+
+    uint32_t clock = to_ms_since_boot(get_absolute_time());
+    uint8_t *line;
+    int32_t prefix_len = dbgLineReserve(level, clock, &msg_len, &line);
+    if (prefix_len < 0)
+    {
+        va_end(args);
+        return prefix_len;
+    }
+
+    fmtFormatV((char *)line + prefix_len, msg_len + 1, format, args);
     va_end(args);
+    dbgLineCommit(line, prefix_len, msg_len);
+    return E_SUCCESS;
+}
+
+// DBG_PRINT_DEFERRED()から呼ばれる。直接呼ばないこと
+int32_t dbgPrintDeferred(dbg_level_t level, const char *format,
+                         uint32_t argCount, ...)
+{
+    va_list args;
+    va_start(args, argCount);
+    int32_t ret = dbgTokenWrite(level, format, argCount, args, false);
+    va_end(args);
+    return ret;
+}
+
+// DBG_PRINT_FROM_ISR()から呼ばれる。直接呼ばないこと
+// 1回ごとの処理時間を計測し、最悪値を記録する
+int32_t dbgPrintFromISR(dbg_level_t level, const char *format,
+                        uint32_t argCount, ...)
+{
+    uint32_t start = dbgIsrClock();
+    va_list args;
+    va_start(args, argCount);
+    int32_t ret = dbgTokenWrite(level, format, argCount, args, true);
+    va_end(args);
+    dbgIsrCostAdd(dbgIsrClock() - start);
+    return ret;
+}
+
+// 両方のコアの割り込みから呼ばれるため、最大値はCASで更新する
+static void dbgIsrCostAdd(uint32_t cost)
+{
+    atomic_fetch_add_explicit(&s_dbgIsrCount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_dbgIsrTotalCost, cost, memory_order_relaxed);
+    uint32_t max = atomic_load_explicit(&s_dbgIsrMaxCost, memory_order_relaxed);
+    while (cost > max &&
+           !atomic_compare_exchange_weak_explicit(&s_dbgIsrMaxCost, &max, cost,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+    {
+    }
+}
+
+void dbgGetIsrCost(dbgIsrCost_t *cost)
+{
+    if (cost == NULL)
+    {
+        return;
+    }
+    cost->count = atomic_load_explicit(&s_dbgIsrCount, memory_order_relaxed);
+    cost->max = atomic_load_explicit(&s_dbgIsrMaxCost, memory_order_relaxed);
+    cost->total =
+        atomic_load_explicit(&s_dbgIsrTotalCost, memory_order_relaxed);
+}
+
+void dbgResetIsrCost(void)
+{
+    atomic_store_explicit(&s_dbgIsrCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&s_dbgIsrMaxCost, 0, memory_order_relaxed);
+    atomic_store_explicit(&s_dbgIsrTotalCost, 0, memory_order_relaxed);
+}
+
+// 書式文字列のアドレス、時刻、引数だけを記録し、書式化はdbgFormat_taskで行う
+// リングバッファがいっぱいの場合は待たずに破棄する
+// fromISRの場合は確保の再試行回数を制限し、処理時間に上限を設ける
+static int32_t dbgTokenWrite(dbg_level_t level, const char *format,
+                             uint32_t argCount, va_list args, bool fromISR)
+{
+    if (format == NULL || argCount > DBG_TOKEN_ARG_MAX)
+    {
+        return E_ARGUMENT;
+    }
+
+    size_t size = sizeof(dbgTokenRecord_t) + argCount * sizeof(uintptr_t);
+    dbgTokenRecord_t *record =
+        (dbgTokenRecord_t *)(fromISR ? logRingTryReserve(&s_dbgTokenRing, size)
+                                     : logRingReserve(&s_dbgTokenRing, size));
+    if (record == NULL)
+    {
+        atomic_fetch_add_explicit(&s_dbgTokenDropped, 1, memory_order_relaxed);
+        return E_WOULDBLOCK;
+    }
+
+    record->format = format;
+    record->clock = to_ms_since_boot(get_absolute_time());
+    record->level = (uint8_t)level;
+    record->argCount = (uint8_t)argCount;
+
+    for (uint32_t i = 0; i < argCount; i++)
+    {
+        record->args[i] = va_arg(args, uintptr_t);
+    }
+
+    logRingCommit(&s_dbgTokenRing, (uint8_t *)record, size);
+    rtos_task_handle_t task =
+        atomic_load_explicit(&s_dbgFormatTask, memory_order_acquire);
+    if (fromISR)
+    {
+        rtos_task_notify_give_from_isr(task);
+    }
+    else
+    {
+        rtos_task_notify_give(task);
+    }
+    return E_SUCCESS;
+}
+
+// トークン化ログを1行に書式化し、送信リングバッファに書き込む
+static void dbgFormatTokenRecord(const dbgTokenRecord_t *record)
+{
+    // 引数は全てuintptr_tで記録しているので、未使用分も含めて全て渡す
+    // (書式文字列で使われない余分な引数は無視される)
+    // (RP2350ではuintptr_tとintは同じ幅。64bitのホストでも%s/%pのポインタや
+    //  64bit整数は切り詰められない)
+    uintptr_t a[DBG_TOKEN_ARG_MAX] = {0};
+    memcpy(a, record->args, record->argCount * sizeof(uintptr_t));
+    int32_t msg_len = fmtFormat(NULL, 0, record->format, a[0], a[1], a[2],
+                                a[3], a[4], a[5]);
     if (msg_len < 0)
     {
-        if (msg_len < 0)
+        return;
+    }
+
+    uint8_t *line;
+    int32_t prefix_len = dbgLineReserve((dbg_level_t)record->level,
+                                        record->clock, &msg_len, &line);
+    if (prefix_len < 0)
+    {
+        return;
+    }
+    fmtFormat((char *)line + prefix_len, msg_len + 1, record->format, a[0],
+              a[1], a[2], a[3], a[4], a[5]);
+    dbgLineCommit(line, prefix_len, msg_len);
+}
+
+// トークン化ログの書式化タスク(低優先度)
+void dbgFormat_task(void *params)
+{
+    atomic_store_explicit(&s_dbgFormatTask, rtos_task_get_current(),
+                          memory_order_release);
+
+    const uint8_t *data;
+    size_t len;
+    while (1)
+    {
+        while (logRingPeek(&s_dbgTokenRing, &data, &len))
         {
-            ret = E_OTHER;
-            goto exit;
+            if (len >= sizeof(dbgTokenRecord_t))
+            {
+                dbgFormatTokenRecord((const dbgTokenRecord_t *)data);
+            }
+            logRingRelease(&s_dbgTokenRing);
         }
 
-        // 色をリセットする
-        int32_t suffix_len =
-            snprintf((char *)s_buffer + prefix_len + msg_len,
-                     DBG_PRINT_BUFFER_SIZE - prefix_len - msg_len, "%s",
-                     ANSI_COLOR_RESET);
-        if (suffix_len < 0)
+        uint32_t dropped = atomic_exchange_explicit(&s_dbgTokenDropped, 0,
+                                                    memory_order_relaxed);
+        if (dropped > 0)
         {
-            ret = E_OTHER;
-            goto exit;
+            DBG_PRINT(DBG_MODULE_SYSTEM, DBG_LEVEL_WARN,
+                      "dbgPrintDeferred/FromISR: %u logs dropped\r\n",
+                      (unsigned int)dropped);
         }
 
-        // 実際に書き込まれた総長さを計算
-        int32_t total_len = prefix_len + msg_len + suffix_len;
-        if (total_len >= DBG_PRINT_BUFFER_SIZE)
+        rtos_task_notify_take(MAX_DELAY);
+    }
+}
+
+int32_t dbgSetModuleLevel(dbg_module_t module, dbg_level_t level)
+{
+    if (module >= DBG_MODULE_MAX || level > DBG_LEVEL_NONE)
+    {
+        return E_ARGUMENT;
+    }
+    atomic_store_explicit(&dbg_module_levels[module], (unsigned char)level,
+                          memory_order_relaxed);
+    return E_SUCCESS;
+}
+
+// 名前で指定する(USBコマンドから使用)
+// module: "system", "usb", "app", level: "debug", "info", "warn", "error",
+// "none"
+int32_t dbgSetModuleLevelByName(const char *module, const char *level)
+{
+    if (module == NULL || level == NULL)
+    {
+        return E_ARGUMENT;
+    }
+
+    for (int m = 0; m < DBG_MODULE_MAX; m++)
+    {
+        if (strcmp(module, dbg_module_names[m]) != 0)
         {
-            // 切り詰められた場合、実際のバッファサイズ-1（null終端分）
-            total_len = DBG_PRINT_BUFFER_SIZE - 1;
+            continue;
         }
-
-        // USB経由で送信
-        int32_t sent_len = usbTx((const char *)s_buffer, total_len);
-        if (sent_len < 0)
+        for (int l = 0; l <= DBG_LEVEL_NONE; l++)
         {
-            ret = sent_len; // 送り切れる or 負のエラーが返る
-            goto exit;
+            if (strcmp(level, dbg_level_names[l]) == 0)
+            {
+                return dbgSetModuleLevel((dbg_module_t)m, (dbg_level_t)l);
+            }
         }
-        ret = E_SUCCESS;
-
-    exit:
-        rtos_mutex_give(s_mtxDbgPrint);
-        return ret;
     }
-}
\ No newline at end of file
+    return E_ARGUMENT;
+}
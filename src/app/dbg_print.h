@@ -1,6 +1,8 @@
 #ifndef __DBG_PRINT__
 #define __DBG_PRINT__
 
+#include <stdatomic.h>
+
 #include "typedef.h"
 
 typedef enum
@@ -8,10 +10,142 @@ typedef enum
     DBG_LEVEL_DEBUG = 0,
     DBG_LEVEL_INFO,
     DBG_LEVEL_WARN,
-    DBG_LEVEL_ERROR
+    DBG_LEVEL_ERROR,
+    DBG_LEVEL_NONE // フィルタ専用: 全て出力しない
 } dbg_level_t;
 
+// ログの出力元モジュール(モジュールごとに出力レベルを設定できる)
+typedef enum
+{
+    DBG_MODULE_SYSTEM = 0,
+    DBG_MODULE_USB,
+    DBG_MODULE_APP,
+    DBG_MODULE_MAX
+} dbg_module_t;
+
+// コンパイル時の出力レベル下限
+// これ未満のレベルのDBG_PRINTは条件が定数で偽になり、コードごと削除される
+#ifndef DBG_LEVEL_FLOOR
+#define DBG_LEVEL_FLOOR DBG_LEVEL_DEBUG
+#endif
+
+// モジュールごとの実行時の出力レベル(dbgSetModuleLevelで変更する)
+extern atomic_uchar dbg_module_levels[DBG_MODULE_MAX];
+
+static inline bool dbgLevelEnabled(dbg_module_t module, dbg_level_t level)
+{
+    return level >= (dbg_level_t)atomic_load_explicit(
+                        &dbg_module_levels[module], memory_order_relaxed);
+}
+
+// モジュール/レベルでフィルタするdbgPrint
+// 出力しない場合はatomic load 1回だけで、mutexの取得や書式化は行わない
+#define DBG_PRINT(module, level, ...)                                          \
+    do                                                                         \
+    {                                                                          \
+        if ((level) >= DBG_LEVEL_FLOOR && dbgLevelEnabled((module), (level)))  \
+        {                                                                      \
+            dbgPrint((level), __VA_ARGS__);                                    \
+        }                                                                      \
+    } while (0)
+
+// トークン化ログのレコード
+// 書式文字列はアドレスをIDとして記録し、書式化は後でdbgFormat_taskが行う
+#define DBG_TOKEN_ARG_MAX 6
+typedef struct
+{
+    const char *format; // 書式文字列(ID)
+    uint32_t clock;     // 記録時刻[ms]
+    uint8_t level;      // dbg_level_t
+    uint8_t argCount;   // 引数の数
+    uintptr_t args[];   // 引数(ポインタ幅。RP2350では32bit)
+} dbgTokenRecord_t;
+
+// 書式化を後回しにするdbgPrint
+// 呼び出し側は引数をコピーするだけなので、高頻度のログに使用する
+// 制約:
+//  - 引数は最大DBG_TOKEN_ARG_MAX個の、uintptr_t以下の幅の整数/ポインタのみ
+//    (それより広い引数はコンパイルエラー。RP2350では64bit整数は使えない)
+//  - %sに渡す文字列は静的なもの(書式化時点でも有効なもの)に限る
+//  - 書式文字列は文字列リテラルであること
+// DBG_PRINTと同じく、モジュール/レベルでフィルタする
+#define DBG_PRINT_DEFERRED(module, level, format, ...)                         \
+    do                                                                         \
+    {                                                                          \
+        if ((level) >= DBG_LEVEL_FLOOR && dbgLevelEnabled((module), (level)))  \
+        {                                                                      \
+            dbgPrintDeferred(                                                  \
+                (level), (format),                                             \
+                DBG_TOKEN_NARGS(__VA_ARGS__) DBG_TOKEN_MAP(                    \
+                    DBG_TOKEN_NARGS(__VA_ARGS__), ##__VA_ARGS__));             \
+        }                                                                      \
+    } while (0)
+
+// 割り込みハンドラから使用できるdbgPrint
+// DBG_PRINT_DEFERREDと同じレコードを、待たずに一定回数の試行で書き込む
+// 書き込めなかった場合は破棄し、dbgFormat_taskが破棄数を出力する
+// 制約はDBG_PRINT_DEFERREDと同じ
+#define DBG_PRINT_FROM_ISR(module, level, format, ...)                         \
+    do                                                                         \
+    {                                                                          \
+        if ((level) >= DBG_LEVEL_FLOOR && dbgLevelEnabled((module), (level)))  \
+        {                                                                      \
+            dbgPrintFromISR((level), (format),                                 \
+                            DBG_TOKEN_NARGS(__VA_ARGS__) DBG_TOKEN_MAP(        \
+                                DBG_TOKEN_NARGS(__VA_ARGS__), ##__VA_ARGS__)); \
+        }                                                                      \
+    } while (0)
+
+// 引数の数を数える(0~6個)
+#define DBG_TOKEN_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define DBG_TOKEN_NARGS(...)                                                   \
+    DBG_TOKEN_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+
+// 各引数をuintptr_tに変換して並べる
+// 切り詰めないよう、uintptr_tより広い引数はコンパイルエラーにする
+// (配列は+0でポインタとして大きさを比べる)
+#define DBG_TOKEN_ARG(x)                                                       \
+    , ((uintptr_t)(x) +                                                        \
+       0 * sizeof(struct {                                                     \
+           _Static_assert(sizeof((x) + 0) <= sizeof(uintptr_t),                \
+                          "deferred log argument is wider than uintptr_t");    \
+           int unused;                                                         \
+       }))
+#define DBG_TOKEN_MAP_0()
+#define DBG_TOKEN_MAP_1(a) DBG_TOKEN_ARG(a)
+#define DBG_TOKEN_MAP_2(a, b) DBG_TOKEN_ARG(a) DBG_TOKEN_ARG(b)
+#define DBG_TOKEN_MAP_3(a, b, c) DBG_TOKEN_MAP_2(a, b) DBG_TOKEN_ARG(c)
+#define DBG_TOKEN_MAP_4(a, b, c, d) DBG_TOKEN_MAP_3(a, b, c) DBG_TOKEN_ARG(d)
+#define DBG_TOKEN_MAP_5(a, b, c, d, e)                                         \
+    DBG_TOKEN_MAP_4(a, b, c, d) DBG_TOKEN_ARG(e)
+#define DBG_TOKEN_MAP_6(a, b, c, d, e, f)                                      \
+    DBG_TOKEN_MAP_5(a, b, c, d, e) DBG_TOKEN_ARG(f)
+#define DBG_TOKEN_MAP__(n, ...) DBG_TOKEN_MAP_##n(__VA_ARGS__)
+#define DBG_TOKEN_MAP(n, ...) DBG_TOKEN_MAP__(n, ##__VA_ARGS__)
+
+// DBG_PRINT_FROM_ISR()の1回あたりの処理時間の統計(最悪値の確認用)
+// RP2350ではコアのサイクル数、それ以外ではマイクロ秒で計測する
+#if PICO_RP2350
+#define DBG_ISR_COST_UNIT "cycles"
+#else
+#define DBG_ISR_COST_UNIT "us"
+#endif
+typedef struct
+{
+    uint32_t count; // 計測回数
+    uint32_t max;   // 最大
+    uint32_t total; // 合計(平均 = total / count)
+} dbgIsrCost_t;
+
 extern bool init_dbgPrint(void);
 extern int32_t dbgPrint(dbg_level_t level, const char *format, ...);
+extern int32_t dbgPrintDeferred(dbg_level_t level, const char *format,
+                                uint32_t argCount, ...);
+extern int32_t dbgPrintFromISR(dbg_level_t level, const char *format,
+                               uint32_t argCount, ...);
+extern int32_t dbgSetModuleLevel(dbg_module_t module, dbg_level_t level);
+extern int32_t dbgSetModuleLevelByName(const char *module, const char *level);
+extern void dbgGetIsrCost(dbgIsrCost_t *cost);
+extern void dbgResetIsrCost(void);
 
 #endif // __DBG_PRINT__
@@ -0,0 +1,155 @@
+#include "command.h"
+#include "ring_buffer.h"
+#include "rtos_wrapper.h"
+#include "typedef.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+int32_t cmdRingBench(int argc, char **argv);
+static void ringBenchConsumer_task(void *params);
+static int32_t ringBenchRun(bool poll, uint32_t rounds);
+
+#define RING_BENCH_ROUNDS_DEFAULT 100
+#define RING_BENCH_ROUNDS_MAX 10000
+#define RING_BENCH_STACK_SIZE 256
+
+// producerからconsumerへ送るメッセージ
+typedef struct
+{
+    uint32_t stamp; // 格納した時刻[us]
+    uint32_t stop;  // 1ならconsumerを終了する
+} ringBenchMsg_t;
+
+RING_BUFFER_DEFINE(s_ringBench, 64);
+
+// 計測の設定と結果(cmdRingBenchとconsumerタスクで共有する)
+static bool s_ringBenchPoll;
+static rtos_task_handle_t s_ringBenchRequester;
+static atomic_uint s_ringBenchDone;
+static uint32_t s_ringBenchMaxUs;
+static uint64_t s_ringBenchTotalUs;
+
+// データ待ちのconsumer
+// poll=falseはringBufferDequeueWait(タスク通知)、
+// poll=trueは以前のusbTxと同じ1msごとのポーリングで待つ
+static void ringBenchConsumer_task(void *params)
+{
+    while (1)
+    {
+        ringBenchMsg_t msg;
+        int32_t ret;
+        if (s_ringBenchPoll)
+        {
+            while ((ret = ringBufferDequeue(&s_ringBench, (uint8_t *)&msg,
+                                            sizeof(msg))) == E_WOULDBLOCK)
+            {
+                rtos_task_delay(1);
+            }
+        }
+        else
+        {
+            ret = ringBufferDequeueWait(&s_ringBench, (uint8_t *)&msg,
+                                        sizeof(msg), MAX_DELAY);
+        }
+        uint32_t latency = time_us_32() - msg.stamp;
+        if (ret != sizeof(msg) || msg.stop)
+        {
+            break;
+        }
+
+        s_ringBenchMaxUs = (latency > s_ringBenchMaxUs) ? latency
+                                                        : s_ringBenchMaxUs;
+        s_ringBenchTotalUs += latency;
+        atomic_fetch_add_explicit(&s_ringBenchDone, 1, memory_order_release);
+        rtos_task_notify_give(s_ringBenchRequester);
+    }
+    atomic_fetch_add_explicit(&s_ringBenchDone, 1, memory_order_release);
+    rtos_task_notify_give(s_ringBenchRequester);
+    rtos_task_delete(NULL);
+}
+
+// consumerを起動し、rounds回のデータ格納から起床までの時間を計測する
+static int32_t ringBenchRun(bool poll, uint32_t rounds)
+{
+    ringBufferClear(&s_ringBench);
+    s_ringBenchPoll = poll;
+    s_ringBenchRequester = rtos_task_get_current();
+    s_ringBenchMaxUs = 0;
+    s_ringBenchTotalUs = 0;
+    atomic_store_explicit(&s_ringBenchDone, 0, memory_order_relaxed);
+
+    // 呼び出し元より優先度を上げ、起床後すぐに時刻を取れるようにする
+    if (rtos_task_create(ringBenchConsumer_task, "ringBench",
+                         RING_BENCH_STACK_SIZE, NULL, RTOS_PRIORITY_HIGH,
+                         RTOS_CORE_ANY, NULL) != RTOS_OK)
+    {
+        return E_NO_RESOURCE;
+    }
+
+    for (uint32_t i = 0; i <= rounds; i++)
+    {
+        // ポーリングの周期に対して格納のタイミングをずらす
+        rtos_task_delay(1 + (i % 3));
+
+        ringBenchMsg_t msg = {time_us_32(), (i == rounds)};
+        if (ringBufferEnqueueWait(&s_ringBench, (const uint8_t *)&msg,
+                                  sizeof(msg), 100) != sizeof(msg))
+        {
+            return E_TIMEOUT;
+        }
+        // 他の通知で起床する場合があるため、consumerの完了数で確認する
+        while (atomic_load_explicit(&s_ringBenchDone, memory_order_acquire) <=
+               i)
+        {
+            rtos_task_notify_take(100);
+        }
+    }
+    return E_SUCCESS;
+}
+
+// ringbench [rounds] : リングバッファのデータ待ちの起床時間を比較する
+// タスク通知(ringBufferDequeueWait)と1msポーリングそれぞれで、
+// データを格納してからconsumerが起床するまでの時間(平均/最大)を表示する
+int32_t cmdRingBench(int argc, char **argv)
+{
+    uint32_t rounds = RING_BENCH_ROUNDS_DEFAULT;
+    if (argc > 1)
+    {
+        rounds = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2 || rounds == 0 || rounds > RING_BENCH_ROUNDS_MAX)
+    {
+        commandReply("usage: ringbench [rounds(1-%d)]\r\n",
+                     RING_BENCH_ROUNDS_MAX);
+        return E_ARGUMENT;
+    }
+
+    static bool initialized = false;
+    if (!initialized)
+    {
+        if (!RING_BUFFER_INIT(s_ringBench, RING_BUFFER_MODE_SPSC))
+        {
+            return E_INIT;
+        }
+        initialized = true;
+    }
+
+    for (int poll = 0; poll <= 1; poll++)
+    {
+        int32_t ret = ringBenchRun(poll, rounds);
+        if (ret != E_SUCCESS)
+        {
+            commandReply("ringbench: failed (%d)\r\n", (int)ret);
+            return ret;
+        }
+        commandReply("ringbench: %s wake-up avg %u max %u us (%u rounds)\r\n",
+                     poll ? "poll 1ms" : "notify  ",
+                     (uint32_t)(s_ringBenchTotalUs / rounds), s_ringBenchMaxUs,
+                     rounds);
+    }
+    return E_SUCCESS;
+}
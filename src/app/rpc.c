@@ -0,0 +1,163 @@
+#include "rpc.h"
+#include "dbg_print.h"
+#include "rtos_wrapper.h"
+#include "usb_comm.h"
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+bool rpcInit(void);
+void rpcWorker_task(void *params);
+static void rpcHandle(const usbRxData_t *request);
+static rpcStatus_t rpcPing(const uint8_t *arg, size_t argLen, uint8_t *result,
+                           size_t *resultLen);
+static rpcStatus_t rpcDelay(const uint8_t *arg, size_t argLen,
+                            uint8_t *result, size_t *resultLen);
+static rpcStatus_t rpcGetLogLevel(const uint8_t *arg, size_t argLen,
+                                  uint8_t *result, size_t *resultLen);
+static rpcStatus_t rpcSetLogLevel(const uint8_t *arg, size_t argLen,
+                                  uint8_t *result, size_t *resultLen);
+
+_Static_assert(RPC_PAYLOAD_MAX <= USB_FRAME_PAYLOAD_MAX,
+               "RPC payload must fit in one frame");
+
+// 処理関数: 結果をresultに書き込み、その長さをresultLenに返す
+// resultにはRPC_DATA_MAXバイトまで書き込める
+typedef rpcStatus_t (*rpcHandler_t)(const uint8_t *arg, size_t argLen,
+                                    uint8_t *result, size_t *resultLen);
+
+static const rpcHandler_t s_rpcHandlers[RPC_METHOD_MAX] = {
+    [RPC_METHOD_PING] = rpcPing,
+    [RPC_METHOD_DELAY] = rpcDelay,
+    [RPC_METHOD_GET_LOG_LEVEL] = rpcGetLogLevel,
+    [RPC_METHOD_SET_LOG_LEVEL] = rpcSetLogLevel,
+};
+
+// 要求のQueue(全ワーカーで共有)
+// 受信ブロックの数以上の長さにしておくと、Queueが溢れる前にプールが空になり、
+// usbDrain_taskがブロックの返却を待つ。要求は捨てられず、USBの受信が止まる
+#define RPC_QUEUE_LENGTH USB_RX_BLOCK_NUM
+static uint8_t s_rpcQueueStorage[RPC_QUEUE_LENGTH * sizeof(usbRxData_t *)];
+static rtos_static_queue_buf_t s_rpcQueueBuf;
+static rtos_queue_t s_rpcQueue = NULL;
+
+bool rpcInit(void)
+{
+    s_rpcQueue = rtos_queue_create_static(
+        RPC_QUEUE_LENGTH, sizeof(usbRxData_t *), s_rpcQueueStorage,
+        &s_rpcQueueBuf);
+    if (s_rpcQueue == NULL)
+    {
+        return false;
+    }
+    return registerUsbRxChannelQueue(USB_CHANNEL_RPC, &s_rpcQueue) ==
+           E_SUCCESS;
+}
+
+void rpcWorker_task(void *params)
+{
+    while (1)
+    {
+        usbRxData_t *request;
+        if (rtos_queue_receive(s_rpcQueue, &request, MAX_DELAY) != RTOS_OK)
+        {
+            continue;
+        }
+        rpcHandle(request);
+        usbRxDataRelease(request);
+    }
+}
+
+static void rpcHandle(const usbRxData_t *request)
+{
+    if (request->dataLen < RPC_HEADER_SIZE ||
+        request->dataLen > RPC_PAYLOAD_MAX)
+    {
+        DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_WARN,
+                  "[rpc] invalid request length (%d bytes)\r\n",
+                  (int)request->dataLen);
+        return;
+    }
+
+    uint16_t id = rpcGetId(request->data);
+    uint8_t method = request->data[2];
+    uint8_t reply[RPC_PAYLOAD_MAX];
+    size_t resultLen = 0;
+    rpcStatus_t status = RPC_STATUS_NO_METHOD;
+    if (method < RPC_METHOD_MAX && s_rpcHandlers[method] != NULL)
+    {
+        status = s_rpcHandlers[method](&request->data[RPC_HEADER_SIZE],
+                                       request->dataLen - RPC_HEADER_SIZE,
+                                       &reply[RPC_HEADER_SIZE], &resultLen);
+    }
+    if (status != RPC_STATUS_OK)
+    {
+        resultLen = 0;
+    }
+
+    rpcPutHeader(reply, id, (uint8_t)status);
+    if (usbTxFrame(USB_CHANNEL_RPC, reply, RPC_HEADER_SIZE + resultLen) < 0)
+    {
+        DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_WARN,
+                  "[rpc] failed to send reply id=%d\r\n", id);
+        return;
+    }
+
+    // 後続の要求がある間は集約に任せて応答をまとめて送る
+    // 要求が途切れたら、集約の待ち時間を待たずに送る(1件ずつの往復を遅らせない)
+    if (rtos_queue_spaces_available(s_rpcQueue) == RPC_QUEUE_LENGTH)
+    {
+        usbFlushUrgent();
+    }
+}
+
+/****************************************************
+ * method
+ ****************************************************/
+
+static rpcStatus_t rpcPing(const uint8_t *arg, size_t argLen, uint8_t *result,
+                           size_t *resultLen)
+{
+    memcpy(result, arg, argLen);
+    *resultLen = argLen;
+    return RPC_STATUS_OK;
+}
+
+static rpcStatus_t rpcDelay(const uint8_t *arg, size_t argLen,
+                            uint8_t *result, size_t *resultLen)
+{
+    if (argLen != 2)
+    {
+        return RPC_STATUS_BAD_ARGUMENT;
+    }
+    rtos_task_delay(arg[0] | (arg[1] << 8));
+    return RPC_STATUS_OK;
+}
+
+static rpcStatus_t rpcGetLogLevel(const uint8_t *arg, size_t argLen,
+                                  uint8_t *result, size_t *resultLen)
+{
+    if (argLen != 1 || arg[0] >= DBG_MODULE_MAX)
+    {
+        return RPC_STATUS_BAD_ARGUMENT;
+    }
+    result[0] = atomic_load_explicit(&dbg_module_levels[arg[0]],
+                                     memory_order_relaxed);
+    *resultLen = 1;
+    return RPC_STATUS_OK;
+}
+
+static rpcStatus_t rpcSetLogLevel(const uint8_t *arg, size_t argLen,
+                                  uint8_t *result, size_t *resultLen)
+{
+    if (argLen != 2 || arg[0] >= DBG_MODULE_MAX)
+    {
+        return RPC_STATUS_BAD_ARGUMENT;
+    }
+    if (dbgSetModuleLevel((dbg_module_t)arg[0], (dbg_level_t)arg[1]) !=
+        E_SUCCESS)
+    {
+        return RPC_STATUS_BAD_ARGUMENT;
+    }
+    return RPC_STATUS_OK;
+}
@@ -0,0 +1,15 @@
+#ifndef RPC_H
+#define RPC_H
+
+#include "rpc_proto.h"
+#include "typedef.h"
+
+// USB上のバイナリRPC(形式はrpc_proto.h)
+// 要求はRPC_WORKER_NUM個のワーカータスクが1つのQueueから取り出して処理する
+// 時間のかかる要求があっても、他の要求の応答は先に返る
+#define RPC_WORKER_NUM 2
+
+extern bool rpcInit(void);
+extern void rpcWorker_task(void *params);
+
+#endif // RPC_H
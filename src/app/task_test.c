@@ -1,5 +1,7 @@
 #include "task_test.h"
+#include "command.h"
 #include "dbg_print.h"
+#include "line_framer.h"
 #include "pico/stdlib.h"
 #include "rtos_wrapper.h"
 #include "usb_comm.h"
@@ -15,73 +17,80 @@ void task1(void *pvParameters)
     static uint32_t count = 0;
     while (1)
     {
-        dbgPrint(DBG_LEVEL_INFO, "Task 1 is running. %d\r\n", count++);
+        // 定期的なログのため、書式化はdbgFormat_taskに任せる
+        DBG_PRINT_DEFERRED(DBG_MODULE_APP, DBG_LEVEL_INFO,
+                           "Task 1 is running. %d\r\n", count++);
         rtos_task_delay(1000);
     }
 }
 
+// コマンドの最大長
+#define TASK2_COMMAND_MAX 63
+
 static rtos_queue_t s_testQueue = NULL;
+static char s_lineBuffer[TASK2_COMMAND_MAX + 1];
 void task2(void *pvParameters)
 {
-    s_testQueue = rtos_queue_create(10, sizeof(usbRxData_t));
+    s_testQueue = rtos_queue_create(10, sizeof(usbRxData_t *));
     int8_t res_reg = registerUsbRxQueue(&s_testQueue);
     if (res_reg != E_SUCCESS)
     {
-        dbgPrint(DBG_LEVEL_ERROR,
-                 "Failed to register USB Rx Queue in Task 2\r\n");
+        DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_ERROR,
+                  "Failed to register USB Rx Queue in Task 2\r\n");
     }
 
+    // 長すぎるコマンドは途中で切ると別のコマンドになりうるため行ごと捨てる
+    lineFramer_t framer;
+    lineFramerInit(&framer, s_lineBuffer, sizeof(s_lineBuffer),
+                   LINE_OVERFLOW_DISCARD);
+
     rtos_result_t res_dequeue;
-    usbRxData_t rxData;
-    uint8_t command_buf[64] = {0};
-    uint8_t *pbuf = command_buf;
-    size_t len = 0;
+    usbRxData_t *rxData;
 
     while (1)
     {
         res_dequeue = rtos_queue_receive(s_testQueue, &rxData, MAX_DELAY);
         if (res_dequeue != RTOS_OK)
         {
-            dbgPrint(DBG_LEVEL_ERROR,
-                     "Task 2: Failed to receive from USB Rx Queue\r\n");
+            DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_ERROR,
+                      "Task 2: Failed to receive from USB Rx Queue\r\n");
             continue;
         }
 
-        // 一文字ずつバッファーに貯めていく
-        for (int i = 0; i < rxData.dataLen; i++)
+        size_t pos = 0;
+        while (pos < rxData->dataLen)
         {
-            if (rxData.data[i] == '\r')
+            line_t line;
+            lineStatus_t status;
+            pos += lineFramerFeed(&framer, &rxData->data[pos],
+                                  rxData->dataLen - pos, &line, &status);
+            if (status == LINE_STATUS_DISCARDED)
             {
-                // '\r'は処理しない。
-                // len, pbufともに更新しないでcontinue
+                DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_WARN,
+                          "Task 2: command too long (%d bytes)\r\n",
+                          (int)line.len);
                 continue;
             }
-
-            if (rxData.data[i] == '\n')
+            if (status != LINE_STATUS_OK || line.len == 0)
             {
-                // '\n'で区切りとみなす
-                dbgPrint(DBG_LEVEL_INFO, "Task 2: command received: %s\r\n",
-                         command_buf);
-                memset(command_buf, 0, sizeof(command_buf));
-                len = 0;
-                pbuf = command_buf;
                 continue;
             }
 
-            // バッファーオーバーフロー対策
-            if (len > sizeof(command_buf) - 1)
+            // rxDataは他の購読者と共有しているため書き換えられない
+            // 引数を区切れるよう'\0'終端のコピーを作る
+            char command[TASK2_COMMAND_MAX + 1];
+            memcpy(command, line.data, line.len);
+            command[line.len] = '\0';
+            DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_INFO,
+                      "Task 2: command received: %s\r\n", command);
+            if (commandExecute(command) != E_SUCCESS)
             {
-                dbgPrint(DBG_LEVEL_WARN, "Task 2: command too long\r\n");
-                memset(command_buf, 0, sizeof(command_buf));
-                len = 0;
-                pbuf = command_buf;
-                continue;
+                DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_WARN,
+                          "Task 2: command failed (\"help\" to list)\r\n");
             }
-
-            // そのほかの場合はバッファーに一文字ずつ追加
-            memcpy(pbuf, &rxData.data[i], 1);
-            pbuf++;
-            len++;
         }
+
+        // 受け取ったデータはプールに返す
+        usbRxDataRelease(rxData);
     }
 }
@@ -0,0 +1,104 @@
+#include "upload.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "command.h"
+#include "frame.h"
+#include "rtos_wrapper.h"
+#include "usb_comm.h"
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+bool uploadInit(void);
+void upload_task(void *params);
+int32_t cmdUpload(int argc, char **argv);
+
+// 受信データのQueue
+#define UPLOAD_QUEUE_LENGTH 4
+static uint8_t s_uploadQueueStorage[UPLOAD_QUEUE_LENGTH *
+                                    sizeof(usbRxData_t *)];
+static rtos_static_queue_buf_t s_uploadQueueBuf;
+static rtos_queue_t s_uploadQueue = NULL;
+
+// 受信の統計(upload_taskが更新する。resetは転送していない間に行うこと)
+static atomic_uint s_uploadFrames;
+static atomic_uint s_uploadBytes;
+static atomic_uint s_uploadCrc = 0xFFFF; // CRC-16/CCITT-FALSE(frameCrc16)
+// 1フレームごとの処理時間[ms](遅い書き込み先の模擬)
+static atomic_uint s_uploadDelayMs;
+
+bool uploadInit(void)
+{
+    s_uploadQueue = rtos_queue_create_static(
+        UPLOAD_QUEUE_LENGTH, sizeof(usbRxData_t *), s_uploadQueueStorage,
+        &s_uploadQueueBuf);
+    if (s_uploadQueue == NULL)
+    {
+        return false;
+    }
+    return registerUsbRxChannelQueue(USB_CHANNEL_UPLOAD, &s_uploadQueue) ==
+           E_SUCCESS;
+}
+
+void upload_task(void *params)
+{
+    while (1)
+    {
+        usbRxData_t *rxData;
+        if (rtos_queue_receive(s_uploadQueue, &rxData, MAX_DELAY) != RTOS_OK)
+        {
+            continue;
+        }
+
+        uint16_t crc =
+            atomic_load_explicit(&s_uploadCrc, memory_order_relaxed);
+        atomic_store_explicit(&s_uploadCrc,
+                              frameCrc16(crc, rxData->data, rxData->dataLen),
+                              memory_order_relaxed);
+        atomic_fetch_add_explicit(&s_uploadBytes, rxData->dataLen,
+                                  memory_order_relaxed);
+        atomic_fetch_add_explicit(&s_uploadFrames, 1, memory_order_relaxed);
+
+        uint32_t delayMs =
+            atomic_load_explicit(&s_uploadDelayMs, memory_order_relaxed);
+        if (delayMs > 0)
+        {
+            rtos_task_delay(delayMs);
+        }
+        usbRxDataRelease(rxData);
+    }
+}
+
+// upload [reset|delay <ms>] : 受信したフレーム数、バイト数、CRCを表示する
+//                             resetは統計を0に戻す(転送の前に行う)
+//                             delayは1フレームごとの処理時間を設定する
+int32_t cmdUpload(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "reset") == 0)
+    {
+        atomic_store_explicit(&s_uploadFrames, 0, memory_order_relaxed);
+        atomic_store_explicit(&s_uploadBytes, 0, memory_order_relaxed);
+        atomic_store_explicit(&s_uploadCrc, 0xFFFF, memory_order_relaxed);
+    }
+    else if (argc == 3 && strcmp(argv[1], "delay") == 0)
+    {
+        atomic_store_explicit(&s_uploadDelayMs, strtoul(argv[2], NULL, 10),
+                              memory_order_relaxed);
+    }
+    else if (argc != 1)
+    {
+        commandReply("usage: upload [reset|delay <ms>]\r\n");
+        return E_ARGUMENT;
+    }
+
+    commandReply("upload: %u frames, %u bytes, crc16 0x%04x, dropped %u, "
+                 "delay %u ms\r\n",
+                 atomic_load_explicit(&s_uploadFrames, memory_order_relaxed),
+                 atomic_load_explicit(&s_uploadBytes, memory_order_relaxed),
+                 atomic_load_explicit(&s_uploadCrc, memory_order_relaxed),
+                 usbRxGetDropCount(&s_uploadQueue),
+                 atomic_load_explicit(&s_uploadDelayMs, memory_order_relaxed));
+    return E_SUCCESS;
+}
@@ -0,0 +1,14 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include "typedef.h"
+
+// ホストからのファイル転送(tools/usb_upload.c)の受信側
+// USB_CHANNEL_UPLOADのフレームを受け取り、バイト数とCRCを数える
+// "upload"コマンドで表示し、ホスト側の表示と比べて欠落がないことを確認する
+// "upload delay <ms>"で1フレームごとの処理時間を模擬し、フロー制御を試せる
+
+extern bool uploadInit(void);
+extern void upload_task(void *params);
+
+#endif // UPLOAD_H
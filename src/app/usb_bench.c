@@ -0,0 +1,102 @@
+#include "command.h"
+#include "rtos_wrapper.h"
+#include "static_task.h"
+#include "typedef.h"
+#include "usb_comm.h"
+
+#include <stdlib.h>
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+int32_t cmdUsbBench(int argc, char **argv);
+static uint32_t usbBenchSqrt(uint64_t x);
+
+#define USB_BENCH_FRAMES_DEFAULT 1000
+#define USB_BENCH_FRAMES_MAX 100000
+
+static uint32_t usbBenchSqrt(uint64_t x)
+{
+    uint64_t r = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > x)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (x >= r + bit)
+        {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        }
+        else
+        {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+// usbbench [frames] : USBの送信のスループットとばらつきを測る
+// TELEMETRYチャネルにUSB_FRAME_PAYLOAD_MAXバイトのフレームをframes個送り、
+// 送信にかかった時間と、1フレームごとの間隔(平均/最大/標準偏差)を表示する
+// ホスト側はポートを読み続けていること(読まないとUSBが詰まり、待ち時間を測る)
+// "affinity pin" / "affinity float" と組み合わせて、タスクの配置を比較する
+int32_t cmdUsbBench(int argc, char **argv)
+{
+    uint32_t frames = USB_BENCH_FRAMES_DEFAULT;
+    if (argc > 1)
+    {
+        frames = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2 || frames == 0 || frames > USB_BENCH_FRAMES_MAX)
+    {
+        commandReply("usage: usbbench [frames(1-%d)]\r\n",
+                     USB_BENCH_FRAMES_MAX);
+        return E_ARGUMENT;
+    }
+
+    static uint8_t payload[USB_FRAME_PAYLOAD_MAX];
+    for (size_t i = 0; i < sizeof(payload); i++)
+    {
+        payload[i] = (uint8_t)i;
+    }
+
+    uint32_t failed = 0;
+    uint32_t maxGap = 0;
+    uint64_t sumSq = 0;
+    uint32_t start = time_us_32();
+    uint32_t prev = start;
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        if (usbTxFrame(USB_CHANNEL_TELEMETRY, payload, sizeof(payload)) < 0)
+        {
+            failed++;
+        }
+        uint32_t now = time_us_32();
+        uint32_t gap = now - prev;
+        prev = now;
+        maxGap = (gap > maxGap) ? gap : maxGap;
+        sumSq += (uint64_t)gap * gap;
+    }
+    uint32_t elapsed = prev - start;
+
+    // 平均と標準偏差(us)。分散は E[gap^2] - E[gap]^2
+    uint32_t mean = elapsed / frames;
+    uint64_t meanSq = sumSq / frames;
+    uint64_t mean2 = (uint64_t)mean * mean;
+    uint32_t sd = usbBenchSqrt((meanSq > mean2) ? meanSq - mean2 : 0);
+    uint32_t kbps = (elapsed > 0) ? (uint32_t)((uint64_t)frames *
+                                               sizeof(payload) * 1000 /
+                                               elapsed)
+                                  : 0;
+
+    commandReply("usbbench: %u frames x %u bytes, %u us, %u KB/s, "
+                 "gap avg %u max %u sd %u us, failed %u, core %u, %s\r\n",
+                 frames, (uint32_t)sizeof(payload), elapsed, kbps, mean,
+                 maxGap, sd, failed, rtos_core_get_id(),
+                 taskIsPinned() ? "pin" : "float");
+    return E_SUCCESS;
+}
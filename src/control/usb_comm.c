@@ -1,48 +1,199 @@
 #include "usb_comm.h"
 
+#include <stdatomic.h>
 #include <stdint.h>
 
 #include "dbg_print.h"
+#include "block_pool.h"
+#include "fmt.h"
+#include "frame.h"
+#include "log_ring.h"
 #include "ring_buffer.h"
 #include "rtos_wrapper.h"
 #include "typedef.h"
+#include "usb_transport.h"
 
 /****************************************************
  * static resource
  ****************************************************/
 #define USB_TX_BUFFER_SIZE 1024
-#define USB_RX_BUFFER_SIZE 256
-static uint8_t s_usbTxBuffer[USB_TX_BUFFER_SIZE]; // リングバッファーに使用
-static uint8_t s_usbFlushWorkBuffer[USB_TX_BUFFER_SIZE];
-static uint8_t s_usbRxBuffer[USB_RX_BUFFER_SIZE];
-ringBuffer_t s_usbTxRingBuffer;
-
-// タスク間同期用フラグ
-// 送信: リングバッファに入れたらフラッグを立てる
-rtos_static_flag_buf_t flag_buf_usbFlush;
-rtos_flag_t flag_usbFlush = NULL;
+RING_BUFFER_DEFINE(s_usbTxRingBuffer, USB_TX_BUFFER_SIZE);
+// 送信リングバッファはSPSCモードで使用する(consumerはusbFlush_taskのみ)
+// 複数のproducer(usbTx呼び出し元)同士はこのmutexで直列化する
+static rtos_static_mutex_buf_t s_mtxBufUsbTx;
+static rtos_mutex_t s_mtxUsbTx = NULL;
+
+// レコード送信用リングバッファ(dbgPrint等の1行単位の送信に使用)
+// 複数のproducerがmutexなしで同時に書き込める。consumerはusbFlush_taskのみ
+// コアごとに分け、別コアのproducerと確保位置(キャッシュライン)を奪い合わない
+// 各レコードの先頭には確保時刻を付け、usbFlushRecordsで時刻順にマージする
+// (NORMALレーン。HIGHレーンはs_usbTxLogRingHighを使用)
+#define USB_TX_RECORD_BUFFER_SIZE 2048 // 1コアあたり
+#define USB_TX_CORE_NUM 2
+LOG_RING_DEFINE(s_usbTxLogRingCore0, USB_TX_RECORD_BUFFER_SIZE);
+LOG_RING_DEFINE(s_usbTxLogRingCore1, USB_TX_RECORD_BUFFER_SIZE);
+static logRing_t *const s_usbTxLogRings[USB_TX_CORE_NUM] = {
+    &s_usbTxLogRingCore0, &s_usbTxLogRingCore1};
+// レコードの先頭に付ける確保時刻[us](送信はしない)
+#define USB_TX_RECORD_STAMP_SIZE sizeof(uint32_t)
+// HIGHレーンのレコード送信用リングバッファ(量は少ないためコアで分けない)
+#define USB_TX_HIGH_BUFFER_SIZE 1024
+LOG_RING_DEFINE(s_usbTxLogRingHigh, USB_TX_HIGH_BUFFER_SIZE);
+static logRing_t *const s_usbTxHighRings[1] = {&s_usbTxLogRingHigh};
+// レコードを格納するレーンとそのリング(BULKはs_usbTxRingBufferを使用)
+typedef struct
+{
+    logRing_t *const *rings;
+    int ringNum; // 2以上の場合はコアごとに分ける
+} usbTxRecordLane_t;
+static const usbTxRecordLane_t s_usbTxRecordLanes[USB_TX_LANE_BULK] = {
+    [USB_TX_LANE_HIGH] = {s_usbTxHighRings, 1},
+    [USB_TX_LANE_NORMAL] = {s_usbTxLogRings, USB_TX_CORE_NUM}};
+// レーンごとの1巡あたりの送信量[byte](0は無制限)
+static atomic_uint s_usbTxLaneBudget[USB_TX_LANE_MAX] = {
+    [USB_TX_LANE_HIGH] = 0,
+    [USB_TX_LANE_NORMAL] = 512,
+    [USB_TX_LANE_BULK] = 256};
+// レーンごとの滞留時間の統計
+static atomic_uint s_usbTxLaneLatencyCount[USB_TX_LANE_MAX];
+static atomic_uint s_usbTxLaneLatencyMaxUs[USB_TX_LANE_MAX];
+static atomic_uint s_usbTxLaneLatencyTotalUs[USB_TX_LANE_MAX];
+// BULKはバイト列のため、空の状態から格納された時刻で滞留時間を近似する
+static atomic_uint s_usbTxBulkSinceUs;
+
+// 小さなレコードをまとめて1回のUSB転送で送るためのバッファ
+// write()は呼び出しごとに転送するため、行単位で呼ぶと転送回数が増える
+#define USB_TX_BATCH_SIZE 256 // TinyUSBのCDC送信FIFOと同じサイズ
+static uint8_t s_usbTxBatchBuffer[USB_TX_BATCH_SIZE];
+
+// 送信バッファがいっぱいの場合の動作と、破棄したデータの統計
+static atomic_int s_usbTxOverflowPolicy = USB_TX_OVERFLOW_BLOCK;
+static atomic_uint s_usbTxDroppedBytes;
+static atomic_uint s_usbTxDroppedRecords;
+// 最後に通知してから破棄したバイト数(送信が追いついたら通知して0に戻す)
+static atomic_uint s_usbTxDroppedBytesUnreported;
+
+// 送信の集約(coalescing)
+// 未送信のバイト数と、それが0から増えた時刻[us]
+// 閾値に達するか時間が経過するまで、usbFlush_taskは送信を待つ
+static atomic_uint s_usbTxCoalesceBytes = USB_TX_COALESCE_BYTES_DEFAULT;
+static atomic_uint s_usbTxCoalesceUs = USB_TX_COALESCE_US_DEFAULT;
+static atomic_uint s_usbTxPendingBytes;
+static atomic_uint s_usbTxPendingSinceUs;
+static atomic_bool s_usbTxUrgent; // usbFlushUrgent()で立て、待たずに送信する
+// 送信の統計
+static atomic_uint s_usbTxTransfers;
+static atomic_uint s_usbTxSentBytes;
+static atomic_uint s_usbTxFlushErrors;
+
+// 下位の送受信経路(usbCommInit()より前にusbCommSetTransport()で変更できる)
+static const usbTransport_t *s_usbTransport = &usbTransportStdio;
+
+// タスク間同期
+// 送信: リングバッファに入れたらusbFlush_taskにタスク通知する
+static _Atomic(rtos_task_handle_t) s_usbFlushTask = NULL;
+// 送信: LogRingの空き待ちのタスク。usbFlushが領域を解放したら通知する
+#define USB_TX_SPACE_WAITER_MAX 4
+static _Atomic(rtos_task_handle_t) s_usbTxSpaceWaiters[USB_TX_SPACE_WAITER_MAX];
 // 受信: コールバックでフラッグを立てる
 rtos_static_flag_buf_t flag_buf_usbDrain;
 rtos_flag_t flag_usbDrain = NULL;
 
+// フレーム
+// 送信: チャネルごとの連番
+static atomic_uchar s_usbTxFrameSeq[USB_CHANNEL_MAX];
+_Static_assert(FRAME_ENCODED_MAX(USB_FRAME_PAYLOAD_MAX) <= USB_TX_RECORD_MAX,
+               "USB_FRAME_PAYLOAD_MAX must fit in one TX record");
+// 受信: バイト列からフレームを取り出すデコーダー(usbDrain_taskのみ使用)
+static uint8_t s_usbRxFrameBuffer[FRAME_ENCODED_MAX(USB_FRAME_PAYLOAD_MAX)];
+static frameDecoder_t s_usbRxFrameDecoder;
+// 受信: フレームの途中か(区切りの後から、フレームの終わりの区切りまで)
+static bool s_usbRxInFrame;
+_Static_assert(USB_FRAME_PAYLOAD_MAX <= USBRX_DATA_MAX_SIZE,
+               "USB_FRAME_PAYLOAD_MAX must fit in one RX block");
+
+// 受信データ用プール
+// 受信データはブロックに直接読み込み、ポインタのままアプリケーションに渡す
+BLOCK_POOL_DEFINE(s_usbRxPool, USB_RX_BLOCK_SIZE, USB_RX_BLOCK_NUM);
+
+// 受信のフロー制御
+// 受信用プールか購読者のQueueの空きが少なくなったらFLOW_OFFフレームを送り、
+// 十分に空いたらFLOW_ONフレームを送る(ホストはこれに従って送信を止める)
+#define USB_RX_FLOW_OFF_FREE_BLOCKS 2
+#define USB_RX_FLOW_ON_FREE_BLOCKS (USB_RX_BLOCK_NUM / 2)
+#define USB_RX_FLOW_OFF_QUEUE_SPACES 2
+#define USB_RX_FLOW_ON_QUEUE_SPACES 4
+// Queueがいっぱいの場合は、FLOW_OFFを送ってから空くまで待つ
+// (usbDrain_taskが止まるとUSBの受信も止まり、ホストからの送信は失われない)
+// 待っても空かない購読者(止まっているタスク等)の分だけ、この時間で破棄する
+#define USB_RX_FLOW_OFF_WAIT_MS 1000
+static atomic_bool s_usbRxFlowOff;
+// usbDrain_taskを起床させる理由
+#define USB_DRAIN_BIT_RECV BIT_0 // 受信データあり
+#define USB_DRAIN_BIT_FLOW BIT_1 // FLOW_OFF中に空きができた
+
 // 受信アプリケーションへの伝達用Queue
 // 各アプリケーションでqueueを作成し、registerUsbRxQueue()で登録する
-static usbRxData_t s_usbRxData; // 受信データ格納用構造体
-#define MAX_USBRX_APP_QUEUE 4
 usbRxQueue_t s_usbRxAppQueues[MAX_USBRX_APP_QUEUE];
 
 /****************************************************
  * forward declaration
  ****************************************************/
 bool usbCommInit();
+int32_t usbCommSetTransport(const usbTransport_t *transport);
 int32_t usbBufferEnqueue(const char *str, size_t len);
 int32_t usbFlush();
+int32_t usbFlushRecords(usbTxLane_t lane, size_t budget);
+int32_t usbFlushBulk(size_t budget);
 int32_t usbTx(const char *str, size_t len);
+int32_t usbTxv(const usbTxVec_t *vec, size_t count);
+int32_t usbTxFrame(uint8_t channel, const void *data, size_t len);
+static int32_t usbTxFrameLane(usbTxLane_t lane, uint8_t channel,
+                              const void *data, size_t len);
+uint8_t *usbTxRecordReserve(size_t len);
+uint8_t *usbTxRecordReserveLane(usbTxLane_t lane, size_t len);
+static uint8_t *usbTxRecordAcquire(usbTxLane_t lane, size_t len);
+void usbTxRecordCommit(uint8_t *record, size_t len);
+void usbTxSetOverflowPolicy(usbTxOverflowPolicy_t policy);
+usbTxOverflowPolicy_t usbTxGetOverflowPolicy(void);
+void usbTxGetDropStats(usbTxDropStats_t *stats);
+void usbTxCountDrop(size_t bytes);
+static void usbTxCountDropRecord(size_t bytes);
+void usbTxSetCoalesce(size_t bytes, uint32_t us);
+void usbFlushUrgent(void);
+void usbTxGetFlushStats(usbTxFlushStats_t *stats);
+static void usbTxAddPending(size_t bytes);
+static void usbTxSubPending(int32_t sent);
+static bool usbTxHasSpaceWaiters();
+static void usbTxPut(const uint8_t *data, size_t len);
+static logRing_t *usbTxLaneRing(usbTxLane_t lane);
+static logRing_t *usbTxRecordRing(const uint8_t *record, usbTxLane_t *lane);
+static int usbTxOldestRing(usbTxLane_t lane, const uint8_t **record,
+                           size_t *recordLen, uint32_t *stamp);
+int32_t usbTxSetLaneBudget(usbTxLane_t lane, size_t bytes);
+int32_t usbTxGetLaneLatency(usbTxLane_t lane, usbTxLaneLatency_t *latency);
+void usbTxResetLaneLatency(void);
+static void usbTxAddLaneLatency(usbTxLane_t lane, uint32_t sinceUs);
+int usbTxSpaceWaiterAdd(rtos_task_handle_t task);
+void usbTxSpaceWaiterRemove(int slot);
+void usbTxNotifySpaceWaiters();
+void usbFlushDropMarker();
 void usbRecv_callback(void *params);
-bool makeRxData(const uint8_t *data, size_t len);
+static void usbRecvTask_callback(void *params);
+usbRxData_t *makeRxData(uint8_t id, const uint8_t *data, size_t len);
 bool enqueueUsbRxData_App(usbRxData_t *p_data);
+void usbRxDataRelease(usbRxData_t *p_data);
+size_t dispatchUsbRxFrames(uint8_t *data, size_t len, bool *undelivered);
 void initUsbRxAppQueues();
 int8_t registerUsbRxQueue(rtos_queue_t *p_appQueue);
+int8_t registerUsbRxChannelQueue(uint8_t channel, rtos_queue_t *p_appQueue);
+int8_t registerUsbRxSubscriber(uint8_t channel, const void *prefix,
+                               size_t prefixLen, rtos_queue_t *p_appQueue);
+uint32_t usbRxGetDropCount(rtos_queue_t *p_appQueue);
+bool usbRxIsFlowOff(void);
+static void usbRxFlowUpdate(void);
+static bool usbRxSubscriberMatch(const usbRxQueue_t *sub,
+                                 const usbRxData_t *p_data);
 
 /****************************************************
  * Init Proc
@@ -54,20 +205,26 @@ bool usbCommInit()
     {
         return true;
     }
-    if (!stdio_usb_init())
+    if (!s_usbTransport->open())
     {
         return false;
     }
 
     // リングバッファの初期化
-    if (ringBufferInit(&s_usbTxRingBuffer, s_usbTxBuffer, USB_TX_BUFFER_SIZE) !=
-        E_SUCCESS)
+    if (!RING_BUFFER_INIT(s_usbTxRingBuffer, RING_BUFFER_MODE_SPSC))
+    {
+        return false;
+    }
+
+    s_mtxUsbTx = rtos_mutex_create_static(&s_mtxBufUsbTx);
+    if (s_mtxUsbTx == NULL)
     {
         return false;
     }
 
-    flag_usbFlush = rtos_flag_create_static(&flag_buf_usbFlush);
-    if (flag_usbFlush == NULL)
+    if (!LOG_RING_INIT(s_usbTxLogRingCore0) ||
+        !LOG_RING_INIT(s_usbTxLogRingCore1) ||
+        !LOG_RING_INIT(s_usbTxLogRingHigh))
     {
         return false;
     }
@@ -78,19 +235,45 @@ bool usbCommInit()
         return false;
     }
 
-    stdio_set_chars_available_callback(usbRecv_callback, NULL);
+    s_usbTransport->setRxCallback(s_usbTransport->rxCallbackFromIsr
+                                      ? usbRecv_callback
+                                      : usbRecvTask_callback,
+                                  NULL);
+
+    if (!BLOCK_POOL_INIT(s_usbRxPool))
+    {
+        return false;
+    }
 
     initUsbRxAppQueues();
+    frameDecoderInit(&s_usbRxFrameDecoder, s_usbRxFrameBuffer,
+                     sizeof(s_usbRxFrameBuffer));
 
     isInitialized = 1;
     return true;
 }
 
+// 送受信経路を差し替える(ホストでのテスト等)。usbCommInit()より前に呼ぶこと
+int32_t usbCommSetTransport(const usbTransport_t *transport)
+{
+    if (transport == NULL || transport->open == NULL ||
+        transport->write == NULL || transport->read == NULL ||
+        transport->setRxCallback == NULL)
+    {
+        return E_ARGUMENT;
+    }
+    s_usbTransport = transport;
+    return E_SUCCESS;
+}
+
 /****************************************************
  * USB TX
- *  1. UsbTxが呼ばれたら、RingBufferにデータ格納
- *  2. データ格納時にタスク通知
+ *  1. UsbTxが呼ばれたら、1メッセージを1レコードとしてLogRingに格納
+ *     (usbBufferEnqueueはバイト列としてRingBufferに格納)
+ *     格納先は優先度レーン(HIGH/NORMAL/BULK)ごとに分かれている
+ *  2. データ格納時にusbFlush_taskへタスク通知
  *  3. usbFlush_taskで格納されたデータを送信
+ *     未送信データが閾値に達するか一定時間経過するまで待ち、まとめて送信する
  ****************************************************/
 int32_t usbBufferEnqueue(const char *str, size_t len)
 {
@@ -100,76 +283,695 @@ int32_t usbBufferEnqueue(const char *str, size_t len)
     }
 
     ringBuffer_t *pRb = &s_usbTxRingBuffer;
+    rtos_mutex_take(s_mtxUsbTx);
+    if (ringBufferAvailableSize(pRb) == USB_TX_BUFFER_SIZE)
+    {
+        atomic_store_explicit(&s_usbTxBulkSinceUs, time_us_32(),
+                              memory_order_relaxed);
+    }
     int32_t ret = ringBufferEnqueue(pRb, (const uint8_t *)str, len);
+    rtos_mutex_give(s_mtxUsbTx);
 
+    // usbFlush_taskへの通知はringBufferEnqueue内で行われる
     if (ret > 0)
     {
-        rtos_bit_t bit = rtos_flag_set(flag_usbFlush, BIT_0);
+        usbTxAddPending(ret);
     }
-
     return ret;
 }
 
+// HIGHレーンは常に全て送信し、NORMAL/BULKはbudgetずつ交互に送信する
+// NORMALの送信後にもHIGHを確認するため、HIGHの待ちは最大でNORMAL 1巡分
 int32_t usbFlush()
 {
-    int32_t ret = E_OTHER;
+    int32_t ret = 0;
+    int32_t sent;
+
+    do
+    {
+        sent = usbFlushRecords(USB_TX_LANE_HIGH, 0);
+        sent += usbFlushRecords(
+            USB_TX_LANE_NORMAL,
+            atomic_load_explicit(&s_usbTxLaneBudget[USB_TX_LANE_NORMAL],
+                                 memory_order_relaxed));
+        sent += usbFlushRecords(USB_TX_LANE_HIGH, 0);
+
+        int32_t bulk = usbFlushBulk(atomic_load_explicit(
+            &s_usbTxLaneBudget[USB_TX_LANE_BULK], memory_order_relaxed));
+        if (bulk < 0)
+        {
+            return bulk;
+        }
+        sent += bulk;
+        ret += sent;
+    } while (sent > 0);
+
+    usbFlushDropMarker();
+    return ret;
+}
+
+// BULKレーン(バイト列)をbudgetバイトまで送信する(0は無制限)
+// リングバッファ内のデータをコピーせずにそのまま送信する
+int32_t usbFlushBulk(size_t budget)
+{
+    int32_t ret = 0;
     ringBuffer_t *pRb = &s_usbTxRingBuffer;
+    ringBufferSpan_t span;
+
+    if (ringBufferPeekContiguous(pRb, &span) == 0)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < RING_BUFFER_SPAN_MAX; i++)
+    {
+        size_t len = span.len[i];
+        if (budget > 0 && len > budget - ret)
+        {
+            len = budget - ret;
+        }
+        if (len == 0)
+        {
+            continue;
+        }
 
-    while (ringBufferAvailableSize(pRb) > 0)
+        usbTxPut(span.data[i], len);
+
+        // 送信済みの領域を解放する
+        int32_t consumed = ringBufferConsume(pRb, len);
+        if (consumed < 0)
+        {
+            // SPSCモードのためproducerと並行してClearはできない
+            // usbFlush_task内のためログは出さない(BLOCKではHIGHレーンが
+            // いっぱいの場合に自身の送信を待ち続ける)。統計にだけ数える
+            atomic_fetch_add_explicit(&s_usbTxFlushErrors, 1,
+                                      memory_order_relaxed);
+            return consumed;
+        }
+        ret += consumed;
+    }
+
+    if (ret > 0)
+    {
+        usbTxAddLaneLatency(USB_TX_LANE_BULK,
+                            atomic_load_explicit(&s_usbTxBulkSinceUs,
+                                                 memory_order_relaxed));
+    }
+    return ret;
+}
+
+// 破棄が発生していた場合、送信が追いついた時点で1度だけストリームに通知する
+void usbFlushDropMarker()
+{
+    uint32_t dropped = atomic_exchange_explicit(&s_usbTxDroppedBytesUnreported,
+                                                0, memory_order_relaxed);
+    if (dropped == 0)
     {
-        int32_t len =
-            ringBufferDequeue(pRb, s_usbFlushWorkBuffer, USB_TX_BUFFER_SIZE);
-        if (len == E_WOULDBLOCK)
+        return;
+    }
+
+    char marker[48];
+    int len = fmtFormat(marker, sizeof(marker),
+                        "\r\n[usb_comm] %u bytes dropped\r\n",
+                        (unsigned int)dropped);
+    if (len > 0)
+    {
+        usbTxPut((const uint8_t *)marker, len);
+    }
+}
+
+// laneの各コアのリングの先頭レコードのうち、最も古いものを返す
+// 戻り値はそのリングの番号。確定済みのレコードがなければ-1
+// 書き込み中のレコードは待たないため、コア間の順序は確定順に近い近似となる
+static int usbTxOldestRing(usbTxLane_t lane, const uint8_t **record,
+                           size_t *recordLen, uint32_t *stamp)
+{
+    const usbTxRecordLane_t *l = &s_usbTxRecordLanes[lane];
+    int oldest = -1;
+    uint32_t oldestStamp = 0;
+    for (int i = 0; i < l->ringNum; i++)
+    {
+        const uint8_t *data;
+        size_t len;
+        if (!logRingPeek(l->rings[i], &data, &len))
+        {
+            continue;
+        }
+
+        uint32_t s;
+        memcpy(&s, data, sizeof(s));
+        // 時刻のラップアラウンドを考慮して差分で比較する
+        if (oldest < 0 || (int32_t)(s - oldestStamp) < 0)
         {
-            ret = 0;
-            break;
+            oldest = i;
+            oldestStamp = s;
+            *stamp = s;
+            *record = data + USB_TX_RECORD_STAMP_SIZE;
+            *recordLen = (len > USB_TX_RECORD_STAMP_SIZE)
+                             ? len - USB_TX_RECORD_STAMP_SIZE
+                             : 0;
         }
-        else if (len < 0)
+    }
+    return oldest;
+}
+
+// laneの確定済みのレコードを時刻順に、budgetバイトに達するまで送信する
+// (0は無制限。レコードは分割しないため、budgetを1レコード分超える場合がある)
+// 小さなレコードはバッチバッファにまとめ、レコード単位(行単位)で転送する
+// バッチに入りきらないレコードはコピーせずにそのまま送信する
+int32_t usbFlushRecords(usbTxLane_t lane, size_t budget)
+{
+    int32_t ret = 0;
+    size_t batchLen = 0;
+    const uint8_t *record;
+    size_t recordLen;
+    uint32_t stamp;
+    int ring;
+
+    while ((budget == 0 || (size_t)ret < budget) &&
+           (ring = usbTxOldestRing(lane, &record, &recordLen, &stamp)) >= 0)
+    {
+        // 入りきらない場合は溜まっている分を先に送信する
+        if (batchLen > 0 && batchLen + recordLen > USB_TX_BATCH_SIZE)
         {
-            dbgPrint(DBG_LEVEL_ERROR, "usbFlush: ringBufferDequeue error\r\n");
-            ringBufferClear(pRb);
-            ret = len;
-            break;
+            usbTxPut(s_usbTxBatchBuffer, batchLen);
+            batchLen = 0;
         }
 
-        ret = stdio_put_string((const char *)s_usbFlushWorkBuffer, len, false,
-                               false);
-        if (ret < 0)
+        if (recordLen >= USB_TX_BATCH_SIZE)
         {
-            ret = E_USBCOMM;
+            usbTxPut(record, recordLen);
         }
+        else if (recordLen > 0)
+        {
+            memcpy(&s_usbTxBatchBuffer[batchLen], record, recordLen);
+            batchLen += recordLen;
+        }
+        logRingRelease(s_usbTxRecordLanes[lane].rings[ring]);
+        usbTxAddLaneLatency(lane, stamp);
+        ret += recordLen;
+    }
+
+    if (batchLen > 0)
+    {
+        usbTxPut(s_usbTxBatchBuffer, batchLen);
+    }
+
+    if (ret > 0)
+    {
+        usbTxNotifySpaceWaiters();
     }
     return ret;
 }
 
+// 1メッセージを1レコードとして送信する
+// USB_TX_RECORD_MAX以下のメッセージは分割されず、他のタスクの出力とも混ざらない
+// それより長い場合はUSB_TX_RECORD_MAXごとのレコードに分けて送信する
 int32_t usbTx(const char *str, size_t len)
 {
-    int32_t totalSent = 0;
-    int32_t ret = E_OTHER;
+    if (str == NULL || len == 0)
+    {
+        return 0;
+    }
+
+    size_t totalSent = 0;
     while (totalSent < len)
     {
-        ret = usbBufferEnqueue(str + totalSent, len - totalSent);
-        if (ret == E_WOULDBLOCK)
+        size_t chunkLen = len - totalSent;
+        if (chunkLen > USB_TX_RECORD_MAX)
         {
-            rtos_task_delay(1); // バッファがいっぱいなら少し待つ
-            continue;
+            chunkLen = USB_TX_RECORD_MAX;
         }
-        if (ret < 0)
+
+        // 1レコード分の空きができるまで待ち、一括で書き込む
+        uint8_t *record = usbTxRecordAcquire(USB_TX_LANE_NORMAL, chunkLen);
+        if (record == NULL)
         {
-            return ret; // エラー
+            // DROP_NEWの場合、残りのメッセージも破棄し、1レコードとして数える
+            usbTxCountDropRecord(len - totalSent);
+            return E_WOULDBLOCK;
         }
-        totalSent += ret;
+        memcpy(record, str + totalSent, chunkLen);
+        usbTxRecordCommit(record, chunkLen);
+        totalSent += chunkLen;
     }
     return totalSent;
 }
 
+// 複数の断片(ヘッダーとpayload等)を連結して1レコードとして送信する
+// 断片は確保したレコードに直接コピーするため、連結用の中間バッファは不要
+// 合計がUSB_TX_RECORD_MAXを超える場合は1レコードにできないためE_BUFSIZE
+int32_t usbTxv(const usbTxVec_t *vec, size_t count)
+{
+    if (vec == NULL && count > 0)
+    {
+        return E_ARGUMENT;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (vec[i].data == NULL && vec[i].len > 0)
+        {
+            return E_ARGUMENT;
+        }
+        total += vec[i].len;
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    if (total > USB_TX_RECORD_MAX)
+    {
+        return E_BUFSIZE;
+    }
+
+    uint8_t *record = usbTxRecordReserve(total);
+    if (record == NULL)
+    {
+        return E_WOULDBLOCK; // DROP_NEWで破棄された
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(record + offset, vec[i].data, vec[i].len);
+        offset += vec[i].len;
+    }
+    usbTxRecordCommit(record, total);
+    return total;
+}
+
+// NORMALレーンに送信レコードの書き込み領域を確保する
+uint8_t *usbTxRecordReserve(size_t len)
+{
+    return usbTxRecordReserveLane(USB_TX_LANE_NORMAL, len);
+}
+
+// laneのリングを返す(コアごとに分かれている場合は実行中のコアのもの)
+static logRing_t *usbTxLaneRing(usbTxLane_t lane)
+{
+    const usbTxRecordLane_t *l = &s_usbTxRecordLanes[lane];
+    return l->rings[(l->ringNum > 1) ? rtos_core_get_id() : 0];
+}
+
+// channelのフレーム(frame.h)として送信する
+// 確保したレコードに直接エンコードするため、エンコード用の中間バッファは不要
+int32_t usbTxFrame(uint8_t channel, const void *data, size_t len)
+{
+    return usbTxFrameLane(USB_TX_LANE_NORMAL, channel, data, len);
+}
+
+static int32_t usbTxFrameLane(usbTxLane_t lane, uint8_t channel,
+                              const void *data, size_t len)
+{
+    if (channel >= USB_CHANNEL_MAX || (data == NULL && len > 0))
+    {
+        return E_ARGUMENT;
+    }
+    if (len > USB_FRAME_PAYLOAD_MAX)
+    {
+        return E_BUFSIZE;
+    }
+
+    size_t maxLen = FRAME_ENCODED_MAX(len);
+    uint8_t *record = usbTxRecordReserveLane(lane, maxLen);
+    if (record == NULL)
+    {
+        return E_WOULDBLOCK; // DROP_NEWで破棄された
+    }
+
+    uint8_t seq = atomic_fetch_add_explicit(&s_usbTxFrameSeq[channel], 1,
+                                            memory_order_relaxed);
+    size_t encodedLen = frameEncode(channel, seq, data, len, record, maxLen);
+    usbTxRecordCommit(record, encodedLen);
+    return len;
+}
+
+// 送信レコードの書き込み領域を、laneのリングに確保する
+// 空きがなければ待つ。USB_TX_RECORD_MAXを超える場合やBULKレーンの場合はNULL
+// DROP_NEWの場合は待たずにNULLを返し、確保しようとしたサイズを破棄として数える
+uint8_t *usbTxRecordReserveLane(usbTxLane_t lane, size_t len)
+{
+    if (lane >= USB_TX_LANE_BULK || len == 0 || len > USB_TX_RECORD_MAX)
+    {
+        return NULL;
+    }
+
+    uint8_t *record = usbTxRecordAcquire(lane, len);
+    if (record == NULL)
+    {
+        usbTxCountDropRecord(len);
+    }
+    return record;
+}
+
+// usbTxRecordReserveLane()の本体。DROP_NEWでNULLを返す場合も破棄は数えない
+// (複数レコードに分けて送るusbTx()が、メッセージ単位で数えるため)
+static uint8_t *usbTxRecordAcquire(usbTxLane_t lane, size_t len)
+{
+    if (lane >= USB_TX_LANE_BULK || len == 0 || len > USB_TX_RECORD_MAX)
+    {
+        return NULL;
+    }
+
+    size_t size = USB_TX_RECORD_STAMP_SIZE + len;
+    uint8_t *record = logRingReserve(usbTxLaneRing(lane), size);
+    if (record != NULL)
+    {
+        goto reserved;
+    }
+
+    if (atomic_load_explicit(&s_usbTxOverflowPolicy, memory_order_relaxed) ==
+        USB_TX_OVERFLOW_DROP_NEW)
+    {
+        return NULL;
+    }
+
+    // 空き待ちとして登録してから再確認し、usbFlushが領域を解放したら起床する
+    // 待っている間に別のコアに移る場合があるため、毎回コアを確認する
+    int slot = usbTxSpaceWaiterAdd(rtos_task_get_current());
+    while ((record = logRingReserve(usbTxLaneRing(lane), size)) == NULL)
+    {
+        if (slot < 0)
+        {
+            rtos_task_delay(1); // 登録できなかった場合はポーリングで待つ
+            continue;
+        }
+        rtos_task_notify_take(MAX_DELAY);
+    }
+    usbTxSpaceWaiterRemove(slot);
+
+reserved:;
+    uint32_t stamp = time_us_32();
+    memcpy(record, &stamp, sizeof(stamp));
+    return record + USB_TX_RECORD_STAMP_SIZE;
+}
+
+// recordを確保したリングとそのレーンを返す
+// 確保後に別のコアに移ったタスクもいるため、実行中のコアではなく格納先で判定する
+static logRing_t *usbTxRecordRing(const uint8_t *record, usbTxLane_t *lane)
+{
+    for (int l = 0; l < USB_TX_LANE_BULK; l++)
+    {
+        for (int i = 0; i < s_usbTxRecordLanes[l].ringNum; i++)
+        {
+            logRing_t *lr = s_usbTxRecordLanes[l].rings[i];
+            if (record >= lr->buffer && record < lr->buffer + lr->bufferSize)
+            {
+                *lane = (usbTxLane_t)l;
+                return lr;
+            }
+        }
+    }
+    return NULL;
+}
+
+// 書き込んだレコードを確定し、送信タスクに通知する
+// HIGHレーンの場合は集約を待たずに送信させる
+void usbTxRecordCommit(uint8_t *record, size_t len)
+{
+    if (record == NULL)
+    {
+        return;
+    }
+    record -= USB_TX_RECORD_STAMP_SIZE;
+    usbTxLane_t lane = USB_TX_LANE_NORMAL;
+    logRingCommit(usbTxRecordRing(record, &lane), record,
+                  USB_TX_RECORD_STAMP_SIZE + len);
+    usbTxAddPending(len);
+    if (lane == USB_TX_LANE_HIGH)
+    {
+        usbFlushUrgent();
+        return;
+    }
+    rtos_task_notify_give(
+        atomic_load_explicit(&s_usbFlushTask, memory_order_acquire));
+}
+
+// 1回のUSB転送。送信の統計を更新する
+static void usbTxPut(const uint8_t *data, size_t len)
+{
+    s_usbTransport->write(data, len);
+    atomic_fetch_add_explicit(&s_usbTxTransfers, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_usbTxSentBytes, len, memory_order_relaxed);
+}
+
+// 未送信のバイト数を加算する。0から増えた場合は集約の待ち時間の起点とする
+static void usbTxAddPending(size_t bytes)
+{
+    if (atomic_fetch_add_explicit(&s_usbTxPendingBytes, bytes,
+                                  memory_order_relaxed) == 0)
+    {
+        atomic_store_explicit(&s_usbTxPendingSinceUs, time_us_32(),
+                              memory_order_relaxed);
+    }
+}
+
+// 送信したバイト数を減算する
+// 送信中に追加された分は残し、残った分の待ち時間は今から数える
+static void usbTxSubPending(int32_t sent)
+{
+    if (sent <= 0)
+    {
+        return;
+    }
+    uint32_t pending =
+        atomic_load_explicit(&s_usbTxPendingBytes, memory_order_relaxed);
+    uint32_t remain;
+    do
+    {
+        // 加算前のデータも送信した場合があるため、0未満にはしない
+        remain = (pending > (uint32_t)sent) ? pending - sent : 0;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &s_usbTxPendingBytes, &pending, remain, memory_order_relaxed,
+        memory_order_relaxed));
+
+    if (remain > 0)
+    {
+        atomic_store_explicit(&s_usbTxPendingSinceUs, time_us_32(),
+                              memory_order_relaxed);
+    }
+}
+
+// 集約の閾値を設定する
+// bytesは送信バッファの半分まで(空き待ちになる前に送信を始めるため)
+// どちらかが0の場合は集約せず、通知のたびに送信する
+void usbTxSetCoalesce(size_t bytes, uint32_t us)
+{
+    if (bytes > USB_TX_BUFFER_SIZE / 2)
+    {
+        bytes = USB_TX_BUFFER_SIZE / 2;
+    }
+    atomic_store_explicit(&s_usbTxCoalesceBytes, bytes, memory_order_relaxed);
+    atomic_store_explicit(&s_usbTxCoalesceUs, us, memory_order_relaxed);
+}
+
+// 閾値を待たずに送信させる(ERRORレベルのログ等)
+void usbFlushUrgent(void)
+{
+    atomic_store_explicit(&s_usbTxUrgent, true, memory_order_release);
+    rtos_task_notify_give(
+        atomic_load_explicit(&s_usbFlushTask, memory_order_acquire));
+}
+
+void usbTxGetFlushStats(usbTxFlushStats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+    stats->transfers =
+        atomic_load_explicit(&s_usbTxTransfers, memory_order_relaxed);
+    stats->bytes =
+        atomic_load_explicit(&s_usbTxSentBytes, memory_order_relaxed);
+    stats->errors =
+        atomic_load_explicit(&s_usbTxFlushErrors, memory_order_relaxed);
+}
+
+// 空いているスロットに登録する。空きがなければ-1
+int usbTxSpaceWaiterAdd(rtos_task_handle_t task)
+{
+    for (int i = 0; i < USB_TX_SPACE_WAITER_MAX; i++)
+    {
+        rtos_task_handle_t empty = NULL;
+        if (atomic_compare_exchange_strong(&s_usbTxSpaceWaiters[i], &empty,
+                                           task))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void usbTxSpaceWaiterRemove(int slot)
+{
+    if (slot < 0 || slot >= USB_TX_SPACE_WAITER_MAX)
+    {
+        return;
+    }
+    atomic_store(&s_usbTxSpaceWaiters[slot], NULL);
+}
+
+static bool usbTxHasSpaceWaiters()
+{
+    for (int i = 0; i < USB_TX_SPACE_WAITER_MAX; i++)
+    {
+        if (atomic_load(&s_usbTxSpaceWaiters[i]) != NULL)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void usbTxNotifySpaceWaiters()
+{
+    for (int i = 0; i < USB_TX_SPACE_WAITER_MAX; i++)
+    {
+        rtos_task_notify_give(atomic_load(&s_usbTxSpaceWaiters[i]));
+    }
+}
+
+void usbTxSetOverflowPolicy(usbTxOverflowPolicy_t policy)
+{
+    atomic_store_explicit(&s_usbTxOverflowPolicy, policy, memory_order_relaxed);
+}
+
+usbTxOverflowPolicy_t usbTxGetOverflowPolicy(void)
+{
+    return (usbTxOverflowPolicy_t)atomic_load_explicit(&s_usbTxOverflowPolicy,
+                                                       memory_order_relaxed);
+}
+
+void usbTxGetDropStats(usbTxDropStats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+    stats->droppedBytes =
+        atomic_load_explicit(&s_usbTxDroppedBytes, memory_order_relaxed);
+    stats->droppedRecords =
+        atomic_load_explicit(&s_usbTxDroppedRecords, memory_order_relaxed);
+}
+
+// 1レコード(またはメッセージ)分の破棄を数える
+static void usbTxCountDropRecord(size_t bytes)
+{
+    usbTxCountDrop(bytes);
+    atomic_fetch_add_explicit(&s_usbTxDroppedRecords, 1, memory_order_relaxed);
+}
+
+void usbTxCountDrop(size_t bytes)
+{
+    if (bytes == 0)
+    {
+        return;
+    }
+    atomic_fetch_add_explicit(&s_usbTxDroppedBytes, bytes,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_usbTxDroppedBytesUnreported, bytes,
+                              memory_order_relaxed);
+}
+
+// レーンの1巡あたりの送信量を設定する(0は無制限)
+// HIGHは常に全て送信するため設定できない
+int32_t usbTxSetLaneBudget(usbTxLane_t lane, size_t bytes)
+{
+    if (lane == USB_TX_LANE_HIGH || lane >= USB_TX_LANE_MAX)
+    {
+        return E_ARGUMENT;
+    }
+    atomic_store_explicit(&s_usbTxLaneBudget[lane], bytes,
+                          memory_order_relaxed);
+    return E_SUCCESS;
+}
+
+// 滞留時間を記録する(usbFlush_taskのみが呼ぶ)
+static void usbTxAddLaneLatency(usbTxLane_t lane, uint32_t sinceUs)
+{
+    uint32_t latency = time_us_32() - sinceUs;
+    atomic_fetch_add_explicit(&s_usbTxLaneLatencyCount[lane], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_usbTxLaneLatencyTotalUs[lane], latency,
+                              memory_order_relaxed);
+    if (latency > atomic_load_explicit(&s_usbTxLaneLatencyMaxUs[lane],
+                                       memory_order_relaxed))
+    {
+        atomic_store_explicit(&s_usbTxLaneLatencyMaxUs[lane], latency,
+                              memory_order_relaxed);
+    }
+}
+
+int32_t usbTxGetLaneLatency(usbTxLane_t lane, usbTxLaneLatency_t *latency)
+{
+    if (lane >= USB_TX_LANE_MAX || latency == NULL)
+    {
+        return E_ARGUMENT;
+    }
+    latency->count = atomic_load_explicit(&s_usbTxLaneLatencyCount[lane],
+                                          memory_order_relaxed);
+    latency->maxUs = atomic_load_explicit(&s_usbTxLaneLatencyMaxUs[lane],
+                                          memory_order_relaxed);
+    latency->totalUs = atomic_load_explicit(&s_usbTxLaneLatencyTotalUs[lane],
+                                            memory_order_relaxed);
+    return E_SUCCESS;
+}
+
+void usbTxResetLaneLatency(void)
+{
+    for (int i = 0; i < USB_TX_LANE_MAX; i++)
+    {
+        atomic_store_explicit(&s_usbTxLaneLatencyCount[i], 0,
+                              memory_order_relaxed);
+        atomic_store_explicit(&s_usbTxLaneLatencyMaxUs[i], 0,
+                              memory_order_relaxed);
+        atomic_store_explicit(&s_usbTxLaneLatencyTotalUs[i], 0,
+                              memory_order_relaxed);
+    }
+}
+
 void usbFlush_task(void *params)
 {
+    // RingBuffer/LogRingにデータが格納されたらこのタスクに通知される
+    rtos_task_handle_t self = rtos_task_get_current();
+    ringBufferSetConsumerTask(&s_usbTxRingBuffer, self);
+    atomic_store_explicit(&s_usbFlushTask, self, memory_order_release);
+
+    // 起動前に格納されたデータも送信するため、先にFlushする
+    usbTxSubPending(usbFlush());
+
     while (1)
     {
-        rtos_bit_t bit =
-            rtos_flag_wait(flag_usbFlush, BIT_0, TRUE, FALSE, MAX_DELAY);
-        usbFlush();
+        rtos_time_ms_t timeout = MAX_DELAY;
+        uint32_t pending =
+            atomic_load_explicit(&s_usbTxPendingBytes, memory_order_relaxed);
+        if (pending > 0)
+        {
+            uint32_t limitBytes = atomic_load_explicit(&s_usbTxCoalesceBytes,
+                                                       memory_order_relaxed);
+            uint32_t limitUs =
+                atomic_load_explicit(&s_usbTxCoalesceUs, memory_order_relaxed);
+            uint32_t elapsed =
+                time_us_32() - atomic_load_explicit(&s_usbTxPendingSinceUs,
+                                                    memory_order_relaxed);
+
+            // 閾値に達した、時間が経過した、緊急送信の要求がある、
+            // 空き待ちのproducerがいる、のいずれかで送信する
+            if (pending >= limitBytes || elapsed >= limitUs ||
+                atomic_exchange_explicit(&s_usbTxUrgent, false,
+                                         memory_order_acquire) ||
+                usbTxHasSpaceWaiters())
+            {
+                usbTxSubPending(usbFlush());
+                continue;
+            }
+
+            // 残り時間だけ待つ(tick単位に切り上げ)
+            timeout = (limitUs - elapsed + 999) / 1000;
+        }
+        rtos_task_notify_take(timeout);
     }
 }
 
@@ -178,69 +980,283 @@ void usbFlush_task(void *params)
  *  1. USB Bufferにデータが来たらコールバックでタスク通知
  *  2. usbDrain_taskでデータを取り出す
  *  3. 登録されたアプリケーションQueueにデータを格納
+ *     生のバイト列はUSB_RX_CHANNEL_RAWのQueueへ、
+ *     デコードしたフレームはそのチャネルのQueueへ格納する
+ *     フィルタに一致する全てのQueueへ、コピーせず参照カウントで共有して渡す
  ****************************************************/
-bool makeRxData(const uint8_t *data, size_t len)
+// プールからブロックを確保し、dataをコピーする(フレームのpayload用)
+// 空きブロックができるまで待つ
+usbRxData_t *makeRxData(uint8_t id, const uint8_t *data, size_t len)
+{
+    if (len > USBRX_DATA_MAX_SIZE)
+    {
+        return NULL;
+    }
+    usbRxData_t *p_data = blockPoolAllocWait(&s_usbRxPool, MAX_DELAY);
+    if (p_data == NULL)
+    {
+        return NULL;
+    }
+    p_data->id = id;
+    atomic_init(&p_data->refCount, 1);
+    p_data->dataLen = len;
+    memcpy(p_data->data, data, len);
+    return p_data;
+}
+
+// 受け取ったデータの参照を手放す。最後の参照だった場合はプールに返す
+void usbRxDataRelease(usbRxData_t *p_data)
 {
-    memset(&s_usbRxData, 0, sizeof(usbRxData_t));
-    s_usbRxData.id = 0;
-    s_usbRxData.dataLen = len;
-    memcpy(s_usbRxData.data, data, len);
+    if (p_data == NULL)
+    {
+        return;
+    }
+    if (atomic_fetch_sub_explicit(&p_data->refCount, 1,
+                                  memory_order_acq_rel) == 1)
+    {
+        blockPoolFree(&s_usbRxPool, p_data);
+    }
 
-    return true;
+    // FLOW_OFF中なら、再開できるかusbDrain_taskに確認させる
+    if (atomic_load_explicit(&s_usbRxFlowOff, memory_order_relaxed))
+    {
+        rtos_flag_set(flag_usbDrain, USB_DRAIN_BIT_FLOW);
+    }
 }
 
-bool enqueueUsbRxData_App(usbRxData_t *p_data)
+// 受信用プールと購読者のQueueの空きから、FLOW_OFF/FLOW_ONを切り替える
+// 切り替えた場合は制御チャネルのフレームをHIGHレーンで送信する
+// (usbDrain_taskのみが呼ぶ)
+static void usbRxFlowUpdate(void)
 {
+    size_t freeBlocks = blockPoolFreeNum(&s_usbRxPool);
+    size_t minSpaces = SIZE_MAX;
     for (int i = 0; i < MAX_USBRX_APP_QUEUE; i++)
     {
-        if (s_usbRxAppQueues[i].registered == 1)
+        const usbRxQueue_t *sub = &s_usbRxAppQueues[i];
+        if (atomic_load_explicit(&sub->registered, memory_order_acquire) !=
+            USB_RX_SUBSCRIBER_ACTIVE)
         {
-            rtos_queue_t queue = *(s_usbRxAppQueues[i].p_appQueue);
-            if (rtos_queue_send(queue, (void *)p_data, 0) == RTOS_OK)
-            {
-                return true;
-            }
+            continue;
+        }
+        size_t spaces = rtos_queue_spaces_available(*(sub->p_appQueue));
+        if (spaces < minSpaces)
+        {
+            minSpaces = spaces;
         }
     }
-    return false;
+
+    bool off = atomic_load_explicit(&s_usbRxFlowOff, memory_order_relaxed);
+    bool next = off;
+    if (!off && (freeBlocks <= USB_RX_FLOW_OFF_FREE_BLOCKS ||
+                 minSpaces <= USB_RX_FLOW_OFF_QUEUE_SPACES))
+    {
+        next = true;
+    }
+    else if (off && freeBlocks >= USB_RX_FLOW_ON_FREE_BLOCKS &&
+             minSpaces >= USB_RX_FLOW_ON_QUEUE_SPACES)
+    {
+        next = false;
+    }
+    if (next == off)
+    {
+        return;
+    }
+
+    atomic_store_explicit(&s_usbRxFlowOff, next, memory_order_relaxed);
+    uint8_t msg[FRAME_CONTROL_FLOW_SIZE] = {
+        next ? FRAME_CONTROL_FLOW_OFF : FRAME_CONTROL_FLOW_ON,
+        (uint8_t)freeBlocks};
+    usbTxFrameLane(USB_TX_LANE_HIGH, USB_CHANNEL_CONTROL, msg, sizeof(msg));
 }
 
-void usbDrain_task(void *params)
+bool usbRxIsFlowOff(void)
 {
-    while (1)
+    return atomic_load_explicit(&s_usbRxFlowOff, memory_order_relaxed);
+}
+
+static bool usbRxSubscriberMatch(const usbRxQueue_t *sub,
+                                 const usbRxData_t *p_data)
+{
+    if (sub->channel != USB_RX_CHANNEL_ANY && sub->channel != p_data->id)
+    {
+        return false;
+    }
+    return sub->prefix == NULL ||
+           (p_data->dataLen >= sub->prefixLen &&
+            memcmp(p_data->data, sub->prefix, sub->prefixLen) == 0);
+}
+
+// フィルタに一致する全てのQueueにp_dataを配信する
+// Queueごとに参照カウントを1増やして渡す(呼び出し元の参照はそのまま残る)
+// Queueがいっぱいの場合はFLOW_OFFを送り、USB_RX_FLOW_OFF_WAIT_MSまで空きを待つ
+// それでも空かない場合はその購読者への配信を破棄し、数える
+// 1つでも配信できた場合はtrue (usbDrain_taskのみが呼ぶ)
+bool enqueueUsbRxData_App(usbRxData_t *p_data)
+{
+    bool delivered = false;
+    for (int i = 0; i < MAX_USBRX_APP_QUEUE; i++)
     {
-        rtos_bit_t bit =
-            rtos_flag_wait(flag_usbDrain, BIT_0, TRUE, FALSE, MAX_DELAY);
-        int readSize = stdio_get_until(s_usbRxBuffer, USB_RX_BUFFER_SIZE,
-                                       at_the_end_of_time);
-        if (readSize <= 0)
+        usbRxQueue_t *sub = &s_usbRxAppQueues[i];
+        if (atomic_load_explicit(&sub->registered, memory_order_acquire) !=
+                USB_RX_SUBSCRIBER_ACTIVE ||
+            !usbRxSubscriberMatch(sub, p_data))
         {
-            dbgPrint(DBG_LEVEL_WARN, "[usbDrain_task] No data received\n");
             continue;
         }
 
-        readSize =
-            (readSize > USBRX_DATA_MAX_SIZE) ? USBRX_DATA_MAX_SIZE : readSize;
-        if (!makeRxData(s_usbRxBuffer, readSize))
+        // 送信した時点で受信側がReleaseする場合があるため、先に加算する
+        atomic_fetch_add_explicit(&p_data->refCount, 1, memory_order_relaxed);
+        rtos_queue_t queue = *(sub->p_appQueue);
+        rtos_result_t ret = rtos_queue_send(queue, &p_data, 0);
+        if (ret != RTOS_OK)
+        {
+            // 待つ前にFLOW_OFFを送り、ホストに送信を止めさせる
+            usbRxFlowUpdate();
+            ret = rtos_queue_send(queue, &p_data, USB_RX_FLOW_OFF_WAIT_MS);
+        }
+        if (ret == RTOS_OK)
+        {
+            delivered = true;
+        }
+        else
+        {
+            atomic_fetch_sub_explicit(&p_data->refCount, 1,
+                                      memory_order_relaxed);
+            atomic_fetch_add_explicit(&sub->dropped, 1, memory_order_relaxed);
+        }
+    }
+    return delivered;
+}
+
+// 受信データをフレームとそれ以外(テキスト等)に分ける
+// フレームは必ず区切り(0x00)で始まるため、区切りの後はフレーム、
+// フレームの終わりの区切りの後は次の区切りまでフレーム以外として扱う
+// フレームはデコードしてチャネルのQueueに格納し、フレーム以外のバイトだけを
+// dataの先頭に詰める(フレームの部分はデコーダーにコピー済みのため上書きできる)
+// 戻り値: フレーム以外のバイト数
+// 格納先のないフレームがあった場合は*undeliveredをtrueにする
+size_t dispatchUsbRxFrames(uint8_t *data, size_t len, bool *undelivered)
+{
+    size_t textLen = 0;
+    size_t pos = 0;
+    while (pos < len)
+    {
+        if (!s_usbRxInFrame)
         {
-            dbgPrint(DBG_LEVEL_ERROR,
-                     "[usbDrain_task] Failed to make RxData\n");
+            const uint8_t *delimiter = memchr(&data[pos], 0x00, len - pos);
+            size_t n = (delimiter != NULL) ? (size_t)(delimiter - &data[pos])
+                                           : len - pos;
+            memmove(&data[textLen], &data[pos], n);
+            textLen += n;
+            pos += n;
+            if (delimiter == NULL)
+            {
+                break;
+            }
+            // 先頭の区切り。デコーダーは空のため渡さなくてよい
+            s_usbRxInFrame = true;
+            pos++;
             continue;
         }
 
-        if (!enqueueUsbRxData_App(&s_usbRxData))
+        frame_t frame;
+        frameStatus_t status;
+        pos += frameDecoderFeed(&s_usbRxFrameDecoder, &data[pos], len - pos,
+                                &frame, &status);
+        if (status == FRAME_STATUS_NONE)
+        {
+            // フレームの途中、または連続した区切り(次のフレームの先頭)
+            continue;
+        }
+        s_usbRxInFrame = false;
+        if (status != FRAME_STATUS_OK)
         {
-            dbgPrint(
-                DBG_LEVEL_WARN,
-                "[usbDrain_task] No app queue registered or enqueue failed\n");
             continue;
         }
+
+        // payloadはデコーダーのバッファ上にあるため、ブロックにコピーする
+        usbRxData_t *p_data =
+            makeRxData(frame.channel, frame.payload, frame.len);
+        if (p_data == NULL || !enqueueUsbRxData_App(p_data))
+        {
+            *undelivered = true;
+        }
+        usbRxDataRelease(p_data);
+    }
+    return textLen;
+}
+
+void usbDrain_task(void *params)
+{
+    while (1)
+    {
+        rtos_bit_t bit = rtos_flag_wait(
+            flag_usbDrain, USB_DRAIN_BIT_RECV | USB_DRAIN_BIT_FLOW, TRUE,
+            FALSE, MAX_DELAY);
+
+        // 受信済みのデータがなくなるまで、ブロックに直接読み込んで渡す
+        // (切り詰めたり、Queueに値渡しでコピーしたりしない)
+        bool received = false;
+        while (1)
+        {
+            usbRxData_t *p_data = blockPoolAllocWait(&s_usbRxPool, MAX_DELAY);
+            int readSize =
+                s_usbTransport->read(p_data->data, USBRX_DATA_MAX_SIZE);
+            if (readSize <= 0)
+            {
+                blockPoolFree(&s_usbRxPool, p_data); // 未使用のため直接返す
+                break;
+            }
+            received = true;
+            p_data->id = USB_RX_CHANNEL_RAW;
+            atomic_init(&p_data->refCount, 1);
+
+            // フレームはチャネルへ、フレーム以外のバイトだけをRAWへ配信する
+            bool undelivered = false;
+            p_data->dataLen =
+                dispatchUsbRxFrames(p_data->data, readSize, &undelivered);
+            if (p_data->dataLen > 0 && !enqueueUsbRxData_App(p_data))
+            {
+                undelivered = true;
+            }
+            usbRxDataRelease(p_data); // 配信先がなければここで返却される
+
+            if (undelivered)
+            {
+                DBG_PRINT(DBG_MODULE_USB, DBG_LEVEL_WARN,
+                          "[usbDrain_task] No app queue registered or "
+                          "enqueue failed\n");
+            }
+
+            // 連続した受信の途中でも、空きが減ったらすぐにFLOW_OFFを送る
+            usbRxFlowUpdate();
+        }
+        usbRxFlowUpdate();
+
+        if (!received && (bit & USB_DRAIN_BIT_RECV))
+        {
+            DBG_PRINT(DBG_MODULE_USB, DBG_LEVEL_WARN,
+                      "[usbDrain_task] No data received\n");
+        }
     }
 }
 
+// 割り込みコンテキストで呼ばれる
 void usbRecv_callback(void *params)
 {
-    rtos_bit_t bit = rtos_flag_set(flag_usbDrain, BIT_0);
+    DBG_PRINT_FROM_ISR(DBG_MODULE_USB, DBG_LEVEL_DEBUG,
+                       "[usbRecv_callback] chars available\r\n");
+    rtos_flag_set_from_isr(flag_usbDrain, USB_DRAIN_BIT_RECV);
+}
+
+// タスクコンテキストで呼ばれる(rxCallbackFromIsrがfalseの経路)
+// ループバックではusbFlush_taskから呼ばれるため、送信を待つログは出さない
+static void usbRecvTask_callback(void *params)
+{
+    DBG_PRINT_DEFERRED(DBG_MODULE_USB, DBG_LEVEL_DEBUG,
+                       "[usbRecv_callback] chars available\r\n");
+    rtos_flag_set(flag_usbDrain, USB_DRAIN_BIT_RECV);
 }
 
 void initUsbRxAppQueues()
@@ -248,25 +1264,76 @@ void initUsbRxAppQueues()
     for (int i = 0; i < MAX_USBRX_APP_QUEUE; i++)
     {
         s_usbRxAppQueues[i].p_appQueue = NULL;
-        s_usbRxAppQueues[i].registered = 0;
+        atomic_init(&s_usbRxAppQueues[i].registered, USB_RX_SUBSCRIBER_FREE);
+        s_usbRxAppQueues[i].channel = USB_RX_CHANNEL_RAW;
+        s_usbRxAppQueues[i].prefix = NULL;
+        s_usbRxAppQueues[i].prefixLen = 0;
+        atomic_init(&s_usbRxAppQueues[i].dropped, 0);
     }
 }
 
+// 生のバイト列を受け取るQueueを登録する
 int8_t registerUsbRxQueue(rtos_queue_t *p_appQueue)
 {
-    if (p_appQueue == NULL)
+    return registerUsbRxChannelQueue(USB_RX_CHANNEL_RAW, p_appQueue);
+}
+
+// channelのフレームのpayloadを受け取るQueueを登録する
+int8_t registerUsbRxChannelQueue(uint8_t channel, rtos_queue_t *p_appQueue)
+{
+    return registerUsbRxSubscriber(channel, NULL, 0, p_appQueue);
+}
+
+// フィルタ付きで購読者を登録する
+// channel: USB_RX_CHANNEL_RAW, フレームのチャネル, USB_RX_CHANNEL_ANYのいずれか
+// prefix : データの先頭がprefixLenバイト一致するものだけ受け取る(NULLは全て)
+//          登録後も参照するため、静的な領域であること
+int8_t registerUsbRxSubscriber(uint8_t channel, const void *prefix,
+                               size_t prefixLen, rtos_queue_t *p_appQueue)
+{
+    if (p_appQueue == NULL || (prefix == NULL && prefixLen > 0) ||
+        (channel >= USB_CHANNEL_MAX && channel != USB_RX_CHANNEL_RAW &&
+         channel != USB_RX_CHANNEL_ANY))
     {
         return E_ARGUMENT;
     }
 
     for (int i = 0; i < MAX_USBRX_APP_QUEUE; i++)
     {
-        if (s_usbRxAppQueues[i].registered == 0)
+        // 空きスロットをatomicに確保し、設定してから公開する
+        usbRxQueue_t *sub = &s_usbRxAppQueues[i];
+        signed char empty = USB_RX_SUBSCRIBER_FREE;
+        if (!atomic_compare_exchange_strong(&sub->registered, &empty,
+                                            USB_RX_SUBSCRIBER_CLAIMED))
         {
-            s_usbRxAppQueues[i].p_appQueue = p_appQueue;
-            s_usbRxAppQueues[i].registered = 1;
-            return E_SUCCESS;
+            continue;
         }
+        sub->p_appQueue = p_appQueue;
+        sub->channel = channel;
+        sub->prefix = (const uint8_t *)prefix;
+        sub->prefixLen = (prefix != NULL) ? prefixLen : 0;
+        atomic_store_explicit(&sub->dropped, 0, memory_order_relaxed);
+        atomic_store_explicit(&sub->registered, USB_RX_SUBSCRIBER_ACTIVE,
+                              memory_order_release);
+        return E_SUCCESS;
     }
     return E_NO_RESOURCE;
+}
+
+// p_appQueueの購読者が、Queueがいっぱいで受け取れなかった数
+uint32_t usbRxGetDropCount(rtos_queue_t *p_appQueue)
+{
+    uint32_t dropped = 0;
+    for (int i = 0; i < MAX_USBRX_APP_QUEUE; i++)
+    {
+        const usbRxQueue_t *sub = &s_usbRxAppQueues[i];
+        if (atomic_load_explicit(&sub->registered, memory_order_acquire) ==
+                USB_RX_SUBSCRIBER_ACTIVE &&
+            sub->p_appQueue == p_appQueue)
+        {
+            dropped += atomic_load_explicit(&sub->dropped,
+                                            memory_order_relaxed);
+        }
+    }
+    return dropped;
 }
\ No newline at end of file
@@ -1,32 +1,150 @@
 #ifndef __USB_COMM__
 #define __USB_COMM__
 
+#include <stdatomic.h>
+
+#include "frame.h"
 #include "rtos_wrapper.h"
 #include "typedef.h"
+#include "usb_transport.h"
 
-// USB受信データ格納用構造体
-// この構造体のポインタをQueueでアプリケーションに渡す
-#define USBRX_DATA_MAX_SIZE 32 // 受信したら即座にキューに積むので小さくてよい
+// USB受信データ格納用構造体(受信用プールの1ブロック)
+// usbDrain_taskがプールから確保し、このポインタをQueueでアプリケーションに渡す
+// 同じデータを複数のアプリケーションで共有するため参照カウントを持つ
+// 受け取ったアプリケーションはデータを変更せず、処理後にusbRxDataRelease()する
+#define USB_RX_BLOCK_SIZE 256
+#define USB_RX_BLOCK_NUM 8
 typedef struct
 {
-    uint8_t id;                        // データ識別ID(今のところ未使用)
-    size_t dataLen;                    // データ長
-    uint8_t data[USBRX_DATA_MAX_SIZE]; // 実際のデータ
+    uint8_t id;            // チャネル(生のバイト列はUSB_RX_CHANNEL_RAW)
+    atomic_uchar refCount; // 参照カウント(0になったらプールに返す)
+    size_t dataLen;        // データ長
+    uint8_t data[];        // 実際のデータ(最大USBRX_DATA_MAX_SIZE)
 } usbRxData_t;
+#define USBRX_DATA_MAX_SIZE (USB_RX_BLOCK_SIZE - sizeof(usbRxData_t))
 
-// アプリケーションがデータを受信するためのQueue登録用構造体
+// アプリケーションがデータを受信するためのQueue登録用構造体(購読者)
 // usbRxData_tのポインタを、p_appQueueで受け渡す
+// (Queueの要素サイズはsizeof(usbRxData_t *)で作成すること)
+// 受信データはフィルタに一致する全ての購読者に配信される
+// Queueがいっぱいの場合はFLOW_OFFをホストに送って空くまで待つ
+// 一定時間待っても空かない購読者への配信は破棄し、droppedに数える
 typedef struct
 {
     rtos_queue_t *p_appQueue; // アプリケーション側のQueueポインタ
-    int8_t registered;        // 登録済みフラグ: 0->未登録, 1->登録済み
+    atomic_schar registered;  // USB_RX_SUBSCRIBER_*
+    uint8_t channel;          // 受け取るチャネル(USB_RX_CHANNEL_ANYは全て)
+    const uint8_t *prefix;    // 先頭一致フィルタ(NULLは全て)
+    size_t prefixLen;
+    atomic_uint dropped;      // Queueがいっぱいで破棄した数(累計)
 } usbRxQueue_t;
+#define USB_RX_SUBSCRIBER_FREE 0    // 未登録
+#define USB_RX_SUBSCRIBER_CLAIMED 1 // 登録中(設定前のため配信しない)
+#define USB_RX_SUBSCRIBER_ACTIVE 2  // 登録済み
+#ifndef MAX_USBRX_APP_QUEUE
+#define MAX_USBRX_APP_QUEUE 8
+#endif
+
+// フレーム(frame.h)のチャネル
+// フレームに入っていない生のバイト列はUSB_RX_CHANNEL_RAWとして受け取る
+#define USB_CHANNEL_LOG 0
+#define USB_CHANNEL_COMMAND 1
+#define USB_CHANNEL_TELEMETRY 2
+#define USB_CHANNEL_CONTROL FRAME_CHANNEL_CONTROL // フロー制御(送信のみ)
+#define USB_CHANNEL_RPC FRAME_CHANNEL_RPC         // バイナリRPC(rpc.h)
+#define USB_CHANNEL_UPLOAD 5 // ファイル転送(upload.h, tools/usb_upload.c)
+#define USB_CHANNEL_MAX 8 // usbTxFrame()で使用できるチャネル数
+#define USB_RX_CHANNEL_RAW 0xFF
+#define USB_RX_CHANNEL_ANY 0xFE // 購読のフィルタ用: 全てのチャネル
+// usbTxFrame()で送信できるpayloadの最大サイズ(1レコードに収まるサイズ)
+#define USB_FRAME_PAYLOAD_MAX 240
+
+// usbTxRecordReserve()で確保できる1レコードの最大サイズ
+#define USB_TX_RECORD_MAX 256
+
+// usbTxv()に渡す送信データの断片
+typedef struct
+{
+    const void *data;
+    size_t len;
+} usbTxVec_t;
+
+// 送信バッファがいっぱいの場合の動作
+typedef enum
+{
+    USB_TX_OVERFLOW_BLOCK = 0, // 空きができるまで待つ(デフォルト)
+    USB_TX_OVERFLOW_DROP_NEW   // 待たずに新しいデータを破棄する
+} usbTxOverflowPolicy_t;
+
+// 破棄したデータの統計
+typedef struct
+{
+    uint32_t droppedBytes;   // 破棄したバイト数(累計)
+    uint32_t droppedRecords; // 破棄したレコード数(累計)
+} usbTxDropStats_t;
+
+// 送信の優先度レーン
+// usbFlushはHIGHを常に優先して全て送信し、NORMAL/BULKは1巡あたりの
+// 送信量(budget)ずつ交互に送信する。大量の出力があってもHIGHは待たされない
+typedef enum
+{
+    USB_TX_LANE_HIGH = 0, // エラーログ等。書き込むと集約を待たずに送信する
+    USB_TX_LANE_NORMAL,   // 通常のレコード(usbTx, dbgPrint)
+    USB_TX_LANE_BULK,     // バイト列(usbBufferEnqueue)
+    USB_TX_LANE_MAX
+} usbTxLane_t;
+
+// レーンごとのキュー滞留時間(確保/格納から送信までの時間)
+typedef struct
+{
+    uint32_t count;   // 計測回数
+    uint32_t maxUs;   // 最大[us]
+    uint32_t totalUs; // 合計[us](平均 = totalUs / count)
+} usbTxLaneLatency_t;
+
+// 送信の集約(coalescing)
+// usbFlush_taskは、未送信データがbytes以上たまるか、最初の未送信データから
+// usマイクロ秒経過するまで送信を待ち、小さな転送をまとめる
+#define USB_TX_COALESCE_BYTES_DEFAULT 256 // TinyUSBのCDC送信FIFOと同じサイズ
+#define USB_TX_COALESCE_US_DEFAULT 2000
+
+// 送信の統計(集約の効果の確認用)
+typedef struct
+{
+    uint32_t transfers; // transportのwrite()の呼び出し回数(累計)
+    uint32_t bytes;     // 送信したバイト数(累計)
+    uint32_t errors;    // usbFlush内で発生したエラーの数(累計)
+} usbTxFlushStats_t;
 
 extern bool usbCommInit();
+extern int32_t usbCommSetTransport(const usbTransport_t *transport);
 extern int32_t usbBufferEnqueue(const char *str, size_t len);
 extern int32_t usbFlush();
 extern int32_t usbTx(const char *str, size_t len);
+extern int32_t usbTxv(const usbTxVec_t *vec, size_t count);
+extern int32_t usbTxFrame(uint8_t channel, const void *data, size_t len);
+extern uint8_t *usbTxRecordReserve(size_t len);
+extern uint8_t *usbTxRecordReserveLane(usbTxLane_t lane, size_t len);
+extern void usbTxRecordCommit(uint8_t *record, size_t len);
+extern void usbTxSetOverflowPolicy(usbTxOverflowPolicy_t policy);
+extern usbTxOverflowPolicy_t usbTxGetOverflowPolicy(void);
+extern void usbTxGetDropStats(usbTxDropStats_t *stats);
+extern void usbTxSetCoalesce(size_t bytes, uint32_t us);
+extern void usbFlushUrgent(void);
+extern void usbTxGetFlushStats(usbTxFlushStats_t *stats);
+extern int32_t usbTxSetLaneBudget(usbTxLane_t lane, size_t bytes);
+extern int32_t usbTxGetLaneLatency(usbTxLane_t lane,
+                                   usbTxLaneLatency_t *latency);
+extern void usbTxResetLaneLatency(void);
 extern void usbRecv_callback(void *params);
 extern int8_t registerUsbRxQueue(rtos_queue_t *p_appQueue);
+extern void usbRxDataRelease(usbRxData_t *p_data);
+extern int8_t registerUsbRxChannelQueue(uint8_t channel,
+                                        rtos_queue_t *p_appQueue);
+extern int8_t registerUsbRxSubscriber(uint8_t channel, const void *prefix,
+                                      size_t prefixLen,
+                                      rtos_queue_t *p_appQueue);
+extern uint32_t usbRxGetDropCount(rtos_queue_t *p_appQueue);
+extern bool usbRxIsFlowOff(void);
 
 #endif // __USB_COMM__
@@ -0,0 +1,35 @@
+#ifndef __USB_TRANSPORT__
+#define __USB_TRANSPORT__
+
+#include "typedef.h"
+
+// usb_commの下位の送受信経路
+// usbCommInit()/usbFlush()/usbDrain_taskはこのインターフェース経由で送受信する
+// 実機ではpico stdio(USB CDC)、ホストではpty/ループバックに差し替えられる
+typedef struct
+{
+    const char *name;
+    // 初期化。失敗した場合はfalse
+    bool (*open)(void);
+    // 全て送信するまで戻らない
+    void (*write)(const uint8_t *data, size_t len);
+    // 受信済みのデータを最大lenバイト読み出す(戻り値: 読み出したバイト数)
+    // データがなければ待たずに0を返す
+    int32_t (*read)(uint8_t *buf, size_t len);
+    // データを受信したときに呼ばれるコールバックを登録する
+    void (*setRxCallback)(void (*callback)(void *), void *params);
+    // コールバックを割り込みコンテキストで呼ぶ場合true
+    // falseの経路はタスクコンテキストで呼ぶ(usb_commが呼ぶ関数を切り替える)
+    bool rxCallbackFromIsr;
+} usbTransport_t;
+
+// pico stdio(USB CDC)。usb_commのデフォルト
+extern const usbTransport_t usbTransportStdio;
+// メモリ上のループバック。送信したフレームをそのまま受信する
+extern const usbTransport_t usbTransportLoopback;
+#if !PICO_ON_DEVICE
+// 疑似端末(Linux)。open時にslave側のパスを標準エラー出力に表示する
+extern const usbTransport_t usbTransportPty;
+#endif
+
+#endif // __USB_TRANSPORT__
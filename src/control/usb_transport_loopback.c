@@ -0,0 +1,104 @@
+#include "usb_transport.h"
+
+#include "ring_buffer.h"
+#include "typedef.h"
+
+#include <string.h>
+
+// 送信したフレーム(0x00で区切られたデータ)をそのまま受信データとして返す
+// 実機/ホストのどちらでもUSBホストなしで送受信の経路全体を動かせる
+// フレーム外のバイト列(ログ等のテキスト)は返さずに破棄する
+// (ログを返すと受信側の警告ログがまた返り、ループし続けるため)
+// 受信側が読み出す前にバッファがいっぱいになった分は破棄する
+#define USB_LOOPBACK_BUFFER_SIZE 1024
+RING_BUFFER_DEFINE(s_usbLoopbackBuffer, USB_LOOPBACK_BUFFER_SIZE);
+static void (*s_usbLoopbackCallback)(void *) = NULL;
+static void *s_usbLoopbackCallbackParams = NULL;
+// 書き込みの区切りをまたぐフレームのための状態(usbFlush_taskのみが使う)
+static bool s_usbLoopbackInFrame = false;
+static size_t s_usbLoopbackFrameLen = 0;
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+static bool usbLoopbackOpen(void);
+static void usbLoopbackWrite(const uint8_t *data, size_t len);
+static int32_t usbLoopbackRead(uint8_t *buf, size_t len);
+static void usbLoopbackSetRxCallback(void (*callback)(void *), void *params);
+static size_t usbLoopbackFilterFrames(const uint8_t *data, size_t len);
+
+const usbTransport_t usbTransportLoopback = {
+    .name = "loopback",
+    .open = usbLoopbackOpen,
+    .write = usbLoopbackWrite,
+    .read = usbLoopbackRead,
+    .setRxCallback = usbLoopbackSetRxCallback,
+    .rxCallbackFromIsr = false,
+};
+
+static bool usbLoopbackOpen(void)
+{
+    // 書き込みはusbFlush_task、読み出しはusbDrain_taskのためSPSCでよい
+    return RING_BUFFER_INIT(s_usbLoopbackBuffer, RING_BUFFER_MODE_SPSC);
+}
+
+// コールバックは送信したタスクのコンテキストで呼ばれる
+static void usbLoopbackWrite(const uint8_t *data, size_t len)
+{
+    if (usbLoopbackFilterFrames(data, len) > 0 &&
+        s_usbLoopbackCallback != NULL)
+    {
+        s_usbLoopbackCallback(s_usbLoopbackCallbackParams);
+    }
+}
+
+// data中のフレームの部分(区切りの0x00を含む)だけを受信バッファに格納する
+// 戻り値: 格納したバイト数
+static size_t usbLoopbackFilterFrames(const uint8_t *data, size_t len)
+{
+    size_t stored = 0;
+    while (len > 0)
+    {
+        const uint8_t *delim = memchr(data, 0x00, len);
+        size_t n = (delim != NULL) ? (size_t)(delim - data) : len;
+        if (!s_usbLoopbackInFrame)
+        {
+            // フレーム外: 区切りまでを捨て、区切りからフレームを開始する
+            if (delim == NULL)
+            {
+                break;
+            }
+            s_usbLoopbackInFrame = true;
+            s_usbLoopbackFrameLen = 0;
+            data += n;
+            len -= n;
+            continue;
+        }
+
+        // フレーム内: 区切りまで(区切りを含む)を格納する
+        size_t chunk = (delim != NULL) ? n + 1 : n;
+        int32_t ret = ringBufferEnqueue(&s_usbLoopbackBuffer, data, chunk);
+        stored += (ret > 0) ? ret : 0;
+        s_usbLoopbackFrameLen += n;
+        if (delim != NULL && s_usbLoopbackFrameLen > 0)
+        {
+            // 空でないフレームの終端。連続する0x00は次のフレームの開始とする
+            s_usbLoopbackInFrame = false;
+        }
+        data += chunk;
+        len -= chunk;
+    }
+    return stored;
+}
+
+static int32_t usbLoopbackRead(uint8_t *buf, size_t len)
+{
+    int32_t ret = ringBufferDequeue(&s_usbLoopbackBuffer, buf, len);
+    return (ret < 0) ? 0 : ret;
+}
+
+static void usbLoopbackSetRxCallback(void (*callback)(void *), void *params)
+{
+    s_usbLoopbackCallbackParams = params;
+    s_usbLoopbackCallback = callback;
+}
@@ -0,0 +1,133 @@
+#define _GNU_SOURCE // posix_openpt, ptsname, cfmakeraw
+#include "usb_transport.h"
+
+#if !PICO_ON_DEVICE // ホスト(Linux)ビルドのみ
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "rtos_wrapper.h"
+#include "typedef.h"
+
+// 疑似端末のmaster側を開き、slave側(/dev/pts/N)をUSB CDCの代わりに使う
+// ホストのターミナル(screen等)やテストスクリプトからslave側に接続する
+// 受信の検出は割り込みの代わりにポーリングタスクで行う
+static int s_usbPtyFd = -1;
+static void (*s_usbPtyCallback)(void *) = NULL;
+static void *s_usbPtyCallbackParams = NULL;
+
+#define USB_PTY_POLL_INTERVAL_MS 1
+#define STACKSIZE_USB_PTY_POLL 256
+static rtos_stack_t stack_usbPtyPoll[STACKSIZE_USB_PTY_POLL];
+static rtos_tcb_t tcb_usbPtyPoll;
+static rtos_task_handle_t task_handle_usbPtyPoll;
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+static bool usbPtyOpen(void);
+static void usbPtyWrite(const uint8_t *data, size_t len);
+static int32_t usbPtyRead(uint8_t *buf, size_t len);
+static void usbPtySetRxCallback(void (*callback)(void *), void *params);
+static void usbPtyPoll_task(void *params);
+
+const usbTransport_t usbTransportPty = {
+    .name = "pty",
+    .open = usbPtyOpen,
+    .write = usbPtyWrite,
+    .read = usbPtyRead,
+    .setRxCallback = usbPtySetRxCallback,
+    .rxCallbackFromIsr = false,
+};
+
+static bool usbPtyOpen(void)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (grantpt(fd) != 0 || unlockpt(fd) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // USB CDCと同じくバイト列をそのまま通す(改行変換やエコーをしない)
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    if (rtos_task_create_static(usbPtyPoll_task, "usbPtyPoll",
+                                STACKSIZE_USB_PTY_POLL, NULL,
+                                RTOS_PRIORITY_NORMAL, RTOS_CORE_ANY,
+                                stack_usbPtyPoll, &tcb_usbPtyPoll,
+                                &task_handle_usbPtyPoll) != RTOS_OK)
+    {
+        close(fd);
+        return false;
+    }
+
+    s_usbPtyFd = fd;
+    fprintf(stderr, "[usb_transport] pty: %s\n", ptsname(fd));
+    return true;
+}
+
+// slave側が開かれていない場合やバッファがいっぱいの場合は空くまで待つ
+static void usbPtyWrite(const uint8_t *data, size_t len)
+{
+    while (len > 0 && s_usbPtyFd >= 0)
+    {
+        ssize_t n = write(s_usbPtyFd, data, len);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EIO)
+            {
+                return;
+            }
+            rtos_task_delay(USB_PTY_POLL_INTERVAL_MS);
+            continue;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static int32_t usbPtyRead(uint8_t *buf, size_t len)
+{
+    ssize_t n = read(s_usbPtyFd, buf, len);
+    return (n < 0) ? 0 : (int32_t)n;
+}
+
+static void usbPtySetRxCallback(void (*callback)(void *), void *params)
+{
+    s_usbPtyCallbackParams = params;
+    s_usbPtyCallback = callback;
+}
+
+// 受信データがあればコールバックを呼ぶ(実機の受信割り込みの代わり)
+// コールバックはこのタスクのコンテキストで呼ばれる
+static void usbPtyPoll_task(void *params)
+{
+    while (1)
+    {
+        struct pollfd pfd = {.fd = s_usbPtyFd, .events = POLLIN};
+        if (s_usbPtyFd >= 0 && poll(&pfd, 1, 0) > 0 &&
+            (pfd.revents & POLLIN) && s_usbPtyCallback != NULL)
+        {
+            s_usbPtyCallback(s_usbPtyCallbackParams);
+        }
+        rtos_task_delay(USB_PTY_POLL_INTERVAL_MS);
+    }
+}
+
+#endif // !PICO_ON_DEVICE
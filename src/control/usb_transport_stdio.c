@@ -0,0 +1,43 @@
+#include "usb_transport.h"
+
+#include "typedef.h"
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+static bool usbStdioOpen(void);
+static void usbStdioWrite(const uint8_t *data, size_t len);
+static int32_t usbStdioRead(uint8_t *buf, size_t len);
+static void usbStdioSetRxCallback(void (*callback)(void *), void *params);
+
+const usbTransport_t usbTransportStdio = {
+    .name = "stdio",
+    .open = usbStdioOpen,
+    .write = usbStdioWrite,
+    .read = usbStdioRead,
+    .setRxCallback = usbStdioSetRxCallback,
+    .rxCallbackFromIsr = true,
+};
+
+static bool usbStdioOpen(void)
+{
+    return stdio_usb_init();
+}
+
+static void usbStdioWrite(const uint8_t *data, size_t len)
+{
+    stdio_put_string((const char *)data, len, false, false);
+}
+
+// 受信済みのデータがなければ待たずに0を返す
+static int32_t usbStdioRead(uint8_t *buf, size_t len)
+{
+    int ret = stdio_get_until((char *)buf, len, get_absolute_time());
+    return (ret < 0) ? 0 : ret;
+}
+
+// コールバックは割り込みコンテキストで呼ばれる
+static void usbStdioSetRxCallback(void (*callback)(void *), void *params)
+{
+    stdio_set_chars_available_callback(callback, params);
+}
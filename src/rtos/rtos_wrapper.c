@@ -9,16 +9,27 @@
 rtos_result_t rtos_task_create(rtos_task_func_t func, const char *name,
                                rtos_stack_size_t stack_size, void *params,
                                rtos_priority_t priority,
+                               rtos_core_mask_t affinity,
                                rtos_task_handle_t *handle);
 rtos_result_t rtos_task_create_static(rtos_task_func_t func, const char *name,
                                       rtos_stack_size_t stack_size,
                                       void *params, rtos_priority_t priority,
+                                      rtos_core_mask_t affinity,
                                       rtos_stack_t *stack_buf,
                                       rtos_tcb_t *tcb_buf,
                                       rtos_task_handle_t *handle);
+rtos_result_t rtos_task_set_affinity(rtos_task_handle_t handle,
+                                     rtos_core_mask_t affinity);
+rtos_core_mask_t rtos_task_get_affinity(rtos_task_handle_t handle);
+uint32_t rtos_core_get_id(void);
 void rtos_task_delete(rtos_task_handle_t handle);
 void rtos_task_delay(uint32_t delay_ms);
 void rtos_schedule_start(void);
+rtos_task_handle_t rtos_task_get_current(void);
+void rtos_task_notify_give(rtos_task_handle_t handle);
+void rtos_task_notify_give_from_isr(rtos_task_handle_t handle);
+uint32_t rtos_task_notify_take(rtos_time_ms_t timeout_ms);
+rtos_time_ms_t rtos_time_get_ms(void);
 rtos_mutex_t rtos_mutex_create(void);
 rtos_mutex_t rtos_mutex_create_static(rtos_static_mutex_buf_t *buffer);
 rtos_result_t rtos_mutex_take(rtos_mutex_t mutex);
@@ -27,6 +38,7 @@ void rtos_mutex_delete(rtos_mutex_t mutex);
 rtos_flag_t rtos_flag_create(void);
 rtos_flag_t rtos_flag_create_static(rtos_static_flag_buf_t *buf);
 rtos_bit_t rtos_flag_set(rtos_flag_t flag, rtos_bit_t setBit);
+rtos_result_t rtos_flag_set_from_isr(rtos_flag_t flag, rtos_bit_t setBit);
 rtos_bit_t rtos_flag_wait(rtos_flag_t flag, rtos_bit_t waitBit,
                           rtos_base_t clearOnExit, rtos_base_t waitAllBits,
                           rtos_time_ms_t timeout_ms);
@@ -40,44 +52,97 @@ rtos_result_t rtos_queue_send(rtos_queue_t queue, const void *item,
                               rtos_time_ms_t timeout_ms);
 rtos_result_t rtos_queue_receive(rtos_queue_t queue, void *item,
                                  rtos_time_ms_t timeout_ms);
+rtos_queue_size_t rtos_queue_spaces_available(rtos_queue_t queue);
 
 /****************************************************
  * Task Implementation
  ****************************************************/
 
+// コアアフィニティはSMP構成でのみ有効
+#if (configNUMBER_OF_CORES > 1) && (configUSE_CORE_AFFINITY == 1)
+#define RTOS_USE_CORE_AFFINITY 1
+#else
+#define RTOS_USE_CORE_AFFINITY 0
+#endif
+
 rtos_result_t rtos_task_create(rtos_task_func_t func, const char *name,
                                rtos_stack_size_t stack_size, void *params,
                                rtos_priority_t priority,
+                               rtos_core_mask_t affinity,
                                rtos_task_handle_t *handle)
 {
-    if (func == NULL)
+    if (func == NULL || affinity == 0)
     {
         return RTOS_ERROR;
     }
 
+#if RTOS_USE_CORE_AFFINITY
+    BaseType_t res = xTaskCreateAffinitySet(func, name, stack_size, params,
+                                            priority, affinity, handle);
+#else
     BaseType_t res =
         xTaskCreate(func, name, stack_size, params, priority, handle);
+#endif
     return (res == pdPASS) ? RTOS_OK : RTOS_ERROR;
 }
 
 rtos_result_t rtos_task_create_static(rtos_task_func_t func, const char *name,
                                       rtos_stack_size_t stack_size,
                                       void *params, rtos_priority_t priority,
+                                      rtos_core_mask_t affinity,
                                       rtos_stack_t *stack_buf,
                                       rtos_tcb_t *tcb_buf,
                                       rtos_task_handle_t *handle)
 {
-    if (func == NULL || stack_buf == NULL || tcb_buf == NULL || handle == NULL)
+    if (func == NULL || stack_buf == NULL || tcb_buf == NULL ||
+        handle == NULL || affinity == 0)
     {
         return RTOS_ERROR;
     }
 
+#if RTOS_USE_CORE_AFFINITY
+    *handle = xTaskCreateStaticAffinitySet(func, name, stack_size, params,
+                                           priority, stack_buf, tcb_buf,
+                                           affinity);
+#else
     *handle = xTaskCreateStatic(func, name, stack_size, params, priority,
                                 stack_buf, tcb_buf);
+#endif
 
     return (*handle != NULL) ? RTOS_OK : RTOS_ERROR;
 }
 
+rtos_result_t rtos_task_set_affinity(rtos_task_handle_t handle,
+                                     rtos_core_mask_t affinity)
+{
+    if (handle == NULL || affinity == 0)
+    {
+        return RTOS_ERROR;
+    }
+#if RTOS_USE_CORE_AFFINITY
+    vTaskCoreAffinitySet(handle, affinity);
+#endif
+    return RTOS_OK;
+}
+
+rtos_core_mask_t rtos_task_get_affinity(rtos_task_handle_t handle)
+{
+#if RTOS_USE_CORE_AFFINITY
+    return vTaskCoreAffinityGet(handle);
+#else
+    return RTOS_CORE_ANY;
+#endif
+}
+
+uint32_t rtos_core_get_id(void)
+{
+#if configNUMBER_OF_CORES > 1
+    return portGET_CORE_ID();
+#else
+    return 0;
+#endif
+}
+
 void rtos_task_delete(rtos_task_handle_t handle)
 {
     vTaskDelete(handle);
@@ -93,6 +158,39 @@ void rtos_schedule_start(void)
     vTaskStartScheduler();
 }
 
+rtos_task_handle_t rtos_task_get_current(void)
+{
+    return xTaskGetCurrentTaskHandle();
+}
+
+void rtos_task_notify_give(rtos_task_handle_t handle)
+{
+    if (handle != NULL)
+    {
+        xTaskNotifyGive(handle);
+    }
+}
+
+void rtos_task_notify_give_from_isr(rtos_task_handle_t handle)
+{
+    if (handle != NULL)
+    {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(handle, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+uint32_t rtos_task_notify_take(rtos_time_ms_t timeout_ms)
+{
+    return ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+}
+
+rtos_time_ms_t rtos_time_get_ms(void)
+{
+    return (rtos_time_ms_t)xTaskGetTickCount() * 1000 / configTICK_RATE_HZ;
+}
+
 /****************************************************
  * Mutex Implementation
  ****************************************************/
@@ -161,6 +259,17 @@ rtos_bit_t rtos_flag_set(rtos_flag_t flag, rtos_bit_t setBit)
     return xEventGroupSetBits(flag, setBit);
 }
 
+rtos_result_t rtos_flag_set_from_isr(rtos_flag_t flag, rtos_bit_t setBit)
+{
+    BaseType_t woken = pdFALSE;
+    if (xEventGroupSetBitsFromISR(flag, setBit, &woken) != pdPASS)
+    {
+        return RTOS_ERROR;
+    }
+    portYIELD_FROM_ISR(woken);
+    return RTOS_OK;
+}
+
 rtos_bit_t rtos_flag_wait(rtos_flag_t flag, rtos_bit_t waitBit,
                           rtos_base_t clearOnExit, rtos_base_t waitAllBits,
                           rtos_time_ms_t timeout_ms)
@@ -214,4 +323,13 @@ rtos_result_t rtos_queue_receive(rtos_queue_t queue, void *item,
 
     BaseType_t res = xQueueReceive(queue, item, pdMS_TO_TICKS(timeout_ms));
     return (res == pdTRUE) ? RTOS_OK : RTOS_TIMEOUT;
+}
+
+rtos_queue_size_t rtos_queue_spaces_available(rtos_queue_t queue)
+{
+    if (queue == NULL)
+    {
+        return 0;
+    }
+    return uxQueueSpacesAvailable(queue);
 }
\ No newline at end of file
@@ -32,6 +32,16 @@ typedef StackType_t rtos_stack_t;
 typedef StaticTask_t rtos_tcb_t;
 typedef UBaseType_t rtos_priority_t;
 
+// core affinity (bit n: core n で実行してよい)
+typedef UBaseType_t rtos_core_mask_t;
+#define RTOS_CORE_0 ((rtos_core_mask_t)(1u << 0))
+#define RTOS_CORE_1 ((rtos_core_mask_t)(1u << 1))
+#ifdef tskNO_AFFINITY
+#define RTOS_CORE_ANY ((rtos_core_mask_t)tskNO_AFFINITY)
+#else
+#define RTOS_CORE_ANY ((rtos_core_mask_t)-1)
+#endif
+
 // mutex
 typedef SemaphoreHandle_t rtos_mutex_t;
 typedef StaticSemaphore_t rtos_static_mutex_buf_t;
@@ -59,24 +69,54 @@ typedef UBaseType_t rtos_queue_size_t;
  * Task API
  ****************************************************/
 
+// affinity: 実行してよいコア(RTOS_CORE_0 | RTOS_CORE_1等)
+//           RTOS_CORE_ANYはどのコアでもよい
+// シングルコア構成(configUSE_CORE_AFFINITYが無効)では無視する
 rtos_result_t rtos_task_create(rtos_task_func_t func, const char *name,
                                rtos_stack_size_t stack_size, void *params,
                                rtos_priority_t priority,
+                               rtos_core_mask_t affinity,
                                rtos_task_handle_t *handle);
 
 rtos_result_t rtos_task_create_static(rtos_task_func_t func, const char *name,
                                       rtos_stack_size_t stack_size,
                                       void *params, rtos_priority_t priority,
+                                      rtos_core_mask_t affinity,
                                       rtos_stack_t *stack_buf,
                                       rtos_tcb_t *tcb_buf,
                                       rtos_task_handle_t *handle);
 
+// 実行中のタスクのコアアフィニティを変更する
+// 現在のコアが含まれない場合、タスクは次の切り替えで移動する
+rtos_result_t rtos_task_set_affinity(rtos_task_handle_t handle,
+                                     rtos_core_mask_t affinity);
+
+rtos_core_mask_t rtos_task_get_affinity(rtos_task_handle_t handle);
+
+// 呼び出したコードが実行されているコアの番号
+uint32_t rtos_core_get_id(void);
+
 void rtos_task_delete(rtos_task_handle_t handle);
 
 void rtos_task_delay(uint32_t delay_ms);
 
 void rtos_schedule_start(void);
 
+rtos_task_handle_t rtos_task_get_current(void);
+
+// タスク通知(対象タスクの通知カウントを+1する)
+void rtos_task_notify_give(rtos_task_handle_t handle);
+
+// 割り込みハンドラ用のタスク通知
+// 通知したタスクの方が優先度が高ければ、割り込みからの復帰時に切り替える
+void rtos_task_notify_give_from_isr(rtos_task_handle_t handle);
+
+// タスク通知待ち(戻り値: 受け取った通知数。タイムアウト時は0)
+uint32_t rtos_task_notify_take(rtos_time_ms_t timeout_ms);
+
+// 起動からの経過時間[ms]
+rtos_time_ms_t rtos_time_get_ms(void);
+
 /****************************************************
  * Mutex API
  ****************************************************/
@@ -103,6 +143,11 @@ rtos_flag_t rtos_flag_create_static(rtos_static_flag_buf_t *buffer);
 // EventFlag Set
 rtos_bit_t rtos_flag_set(rtos_flag_t flag, rtos_bit_t setBit);
 
+// 割り込みハンドラ用のEventFlag Set
+// ビットの設定はタイマータスクに依頼して行う(依頼できなければRTOS_ERROR)
+// タイマータスクの方が優先度が高ければ、割り込みからの復帰時に切り替える
+rtos_result_t rtos_flag_set_from_isr(rtos_flag_t flag, rtos_bit_t setBit);
+
 // EventFlag wait
 rtos_bit_t rtos_flag_wait(rtos_flag_t flag, rtos_bit_t waitBit,
                           rtos_base_t clearOnExit, rtos_base_t waitAllBits,
@@ -125,4 +170,7 @@ rtos_result_t rtos_queue_send(rtos_queue_t queue, const void *item,
 rtos_result_t rtos_queue_receive(rtos_queue_t queue, void *item,
                                  rtos_time_ms_t timeout_ms);
 
+// Queueの空き数
+rtos_queue_size_t rtos_queue_spaces_available(rtos_queue_t queue);
+
 #endif
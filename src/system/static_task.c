@@ -1,12 +1,21 @@
 #include "static_task.h"
+
+#include <stdatomic.h>
+
+#include "rpc.h"
 #include "rtos_wrapper.h"
+#include "task_test.h" // test
 #include "typedef.h"
+#include "upload.h"
 #include "usb_comm.h"
 
 /****************************************************
  * forward declaration
  ****************************************************/
 bool taskInit();
+int32_t taskSetPinned(bool pinned);
+bool taskIsPinned(void);
+static rtos_core_mask_t taskCore(rtos_core_mask_t core);
 
 // usb comm task
 #define STACKSIZE_USB_FLUSH 512
@@ -19,17 +28,123 @@ rtos_stack_t stack_usbDrain[STACKSIZE_USB_DRAIN];
 rtos_tcb_t tcb_usbDrain;
 rtos_task_handle_t task_handle_usbDrain;
 
+// dbg print task
+// 書式化はfmtFormat(newlibのsnprintfより小さいスタックで動く)のみ
+#define STACKSIZE_DBG_FORMAT 256
+rtos_stack_t stack_dbgFormat[STACKSIZE_DBG_FORMAT];
+rtos_tcb_t tcb_dbgFormat;
+rtos_task_handle_t task_handle_dbgFormat;
+
+// rpc worker task (同じ関数をRPC_WORKER_NUM個起動する)
+#define STACKSIZE_RPC_WORKER 512
+rtos_stack_t stack_rpcWorker[RPC_WORKER_NUM][STACKSIZE_RPC_WORKER];
+rtos_tcb_t tcb_rpcWorker[RPC_WORKER_NUM];
+rtos_task_handle_t task_handle_rpcWorker[RPC_WORKER_NUM];
+
+// upload task
+#define STACKSIZE_UPLOAD 256
+rtos_stack_t stack_upload[STACKSIZE_UPLOAD];
+rtos_tcb_t tcb_upload;
+rtos_task_handle_t task_handle_upload;
+
+// test task (ヒープから確保する)
+#define STACKSIZE_TASK_TEST 512
+rtos_task_handle_t task_handle_task1;
+rtos_task_handle_t task_handle_task2;
+
+// タスクごとの配置先
+typedef struct
+{
+    rtos_task_handle_t *handles;
+    size_t num;
+    rtos_core_mask_t core;
+} taskPlacement_t;
+
+static const taskPlacement_t s_taskPlacements[] = {
+    {&task_handle_usbFlush, 1, TASK_CORE_IO},
+    {&task_handle_usbDrain, 1, TASK_CORE_IO},
+    {&task_handle_dbgFormat, 1, TASK_CORE_IO},
+    {task_handle_rpcWorker, RPC_WORKER_NUM, TASK_CORE_APP},
+    {&task_handle_upload, 1, TASK_CORE_APP},
+    {&task_handle_task1, 1, TASK_CORE_APP},
+    {&task_handle_task2, 1, TASK_CORE_APP},
+};
+
+static atomic_bool s_taskPinned = TASK_PIN_CORES;
+
+// 固定しない場合はRTOS_CORE_ANY
+static rtos_core_mask_t taskCore(rtos_core_mask_t core)
+{
+    return atomic_load_explicit(&s_taskPinned, memory_order_relaxed)
+               ? core
+               : RTOS_CORE_ANY;
+}
+
 bool taskInit()
 {
-    rtos_result_t ret =
-        rtos_task_create_static(usbFlush_task, "usbFlush", STACKSIZE_USB_FLUSH,
-                                NULL, RTOS_PRIORITY_NORMAL, stack_usbFlush,
-                                &tcb_usbFlush, &task_handle_usbFlush);
+    rtos_result_t ret = rtos_task_create_static(
+        usbFlush_task, "usbFlush", STACKSIZE_USB_FLUSH, NULL,
+        RTOS_PRIORITY_NORMAL, taskCore(TASK_CORE_IO), stack_usbFlush,
+        &tcb_usbFlush, &task_handle_usbFlush);
+
+    ret += rtos_task_create_static(
+        usbDrain_task, "usbDrain", STACKSIZE_USB_DRAIN, NULL,
+        RTOS_PRIORITY_NORMAL, taskCore(TASK_CORE_IO), stack_usbDrain,
+        &tcb_usbDrain, &task_handle_usbDrain);
+
+    // トークン化ログの書式化は他の処理の邪魔をしないよう低優先度で行う
+    ret += rtos_task_create_static(
+        dbgFormat_task, "dbgFormat", STACKSIZE_DBG_FORMAT, NULL,
+        RTOS_PRIORITY_LOW, taskCore(TASK_CORE_IO), stack_dbgFormat,
+        &tcb_dbgFormat, &task_handle_dbgFormat);
+
+    for (int i = 0; i < RPC_WORKER_NUM; i++)
+    {
+        ret += rtos_task_create_static(
+            rpcWorker_task, "rpcWorker", STACKSIZE_RPC_WORKER, NULL,
+            RTOS_PRIORITY_NORMAL, taskCore(TASK_CORE_APP), stack_rpcWorker[i],
+            &tcb_rpcWorker[i], &task_handle_rpcWorker[i]);
+    }
+
+    ret += rtos_task_create_static(
+        upload_task, "upload", STACKSIZE_UPLOAD, NULL, RTOS_PRIORITY_LOW,
+        taskCore(TASK_CORE_APP), stack_upload, &tcb_upload,
+        &task_handle_upload);
 
-    ret +=
-        rtos_task_create_static(usbDrain_task, "usbDrain", STACKSIZE_USB_DRAIN,
-                                NULL, RTOS_PRIORITY_NORMAL, stack_usbDrain,
-                                &tcb_usbDrain, &task_handle_usbDrain);
+    ret += rtos_task_create(task1, "task1", STACKSIZE_TASK_TEST, NULL,
+                            RTOS_PRIORITY_LOW, taskCore(TASK_CORE_APP),
+                            &task_handle_task1);
+    ret += rtos_task_create(task2, "task2", STACKSIZE_TASK_TEST, NULL,
+                            RTOS_PRIORITY_LOW, taskCore(TASK_CORE_APP),
+                            &task_handle_task2);
 
     return (ret == RTOS_OK) ? true : false;
-}
\ No newline at end of file
+}
+
+// 配置の方針を実行中に切り替える(固定あり/なしの比較用)
+// pinned: true=TASK_CORE_IO/TASK_CORE_APPに固定する。false=両方のコアで実行する
+int32_t taskSetPinned(bool pinned)
+{
+    atomic_store_explicit(&s_taskPinned, pinned, memory_order_relaxed);
+
+    int32_t ret = E_SUCCESS;
+    for (size_t i = 0;
+         i < sizeof(s_taskPlacements) / sizeof(s_taskPlacements[0]); i++)
+    {
+        const taskPlacement_t *p = &s_taskPlacements[i];
+        for (size_t n = 0; n < p->num; n++)
+        {
+            if (rtos_task_set_affinity(p->handles[n], taskCore(p->core)) !=
+                RTOS_OK)
+            {
+                ret = E_OTHER;
+            }
+        }
+    }
+    return ret;
+}
+
+bool taskIsPinned(void)
+{
+    return atomic_load_explicit(&s_taskPinned, memory_order_relaxed);
+}
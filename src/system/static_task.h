@@ -4,8 +4,25 @@
 #include "rtos_wrapper.h"
 #include "typedef.h"
 
+// タスクの配置(コアアフィニティ)
+// USBの割り込み(usbRecv_callback等)はstdio_init_all()を呼んだcore0で動くため、
+// USBのI/Oを行うタスクはcore0、アプリケーションの処理はcore1に固定する
+// タスクがコア間を移動しなくなり、同じロック/リングを両コアで取り合う頻度が減る
+#define TASK_CORE_IO RTOS_CORE_0
+#define TASK_CORE_APP RTOS_CORE_1
+
+// 起動時の配置(0にすると固定せず、両方のコアで実行する)
+#ifndef TASK_PIN_CORES
+#define TASK_PIN_CORES 1
+#endif
+
 extern bool taskInit(void);
+extern int32_t taskSetPinned(bool pinned);
+extern bool taskIsPinned(void);
 extern void usbFlush_task(void *params);
 extern void usbDrain_task(void *params);
+extern void dbgFormat_task(void *params);
+extern void rpcWorker_task(void *params);
+extern void upload_task(void *params);
 
 #endif // STATIC_TASK_H
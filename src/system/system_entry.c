@@ -1,7 +1,6 @@
 #include "dbg_print.h"
 #include "rtos_wrapper.h"
 #include "system_init.h"
-#include "task_test.h" // test
 #include "typedef.h"
 
 int main()
@@ -13,11 +12,8 @@ int main()
         return -1;
     }
 
-    rtos_result_t res = rtos_task_create(task1, "task1", 512, NULL, 1, NULL);
-
-    res = rtos_task_create(task2, "task2", 512, NULL, 1, NULL);
-
-    dbgPrint(DBG_LEVEL_INFO, "Starting scheduler...\r\n");
+    // タスク(task1, task2を含む)はtaskInit()で配置を決めて作成済み
+    DBG_PRINT(DBG_MODULE_SYSTEM, DBG_LEVEL_INFO, "Starting scheduler...\r\n");
     rtos_schedule_start();
     // TODO: Assert;
 }
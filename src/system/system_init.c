@@ -1,7 +1,9 @@
 #include "system_init.h"
 #include "dbg_print.h"
+#include "rpc.h"
 #include "static_task.h"
 #include "typedef.h"
+#include "upload.h"
 #include "usb_comm.h"
 
 bool systemInit()
@@ -35,5 +37,17 @@ bool systemInit()
         return false;
     }
 
+    // RPCの要求Queueを作り、USBのRPCチャネルに登録する
+    if (!rpcInit())
+    {
+        return false;
+    }
+
+    // ファイル転送の受信Queueを作り、USBのUPLOADチャネルに登録する
+    if (!uploadInit())
+    {
+        return false;
+    }
+
     return true;
 }
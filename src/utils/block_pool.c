@@ -0,0 +1,139 @@
+#include "block_pool.h"
+#include "typedef.h"
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+bool blockPoolInit(blockPool_t *pool, uint8_t *buffer, size_t blockSize,
+                   uint16_t *next, size_t blockNum);
+void *blockPoolAlloc(blockPool_t *pool);
+void *blockPoolAllocWait(blockPool_t *pool, rtos_time_ms_t timeout_ms);
+void blockPoolFree(blockPool_t *pool, void *block);
+size_t blockPoolFreeNum(blockPool_t *pool);
+
+#define BLOCK_POOL_TAG_UNIT (1u << 16)
+#define BLOCK_POOL_INDEX_MASK 0xFFFFu
+
+bool blockPoolInit(blockPool_t *pool, uint8_t *buffer, size_t blockSize,
+                   uint16_t *next, size_t blockNum)
+{
+    if (pool == NULL || buffer == NULL || next == NULL || blockSize == 0 ||
+        blockNum == 0 || blockNum >= BLOCK_POOL_NIL ||
+        ((uintptr_t)buffer & 3u) != 0)
+    {
+        return false;
+    }
+    pool->buffer = buffer;
+    pool->blockSize = blockSize;
+    pool->blockNum = blockNum;
+    pool->next = next;
+
+    // 全ブロックを先頭から順につなぐ
+    for (size_t i = 0; i < blockNum; i++)
+    {
+        next[i] = (i + 1 < blockNum) ? (uint16_t)(i + 1) : BLOCK_POOL_NIL;
+    }
+    atomic_init(&pool->freeHead, 0);
+    atomic_init(&pool->freeNum, blockNum);
+    atomic_init(&pool->waiter, NULL);
+    return true;
+}
+
+// 空きブロックを1つ取り出す。空きがなければNULL
+void *blockPoolAlloc(blockPool_t *pool)
+{
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t head = atomic_load_explicit(&pool->freeHead, memory_order_acquire);
+    uint32_t index;
+    uint32_t newHead;
+    do
+    {
+        index = head & BLOCK_POOL_INDEX_MASK;
+        if (index == BLOCK_POOL_NIL)
+        {
+            return NULL;
+        }
+        // 他のタスクが先に取り出していた場合、nextは古い値になりうるが、
+        // tagが変わっているためCASは失敗する
+        newHead = ((head + BLOCK_POOL_TAG_UNIT) & ~BLOCK_POOL_INDEX_MASK) |
+                  pool->next[index];
+    } while (!atomic_compare_exchange_weak_explicit(
+        &pool->freeHead, &head, newHead, memory_order_acquire,
+        memory_order_acquire));
+
+    atomic_fetch_sub_explicit(&pool->freeNum, 1, memory_order_relaxed);
+    return pool->buffer + index * pool->blockSize;
+}
+
+// 空きブロックができるまで待つ(blockPoolFree()からのタスク通知で起床する)
+// 待てるのは1タスクまで。タイムアウトした場合はNULL
+void *blockPoolAllocWait(blockPool_t *pool, rtos_time_ms_t timeout_ms)
+{
+    void *block = blockPoolAlloc(pool);
+    if (block != NULL || pool == NULL || timeout_ms == 0)
+    {
+        return block;
+    }
+
+    uint32_t startMs = (uint32_t)rtos_time_get_ms();
+    atomic_store_explicit(&pool->waiter, rtos_task_get_current(),
+                          memory_order_release);
+    // 登録後に再確認し、登録前に返却されたブロックを取りこぼさない
+    while ((block = blockPoolAlloc(pool)) == NULL)
+    {
+        rtos_time_ms_t remaining = MAX_DELAY;
+        if (timeout_ms != MAX_DELAY)
+        {
+            uint32_t elapsed = (uint32_t)rtos_time_get_ms() - startMs;
+            if (elapsed >= timeout_ms)
+            {
+                break;
+            }
+            remaining = timeout_ms - elapsed;
+        }
+        rtos_task_notify_take(remaining);
+    }
+    atomic_store_explicit(&pool->waiter, NULL, memory_order_release);
+    return block;
+}
+
+void blockPoolFree(blockPool_t *pool, void *block)
+{
+    if (pool == NULL || block == NULL)
+    {
+        return;
+    }
+    uint32_t index = ((uint8_t *)block - pool->buffer) / pool->blockSize;
+    if (index >= pool->blockNum)
+    {
+        return; // このプールのブロックではない
+    }
+
+    uint32_t head = atomic_load_explicit(&pool->freeHead, memory_order_relaxed);
+    uint32_t newHead;
+    do
+    {
+        pool->next[index] = head & BLOCK_POOL_INDEX_MASK;
+        newHead = ((head + BLOCK_POOL_TAG_UNIT) & ~BLOCK_POOL_INDEX_MASK) |
+                  index;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &pool->freeHead, &head, newHead, memory_order_release,
+        memory_order_relaxed));
+
+    atomic_fetch_add_explicit(&pool->freeNum, 1, memory_order_relaxed);
+    rtos_task_notify_give(
+        atomic_load_explicit(&pool->waiter, memory_order_acquire));
+}
+
+size_t blockPoolFreeNum(blockPool_t *pool)
+{
+    if (pool == NULL)
+    {
+        return 0;
+    }
+    return atomic_load_explicit(&pool->freeNum, memory_order_relaxed);
+}
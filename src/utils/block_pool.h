@@ -0,0 +1,49 @@
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <stdatomic.h>
+
+#include "rtos_wrapper.h"
+#include "typedef.h"
+
+// 固定長ブロックのメモリプール
+// 空きブロックはlock-freeのリスト(index + ABA対策のtag)で管理し、
+// 確保/解放はどのタスク/コアからでもmutexなしで行える
+// ブロックの所有権はポインタごと受け渡し、最後の所有者がblockPoolFree()で返す
+#define BLOCK_POOL_NIL 0xFFFFu
+
+typedef struct
+{
+    uint8_t *buffer;      // ブロック領域 (4byte境界)
+    uint32_t blockSize;   // 1ブロックのサイズ
+    uint32_t blockNum;    // ブロック数
+    uint16_t *next;       // 空きリストのリンク(blockNum個)
+    atomic_uint freeHead; // bit31-16: tag, bit15-0: 先頭の空きブロック
+    atomic_uint freeNum;  // 空きブロック数(統計用)
+    _Atomic(rtos_task_handle_t) waiter; // 空き待ちのタスク(1タスクまで)
+} blockPool_t;
+
+// プールと格納領域を静的に定義する。RING_BUFFER_DEFINEと同様
+#define BLOCK_POOL_DEFINE(name, blockSize, blockNum)                           \
+    _Static_assert((blockSize) % sizeof(uint32_t) == 0 && (blockNum) > 0 &&    \
+                       (blockNum) < BLOCK_POOL_NIL,                            \
+                   #name ": invalid block pool size");                         \
+    static uint32_t name##_storage[(blockSize) * (blockNum) /                  \
+                                   sizeof(uint32_t)];                          \
+    static uint16_t name##_next[(blockNum)];                                   \
+    static blockPool_t name
+
+#define BLOCK_POOL_INIT(name)                                                  \
+    blockPoolInit(&(name), (uint8_t *)name##_storage,                          \
+                  sizeof(name##_storage) /                                     \
+                      (sizeof(name##_next) / sizeof(name##_next[0])),          \
+                  name##_next, sizeof(name##_next) / sizeof(name##_next[0]))
+
+extern bool blockPoolInit(blockPool_t *pool, uint8_t *buffer,
+                          size_t blockSize, uint16_t *next, size_t blockNum);
+extern void *blockPoolAlloc(blockPool_t *pool);
+extern void *blockPoolAllocWait(blockPool_t *pool, rtos_time_ms_t timeout_ms);
+extern void blockPoolFree(blockPool_t *pool, void *block);
+extern size_t blockPoolFreeNum(blockPool_t *pool);
+
+#endif // BLOCK_POOL_H
@@ -0,0 +1,428 @@
+#include "fmt.h"
+#include "typedef.h"
+
+#define FMT_FLAG_LEFT (1u << 0)  // '-'
+#define FMT_FLAG_ZERO (1u << 1)  // '0'
+#define FMT_FLAG_PLUS (1u << 2)  // '+'
+#define FMT_FLAG_SPACE (1u << 3) // ' '
+#define FMT_FLAG_ALT (1u << 4)   // '#'
+
+// 64bit整数の10進数の最大桁数
+#define FMT_DIGITS_MAX 20
+
+typedef enum
+{
+    FMT_LEN_INT = 0,
+    FMT_LEN_CHAR,      // hh
+    FMT_LEN_SHORT,     // h
+    FMT_LEN_LONG,      // l
+    FMT_LEN_LONG_LONG, // ll
+    FMT_LEN_SIZE,      // z, t
+    FMT_LEN_MAX,       // j
+} fmtLength_t;
+
+typedef struct
+{
+    uint32_t flags;
+    int32_t width;     // 最小幅
+    int32_t precision; // 精度(指定なしは-1)
+    fmtLength_t length;
+    char conv; // 変換指定子
+} fmtSpec_t;
+
+// 出力先(はみ出した分は書き込まずに数だけ数える)
+typedef struct
+{
+    char *buf;
+    size_t size;
+    size_t pos;
+} fmtOut_t;
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+int32_t fmtFormat(char *buf, size_t size, const char *format, ...);
+int32_t fmtFormatV(char *buf, size_t size, const char *format,
+                   va_list args);
+static void fmtPutc(fmtOut_t *out, char c);
+static void fmtPad(fmtOut_t *out, char c, int32_t count);
+static void fmtString(fmtOut_t *out, const fmtSpec_t *spec, const char *s);
+static void fmtInteger(fmtOut_t *out, const fmtSpec_t *spec, uint64_t value,
+                       bool negative);
+static uint32_t fmtDigits(char *digits, uint64_t value, uint32_t base,
+                          bool upper);
+
+static void fmtPutc(fmtOut_t *out, char c)
+{
+    if (out->pos + 1 < out->size)
+    {
+        out->buf[out->pos] = c;
+    }
+    out->pos++;
+}
+
+static void fmtPad(fmtOut_t *out, char c, int32_t count)
+{
+    for (int32_t i = 0; i < count; i++)
+    {
+        fmtPutc(out, c);
+    }
+}
+
+static void fmtString(fmtOut_t *out, const fmtSpec_t *spec, const char *s)
+{
+    if (s == NULL)
+    {
+        s = "(null)";
+    }
+
+    // 精度が指定された場合、その長さを超えて読まない
+    int32_t len = 0;
+    while (s[len] != '\0' && (spec->precision < 0 || len < spec->precision))
+    {
+        len++;
+    }
+
+    int32_t pad = spec->width - len;
+    if (!(spec->flags & FMT_FLAG_LEFT))
+    {
+        fmtPad(out, ' ', pad);
+    }
+    for (int32_t i = 0; i < len; i++)
+    {
+        fmtPutc(out, s[i]);
+    }
+    if (spec->flags & FMT_FLAG_LEFT)
+    {
+        fmtPad(out, ' ', pad);
+    }
+}
+
+// valueをbase進数で下の桁から書き込み、桁数を返す
+// 32bitに収まる値は64bit除算を使わない(M33では64bit除算が遅いため)
+static uint32_t fmtDigits(char *digits, uint64_t value, uint32_t base,
+                          bool upper)
+{
+    const char *table = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    uint32_t n = 0;
+    while (value > UINT32_MAX)
+    {
+        digits[n++] = table[value % base];
+        value /= base;
+    }
+    uint32_t v = (uint32_t)value;
+    while (v != 0)
+    {
+        digits[n++] = table[v % base];
+        v /= base;
+    }
+    return n;
+}
+
+static void fmtInteger(fmtOut_t *out, const fmtSpec_t *spec, uint64_t value,
+                       bool negative)
+{
+    char digits[FMT_DIGITS_MAX];
+    bool hex = (spec->conv == 'x' || spec->conv == 'X' || spec->conv == 'p');
+    uint32_t n = fmtDigits(digits, value, hex ? 16 : 10, spec->conv == 'X');
+
+    // 精度は最小桁数。精度未指定で値が0の場合は"0"を出力する
+    int32_t precision = spec->precision;
+    if (precision < 0)
+    {
+        precision = 1;
+    }
+    int32_t zeros = (precision > (int32_t)n) ? precision - (int32_t)n : 0;
+
+    // 符号/プレフィックス
+    char prefix[2];
+    int32_t prefixLen = 0;
+    if (spec->conv == 'd' || spec->conv == 'i')
+    {
+        if (negative)
+        {
+            prefix[prefixLen++] = '-';
+        }
+        else if (spec->flags & FMT_FLAG_PLUS)
+        {
+            prefix[prefixLen++] = '+';
+        }
+        else if (spec->flags & FMT_FLAG_SPACE)
+        {
+            prefix[prefixLen++] = ' ';
+        }
+    }
+    else if (spec->conv == 'p' || (hex && (spec->flags & FMT_FLAG_ALT) &&
+                                   value != 0))
+    {
+        prefix[prefixLen++] = '0';
+        prefix[prefixLen++] = (spec->conv == 'X') ? 'X' : 'x';
+    }
+
+    int32_t pad = spec->width - (prefixLen + zeros + (int32_t)n);
+    // '0'フラグは精度指定時と左寄せ時には無視する(Cの規定と同じ)
+    if ((spec->flags & FMT_FLAG_ZERO) && !(spec->flags & FMT_FLAG_LEFT) &&
+        spec->precision < 0 && pad > 0)
+    {
+        zeros += pad;
+        pad = 0;
+    }
+
+    if (!(spec->flags & FMT_FLAG_LEFT))
+    {
+        fmtPad(out, ' ', pad);
+    }
+    for (int32_t i = 0; i < prefixLen; i++)
+    {
+        fmtPutc(out, prefix[i]);
+    }
+    fmtPad(out, '0', zeros);
+    while (n > 0)
+    {
+        fmtPutc(out, digits[--n]);
+    }
+    if (spec->flags & FMT_FLAG_LEFT)
+    {
+        fmtPad(out, ' ', pad);
+    }
+}
+
+int32_t fmtFormat(char *buf, size_t size, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int32_t len = fmtFormatV(buf, size, format, args);
+    va_end(args);
+    return len;
+}
+
+int32_t fmtFormatV(char *buf, size_t size, const char *format, va_list args)
+{
+    if ((buf == NULL && size != 0) || format == NULL)
+    {
+        return E_ARGUMENT;
+    }
+
+    fmtOut_t out = {.buf = buf, .size = size, .pos = 0};
+    const char *p = format;
+    while (*p != '\0')
+    {
+        if (*p != '%')
+        {
+            fmtPutc(&out, *p++);
+            continue;
+        }
+        const char *start = p++;
+
+        fmtSpec_t spec = {.flags = 0, .width = 0, .precision = -1};
+
+        // フラグ
+        while (1)
+        {
+            if (*p == '-')
+            {
+                spec.flags |= FMT_FLAG_LEFT;
+            }
+            else if (*p == '0')
+            {
+                spec.flags |= FMT_FLAG_ZERO;
+            }
+            else if (*p == '+')
+            {
+                spec.flags |= FMT_FLAG_PLUS;
+            }
+            else if (*p == ' ')
+            {
+                spec.flags |= FMT_FLAG_SPACE;
+            }
+            else if (*p == '#')
+            {
+                spec.flags |= FMT_FLAG_ALT;
+            }
+            else
+            {
+                break;
+            }
+            p++;
+        }
+
+        // 幅
+        if (*p == '*')
+        {
+            spec.width = va_arg(args, int);
+            if (spec.width < 0)
+            {
+                spec.flags |= FMT_FLAG_LEFT;
+                spec.width = -spec.width;
+            }
+            p++;
+        }
+        while (*p >= '0' && *p <= '9')
+        {
+            spec.width = spec.width * 10 + (*p++ - '0');
+        }
+
+        // 精度
+        if (*p == '.')
+        {
+            p++;
+            spec.precision = 0;
+            if (*p == '*')
+            {
+                spec.precision = va_arg(args, int);
+                p++;
+            }
+            while (*p >= '0' && *p <= '9')
+            {
+                spec.precision = spec.precision * 10 + (*p++ - '0');
+            }
+            if (spec.precision < 0)
+            {
+                spec.precision = -1; // 負の精度は指定なし扱い
+            }
+        }
+
+        // 長さ修飾子
+        spec.length = FMT_LEN_INT;
+        if (*p == 'h')
+        {
+            p++;
+            spec.length = FMT_LEN_SHORT;
+            if (*p == 'h')
+            {
+                p++;
+                spec.length = FMT_LEN_CHAR;
+            }
+        }
+        else if (*p == 'l')
+        {
+            p++;
+            spec.length = FMT_LEN_LONG;
+            if (*p == 'l')
+            {
+                p++;
+                spec.length = FMT_LEN_LONG_LONG;
+            }
+        }
+        else if (*p == 'z' || *p == 't')
+        {
+            p++;
+            spec.length = FMT_LEN_SIZE;
+        }
+        else if (*p == 'j')
+        {
+            p++;
+            spec.length = FMT_LEN_MAX;
+        }
+
+        spec.conv = *p;
+        switch (spec.conv)
+        {
+        case 'd':
+        case 'i': {
+            int64_t v;
+            switch (spec.length)
+            {
+            case FMT_LEN_CHAR:
+                v = (signed char)va_arg(args, int);
+                break;
+            case FMT_LEN_SHORT:
+                v = (short)va_arg(args, int);
+                break;
+            case FMT_LEN_LONG:
+                v = va_arg(args, long);
+                break;
+            case FMT_LEN_LONG_LONG:
+                v = va_arg(args, long long);
+                break;
+            case FMT_LEN_SIZE:
+                v = va_arg(args, ptrdiff_t);
+                break;
+            case FMT_LEN_MAX:
+                v = va_arg(args, intmax_t);
+                break;
+            default:
+                v = va_arg(args, int);
+                break;
+            }
+            // INT64_MINでもオーバーフローしないよう符号なしで反転する
+            uint64_t mag = (v < 0) ? (uint64_t)0 - (uint64_t)v : (uint64_t)v;
+            fmtInteger(&out, &spec, mag, v < 0);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X': {
+            uint64_t v;
+            switch (spec.length)
+            {
+            case FMT_LEN_CHAR:
+                v = (unsigned char)va_arg(args, unsigned int);
+                break;
+            case FMT_LEN_SHORT:
+                v = (unsigned short)va_arg(args, unsigned int);
+                break;
+            case FMT_LEN_LONG:
+                v = va_arg(args, unsigned long);
+                break;
+            case FMT_LEN_LONG_LONG:
+                v = va_arg(args, unsigned long long);
+                break;
+            case FMT_LEN_SIZE:
+                v = va_arg(args, size_t);
+                break;
+            case FMT_LEN_MAX:
+                v = va_arg(args, uintmax_t);
+                break;
+            default:
+                v = va_arg(args, unsigned int);
+                break;
+            }
+            fmtInteger(&out, &spec, v, false);
+            break;
+        }
+        case 'p':
+            fmtInteger(&out, &spec, (uintptr_t)va_arg(args, void *), false);
+            break;
+        case 'c': {
+            char c = (char)va_arg(args, int);
+            int32_t pad = spec.width - 1;
+            if (!(spec.flags & FMT_FLAG_LEFT))
+            {
+                fmtPad(&out, ' ', pad);
+            }
+            fmtPutc(&out, c);
+            if (spec.flags & FMT_FLAG_LEFT)
+            {
+                fmtPad(&out, ' ', pad);
+            }
+            break;
+        }
+        case 's':
+            fmtString(&out, &spec, va_arg(args, const char *));
+            break;
+        case '%':
+            fmtPutc(&out, '%');
+            break;
+        default:
+            // 未対応の書式はそのまま出力する
+            while (start < p && *start != '\0')
+            {
+                fmtPutc(&out, *start++);
+            }
+            if (*p == '\0')
+            {
+                continue;
+            }
+            fmtPutc(&out, *p);
+            break;
+        }
+        p++;
+    }
+
+    if (size > 0)
+    {
+        out.buf[(out.pos < size) ? out.pos : size - 1] = '\0';
+    }
+    return (int32_t)out.pos;
+}
@@ -0,0 +1,22 @@
+#ifndef FMT_H
+#define FMT_H
+
+#include <stdarg.h>
+
+#include "typedef.h"
+
+// 軽量な書式化関数(vsnprintfの代替)
+// ヒープ、ロケール、浮動小数点を使用せず、再入可能
+// 対応する書式:
+//  変換指定子 : %d %i %u %x %X %c %s %p(0x+16進数) %%
+//  フラグ     : - 0 + (スペース) #
+//  幅/精度    : 数値または*
+//  長さ修飾子 : hh h l ll z t j
+// 戻り値はsnprintfと同じく、切り詰めなかった場合の文字数(null終端を除く)
+// sizeが0でなければ、bufは必ずnull終端される
+
+extern int32_t fmtFormat(char *buf, size_t size, const char *format, ...);
+extern int32_t fmtFormatV(char *buf, size_t size, const char *format,
+                          va_list args);
+
+#endif // FMT_H
@@ -0,0 +1,198 @@
+#include "frame.h"
+
+#include <string.h>
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+size_t frameEncode(uint8_t channel, uint8_t seq, const void *payload,
+                   size_t len, uint8_t *out, size_t outSize);
+void frameDecoderInit(frameDecoder_t *dec, uint8_t *buffer, size_t bufferSize);
+size_t frameDecoderFeed(frameDecoder_t *dec, const uint8_t *data, size_t len,
+                        frame_t *frame, frameStatus_t *status);
+uint16_t frameCrc16(uint16_t crc, const uint8_t *data, size_t len);
+static frameStatus_t frameDecoderFinish(frameDecoder_t *dec, frame_t *frame);
+
+#define FRAME_CRC_INIT 0xFFFF
+
+// COBSエンコードの出力先(ブロック長の位置を後から埋める)
+typedef struct
+{
+    uint8_t *out;
+    size_t size;
+    size_t pos;     // 次に書き込む位置
+    size_t codePos; // 現在のブロック長を書き込む位置
+    uint8_t code;   // 現在のブロック長 + 1
+} frameCobs_t;
+
+static bool frameCobsPut(frameCobs_t *c, uint8_t byte)
+{
+    if (byte != 0)
+    {
+        if (c->pos >= c->size)
+        {
+            return false;
+        }
+        c->out[c->pos++] = byte;
+        c->code++;
+        if (c->code != 0xFF)
+        {
+            return true;
+        }
+    }
+
+    // 0x00、またはブロックが最大長(254バイト)になったらブロックを閉じる
+    if (c->pos >= c->size)
+    {
+        return false;
+    }
+    c->out[c->codePos] = c->code;
+    c->codePos = c->pos++;
+    c->code = 1;
+    return true;
+}
+
+static bool frameCobsPutBytes(frameCobs_t *c, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!frameCobsPut(c, data[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 1フレームをoutに書き込み、その長さを返す。outSizeが足りなければ0
+// outSizeはFRAME_ENCODED_MAX(len)あれば必ず足りる
+size_t frameEncode(uint8_t channel, uint8_t seq, const void *payload,
+                   size_t len, uint8_t *out, size_t outSize)
+{
+    if (out == NULL || (payload == NULL && len > 0) || outSize < 3)
+    {
+        return 0;
+    }
+
+    uint8_t header[FRAME_HEADER_SIZE] = {channel, seq};
+    uint16_t crc = frameCrc16(FRAME_CRC_INIT, header, sizeof(header));
+    crc = frameCrc16(crc, (const uint8_t *)payload, len);
+    uint8_t trailer[FRAME_CRC_SIZE] = {(uint8_t)(crc >> 8), (uint8_t)crc};
+
+    out[0] = 0x00; // 先頭の区切り
+    frameCobs_t c = {
+        .out = out, .size = outSize - 1, .pos = 2, .codePos = 1, .code = 1};
+    if (!frameCobsPutBytes(&c, header, sizeof(header)) ||
+        !frameCobsPutBytes(&c, (const uint8_t *)payload, len) ||
+        !frameCobsPutBytes(&c, trailer, sizeof(trailer)))
+    {
+        return 0;
+    }
+    out[c.codePos] = c.code;
+    out[c.pos++] = 0x00; // 末尾の区切り(sizeを1バイト残してある)
+    return c.pos;
+}
+
+void frameDecoderInit(frameDecoder_t *dec, uint8_t *buffer, size_t bufferSize)
+{
+    dec->buffer = buffer;
+    dec->bufferSize = bufferSize;
+    dec->len = 0;
+    dec->overflow = false;
+}
+
+// dataを区切りまで読み進め、読んだバイト数を返す
+// 区切りに達した場合はstatusにデコード結果を返す(区切りのみの空の塊は無視)
+// 残りのデータは、戻り値の位置から再度Feedする
+size_t frameDecoderFeed(frameDecoder_t *dec, const uint8_t *data, size_t len,
+                        frame_t *frame, frameStatus_t *status)
+{
+    *status = FRAME_STATUS_NONE;
+
+    // 区切りはmemchrで探し、区切りまでをまとめてコピーする
+    const uint8_t *delimiter = memchr(data, 0x00, len);
+    size_t n = (delimiter != NULL) ? (size_t)(delimiter - data) : len;
+    if (dec->len + n <= dec->bufferSize)
+    {
+        memcpy(&dec->buffer[dec->len], data, n);
+        dec->len += n;
+    }
+    else
+    {
+        dec->overflow = true;
+    }
+
+    if (delimiter == NULL)
+    {
+        return n;
+    }
+
+    if (dec->len > 0 || dec->overflow)
+    {
+        *status = frameDecoderFinish(dec, frame);
+    }
+    dec->len = 0;
+    dec->overflow = false;
+    return n + 1;
+}
+
+// バッファ内の1フレームをその場でCOBSデコードし、CRCを確認する
+static frameStatus_t frameDecoderFinish(frameDecoder_t *dec, frame_t *frame)
+{
+    if (dec->overflow)
+    {
+        return FRAME_STATUS_ERROR;
+    }
+
+    // デコード後は必ず短くなるため、前から上書きしてよい
+    uint8_t *buf = dec->buffer;
+    size_t in = 0;
+    size_t out = 0;
+    while (in < dec->len)
+    {
+        uint8_t code = buf[in++];
+        if (in + code - 1 > dec->len)
+        {
+            return FRAME_STATUS_ERROR;
+        }
+        memmove(&buf[out], &buf[in], code - 1);
+        out += code - 1;
+        in += code - 1;
+        if (code != 0xFF && in < dec->len)
+        {
+            buf[out++] = 0x00;
+        }
+    }
+
+    if (out < FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
+    {
+        return FRAME_STATUS_ERROR;
+    }
+    size_t bodyLen = out - FRAME_CRC_SIZE;
+    uint16_t crc = ((uint16_t)buf[bodyLen] << 8) | buf[bodyLen + 1];
+    if (frameCrc16(FRAME_CRC_INIT, buf, bodyLen) != crc)
+    {
+        return FRAME_STATUS_ERROR;
+    }
+
+    frame->channel = buf[0];
+    frame->seq = buf[1];
+    frame->payload = &buf[FRAME_HEADER_SIZE];
+    frame->len = bodyLen - FRAME_HEADER_SIZE;
+    return FRAME_STATUS_OK;
+}
+
+// CRC-16/CCITT-FALSE(多項式0x1021)。4bitずつのテーブルで計算する
+uint16_t frameCrc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
+
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)];
+    }
+    return crc;
+}
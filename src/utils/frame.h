@@ -0,0 +1,73 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// USBのバイト列上のフレーム(チャネル多重化用)
+// pico-sdk/FreeRTOSに依存しないため、ホスト側のツールでもそのまま使用できる
+//
+// フレーム: 0x00 | COBS( channel | seq | payload | crc16 ) | 0x00
+//  - channel : 送信先のチャネル
+//  - seq     : チャネルごとの連番(欠落の検出用)
+//  - crc16   : channelからpayloadまでのCRC-16/CCITT-FALSE(big endian)
+//  - 0x00    : 区切り。COBSによりフレーム内には0x00が現れない
+// 先頭にも区切りを置き、直前にテキスト等が流れていても別の塊として切り離す
+//
+// オーバーヘッド: 254バイト未満のpayloadなら7バイト
+//  (ヘッダー2 + CRC2 + COBS1 + 区切り2)
+#define FRAME_HEADER_SIZE 2
+#define FRAME_CRC_SIZE 2
+#define FRAME_ENCODED_MAX(payloadLen)                                          \
+    ((payloadLen) + FRAME_HEADER_SIZE + FRAME_CRC_SIZE +                       \
+     ((payloadLen) + FRAME_HEADER_SIZE + FRAME_CRC_SIZE) / 254 + 1 + 2)
+
+// 制御チャネル(デバイス/ホスト共通)
+// payload: [0]種別, [1]デバイスの受信用プールの空きブロック数
+//  FLOW_OFF: デバイスの受信が追いつかない。ホストは送信を止める
+//  FLOW_ON : 送信を再開してよい
+#define FRAME_CHANNEL_CONTROL 3
+#define FRAME_CONTROL_FLOW_OFF 0x13 // XOFFと同じ値
+#define FRAME_CONTROL_FLOW_ON 0x11  // XONと同じ値
+#define FRAME_CONTROL_FLOW_SIZE 2
+
+// バイナリRPCのチャネル(形式はrpc_proto.h)
+#define FRAME_CHANNEL_RPC 4
+
+// デコード結果
+typedef enum
+{
+    FRAME_STATUS_NONE = 0, // フレームの途中(区切りを待っている)
+    FRAME_STATUS_OK,       // 1フレームをデコードした
+    FRAME_STATUS_ERROR     // 不正なフレーム(CRC不一致、長さ不足、溢れ)
+} frameStatus_t;
+
+typedef struct
+{
+    uint8_t channel;
+    uint8_t seq;
+    const uint8_t *payload; // デコーダーの内部バッファを指す(次のFeedまで有効)
+    size_t len;
+} frame_t;
+
+// ストリームのデコーダー
+// bufferSizeを超えるフレームはFRAME_STATUS_ERRORとして読み捨てる
+typedef struct
+{
+    uint8_t *buffer;
+    size_t bufferSize;
+    size_t len;
+    bool overflow;
+} frameDecoder_t;
+
+extern size_t frameEncode(uint8_t channel, uint8_t seq, const void *payload,
+                          size_t len, uint8_t *out, size_t outSize);
+extern void frameDecoderInit(frameDecoder_t *dec, uint8_t *buffer,
+                             size_t bufferSize);
+extern size_t frameDecoderFeed(frameDecoder_t *dec, const uint8_t *data,
+                               size_t len, frame_t *frame,
+                               frameStatus_t *status);
+extern uint16_t frameCrc16(uint16_t crc, const uint8_t *data, size_t len);
+
+#endif // FRAME_H
@@ -0,0 +1,104 @@
+#include "line_framer.h"
+
+#include <string.h>
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+void lineFramerInit(lineFramer_t *lf, char *buffer, size_t bufferSize,
+                    lineOverflow_t policy);
+void lineFramerReset(lineFramer_t *lf);
+size_t lineFramerFeed(lineFramer_t *lf, const uint8_t *data, size_t len,
+                      line_t *line, lineStatus_t *status);
+static void lineFramerAppend(lineFramer_t *lf, const uint8_t *data, size_t len);
+
+void lineFramerInit(lineFramer_t *lf, char *buffer, size_t bufferSize,
+                    lineOverflow_t policy)
+{
+    lf->buffer = buffer;
+    lf->bufferSize = bufferSize;
+    lf->policy = policy;
+    lf->overflowNum = 0;
+    lineFramerReset(lf);
+}
+
+// 貯めている途中の行を捨てる
+void lineFramerReset(lineFramer_t *lf)
+{
+    lf->len = 0;
+    lf->dropped = 0;
+}
+
+// 入りきる分だけバッファにまとめてコピーし、残りは長さだけ数える
+static void lineFramerAppend(lineFramer_t *lf, const uint8_t *data, size_t len)
+{
+    size_t space = lf->bufferSize - lf->len;
+    size_t n = (len < space) ? len : space;
+    memcpy(&lf->buffer[lf->len], data, n);
+    lf->len += n;
+    lf->dropped += len - n;
+}
+
+// dataを区切りまで読み進め、読んだバイト数を返す
+// 区切りに達した場合はstatusとlineに行を返す
+// 残りのデータは、戻り値の位置から再度Feedする
+size_t lineFramerFeed(lineFramer_t *lf, const uint8_t *data, size_t len,
+                      line_t *line, lineStatus_t *status)
+{
+    *status = LINE_STATUS_NONE;
+
+    const uint8_t *delimiter = memchr(data, '\n', len);
+    if (delimiter == NULL)
+    {
+        lineFramerAppend(lf, data, len);
+        return len;
+    }
+
+    size_t n = (size_t)(delimiter - data);
+    const char *text;
+    size_t textLen;
+    if (lf->len == 0 && lf->dropped == 0)
+    {
+        // 行全体が入力データ内にある。コピーしない
+        text = (const char *)data;
+        textLen = n;
+    }
+    else
+    {
+        lineFramerAppend(lf, data, n);
+        text = lf->buffer;
+        textLen = lf->len;
+    }
+
+    // 捨てた部分がある場合は、textLenが最大長を超えているため調べなくてよい
+    if (lf->dropped == 0 && textLen > 0 && text[textLen - 1] == '\r')
+    {
+        textLen--;
+    }
+
+    size_t maxLen = lf->bufferSize - 1;
+    size_t totalLen = textLen + lf->dropped;
+    lineFramerReset(lf);
+
+    if (totalLen <= maxLen)
+    {
+        *status = LINE_STATUS_OK;
+        line->data = text;
+        line->len = textLen;
+    }
+    else if (lf->policy == LINE_OVERFLOW_TRUNCATE)
+    {
+        lf->overflowNum++;
+        *status = LINE_STATUS_TRUNCATED;
+        line->data = text;
+        line->len = maxLen;
+    }
+    else
+    {
+        lf->overflowNum++;
+        *status = LINE_STATUS_DISCARDED;
+        line->data = NULL;
+        line->len = totalLen;
+    }
+    return n + 1;
+}
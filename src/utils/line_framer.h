@@ -0,0 +1,58 @@
+#ifndef LINE_FRAMER_H
+#define LINE_FRAMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// バイト列を'\n'区切りの行に分割する(テキストコマンド用)
+// pico-sdk/FreeRTOSに依存しないため、ホスト側のツールでもそのまま使用できる
+//
+// - 区切りはmemchrで探し、区切りまでをまとめてコピーする
+// - 1回のFeedで受け取ったデータの中に行全体が収まっていればコピーせず、
+//   入力データを指したまま行を返す。チャンクをまたぐ行のみ内部バッファに貯める
+// - 行末の'\r'は取り除く("\r\n"に対応)
+//
+// 行の最大長はbufferSize - 1(最後の1バイトは行末の'\r'の分)
+
+// 最大長を超えた行の扱い
+typedef enum
+{
+    LINE_OVERFLOW_DISCARD = 0, // 行全体を捨てる(LINE_STATUS_DISCARDED)
+    LINE_OVERFLOW_TRUNCATE     // 最大長までを返す(LINE_STATUS_TRUNCATED)
+} lineOverflow_t;
+
+typedef enum
+{
+    LINE_STATUS_NONE = 0,  // 行の途中(区切りを待っている)
+    LINE_STATUS_OK,        // 1行を取り出した(空行を含む)
+    LINE_STATUS_TRUNCATED, // 最大長を超えたため途中までを返した
+    LINE_STATUS_DISCARDED  // 最大長を超えたため捨てた(lenは捨てた長さ)
+} lineStatus_t;
+
+// 取り出した行('\n'と行末の'\r'を含まない。'\0'終端ではない)
+// dataはFeedに渡した入力データか内部バッファを指す
+// 次のFeedまで、かつ入力データを解放するまで有効
+typedef struct
+{
+    const char *data;
+    size_t len;
+} line_t;
+
+typedef struct
+{
+    char *buffer;
+    size_t bufferSize;
+    size_t len;            // バッファに貯めた長さ
+    size_t dropped;        // バッファに入りきらず捨てた長さ
+    lineOverflow_t policy; // 最大長を超えた行の扱い
+    uint32_t overflowNum;  // 最大長を超えた行の数(統計用)
+} lineFramer_t;
+
+extern void lineFramerInit(lineFramer_t *lf, char *buffer, size_t bufferSize,
+                           lineOverflow_t policy);
+extern void lineFramerReset(lineFramer_t *lf);
+extern size_t lineFramerFeed(lineFramer_t *lf, const uint8_t *data, size_t len,
+                             line_t *line, lineStatus_t *status);
+
+#endif // LINE_FRAMER_H
@@ -0,0 +1,192 @@
+#include "log_ring.h"
+#include "typedef.h"
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+bool logRingInit(logRing_t *lr, uint8_t *buffer, size_t bufferSize);
+uint8_t *logRingReserve(logRing_t *lr, size_t len);
+uint8_t *logRingTryReserve(logRing_t *lr, size_t len);
+static uint8_t *logRingReserveRetry(logRing_t *lr, size_t len,
+                                    uint32_t retryMax);
+void logRingCommit(logRing_t *lr, uint8_t *payload, size_t len);
+bool logRingPeek(logRing_t *lr, const uint8_t **data, size_t *len);
+void logRingRelease(logRing_t *lr);
+static atomic_uint *logRingHeader(logRing_t *lr, uint32_t pos);
+
+#define LOG_RING_HDR_COMMITTED (1u << 31)
+#define LOG_RING_HDR_PADDING (1u << 30)
+#define LOG_RING_HDR_CAP_SHIFT 15
+#define LOG_RING_HDR_LEN_MASK 0x7FFFu
+#define LOG_RING_ALIGN(len) (((len) + 3u) & ~3u)
+
+static atomic_uint *logRingHeader(logRing_t *lr, uint32_t pos)
+{
+    return (atomic_uint *)&lr->buffer[pos & lr->mask];
+}
+
+bool logRingInit(logRing_t *lr, uint8_t *buffer, size_t bufferSize)
+{
+    if (lr == NULL || buffer == NULL ||
+        !RING_BUFFER_IS_POWER_OF_2(bufferSize) || ((uintptr_t)buffer & 3u) != 0)
+    {
+        return false;
+    }
+    // 未確定のヘッダーを確定済みと誤認しないよう、空き領域は常に0にしておく
+    memset(buffer, 0, bufferSize);
+    lr->buffer = buffer;
+    lr->bufferSize = bufferSize;
+    lr->mask = bufferSize - 1;
+    atomic_init(&lr->reserveHead, 0);
+    atomic_init(&lr->tail, 0);
+    lr->peekSize = 0;
+    return true;
+}
+
+// lenバイトの書き込み領域を確保して返す。空きがなければNULL
+// 確保した領域は必ずlogRingCommit()すること
+// 1レコードはbufferSizeの半分まで(末尾での折り返しを考慮)
+uint8_t *logRingReserve(logRing_t *lr, size_t len)
+{
+    return logRingReserveRetry(lr, len, UINT32_MAX);
+}
+
+// logRingReserve()と同じだが、他のproducerと競合した場合の再試行回数を
+// LOG_RING_TRY_RETRY_MAXまでに制限する(割り込みハンドラから使用する)
+// 競合が続いた場合はNULLを返す
+uint8_t *logRingTryReserve(logRing_t *lr, size_t len)
+{
+    return logRingReserveRetry(lr, len, LOG_RING_TRY_RETRY_MAX);
+}
+
+static uint8_t *logRingReserveRetry(logRing_t *lr, size_t len,
+                                    uint32_t retryMax)
+{
+    if (lr == NULL || len == 0 || len > LOG_RING_RECORD_MAX)
+    {
+        return NULL;
+    }
+    uint32_t recordSize = LOG_RING_HEADER_SIZE + LOG_RING_ALIGN(len);
+    if (recordSize > lr->bufferSize / 2)
+    {
+        return NULL;
+    }
+
+    uint32_t head =
+        atomic_load_explicit(&lr->reserveHead, memory_order_relaxed);
+    uint32_t padSize;
+    uint32_t retry = 0;
+    do
+    {
+        // consumerが解放(0クリア)した領域のみ確保する
+        uint32_t tail = atomic_load_explicit(&lr->tail, memory_order_acquire);
+
+        // バッファ末尾をまたぐ場合は、末尾をパディングにして先頭から確保する
+        uint32_t toEnd = lr->bufferSize - (head & lr->mask);
+        padSize = (recordSize > toEnd) ? toEnd : 0;
+
+        if ((head - tail) + padSize + recordSize > lr->bufferSize)
+        {
+            return NULL; // バッファがいっぱい
+        }
+        if (retry++ > retryMax)
+        {
+            return NULL; // 競合が続いている
+        }
+    } while (!atomic_compare_exchange_weak_explicit(
+        &lr->reserveHead, &head, head + padSize + recordSize,
+        memory_order_relaxed, memory_order_relaxed));
+
+    if (padSize > 0)
+    {
+        atomic_store_explicit(logRingHeader(lr, head),
+                              LOG_RING_HDR_COMMITTED | LOG_RING_HDR_PADDING,
+                              memory_order_release);
+    }
+
+    // 確保サイズだけ記録しておく(未確定のためconsumerはここで止まる)
+    uint32_t start = head + padSize;
+    atomic_store_explicit(logRingHeader(lr, start),
+                          (uint32_t)len << LOG_RING_HDR_CAP_SHIFT,
+                          memory_order_relaxed);
+    return &lr->buffer[(start & lr->mask) + LOG_RING_HEADER_SIZE];
+}
+
+// 確保した領域を確定する。lenは確保時のサイズ以下であればよい
+void logRingCommit(logRing_t *lr, uint8_t *payload, size_t len)
+{
+    if (lr == NULL || payload == NULL)
+    {
+        return;
+    }
+    atomic_uint *hdr = (atomic_uint *)(payload - LOG_RING_HEADER_SIZE);
+    uint32_t cap = atomic_load_explicit(hdr, memory_order_relaxed);
+    uint32_t capLen = (cap >> LOG_RING_HDR_CAP_SHIFT) & LOG_RING_HDR_LEN_MASK;
+    if (len > capLen)
+    {
+        len = capLen;
+    }
+
+    // payloadの書き込み完了後に確定フラグを公開する(consumerはacquireで読む)
+    atomic_store_explicit(hdr, cap | LOG_RING_HDR_COMMITTED | (uint32_t)len,
+                          memory_order_release);
+}
+
+// 最も古いレコードが確定済みであれば、その内容をコピーせずに返す
+// 読み終えたらlogRingRelease()で解放すること
+bool logRingPeek(logRing_t *lr, const uint8_t **data, size_t *len)
+{
+    if (lr == NULL || data == NULL || len == NULL)
+    {
+        return false;
+    }
+
+    while (1)
+    {
+        uint32_t tail = atomic_load_explicit(&lr->tail, memory_order_relaxed);
+        uint32_t head =
+            atomic_load_explicit(&lr->reserveHead, memory_order_acquire);
+        if (tail == head)
+        {
+            return false; // バッファが空
+        }
+
+        uint32_t hdr =
+            atomic_load_explicit(logRingHeader(lr, tail), memory_order_acquire);
+        if ((hdr & LOG_RING_HDR_COMMITTED) == 0)
+        {
+            return false; // 書き込み中
+        }
+
+        uint32_t offset = tail & lr->mask;
+        if (hdr & LOG_RING_HDR_PADDING)
+        {
+            // パディングは読み飛ばしてバッファ先頭から続ける
+            lr->peekSize = lr->bufferSize - offset;
+            logRingRelease(lr);
+            continue;
+        }
+
+        uint32_t capLen =
+            (hdr >> LOG_RING_HDR_CAP_SHIFT) & LOG_RING_HDR_LEN_MASK;
+        lr->peekSize = LOG_RING_HEADER_SIZE + LOG_RING_ALIGN(capLen);
+        *data = &lr->buffer[offset + LOG_RING_HEADER_SIZE];
+        *len = hdr & LOG_RING_HDR_LEN_MASK;
+        return true;
+    }
+}
+
+// Peekしたレコードを解放する
+void logRingRelease(logRing_t *lr)
+{
+    if (lr == NULL || lr->peekSize == 0)
+    {
+        return;
+    }
+    uint32_t tail = atomic_load_explicit(&lr->tail, memory_order_relaxed);
+
+    // 0クリアしてからproducerに返す
+    memset(&lr->buffer[tail & lr->mask], 0, lr->peekSize);
+    atomic_store_explicit(&lr->tail, tail + lr->peekSize, memory_order_release);
+    lr->peekSize = 0;
+}
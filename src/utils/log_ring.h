@@ -0,0 +1,52 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdatomic.h>
+
+#include "ring_buffer.h" // for RING_BUFFER_IS_POWER_OF_2
+#include "typedef.h"
+
+// 複数producer/単一consumerのレコード型リングバッファ
+//  1. producerはlogRingReserve()で領域をatomicに確保し、直接書き込む
+//  2. logRingCommit()で確定する。確定順は確保順と異なってもよい
+//  3. consumerはlogRingPeek()で確定済みのレコードだけを確保順に取り出す
+// producer同士はmutexを使わないため、別コアのproducerとも互いに待たない
+
+// レコードヘッダー(4byte)
+//  bit31    : 確定済み
+//  bit30    : パディング(末尾の折り返し用。consumerは読み飛ばす)
+//  bit29-15 : 確保したpayloadサイズ
+//  bit14-0  : 確定したpayloadサイズ
+#define LOG_RING_HEADER_SIZE 4
+#define LOG_RING_RECORD_MAX 0x7FFF // 1レコードの最大payloadサイズ
+// logRingTryReserve()のCAS再試行回数の上限(割り込みハンドラ用)
+#define LOG_RING_TRY_RETRY_MAX 4
+
+typedef struct
+{
+    uint8_t *buffer;           // buffer pointer (4byte境界)
+    uint32_t bufferSize;       // size of the buffer (2のべき乗)
+    uint32_t mask;             // bufferSize - 1
+    atomic_uint reserveHead;   // 確保済み位置 (producerがCASで更新)
+    atomic_uint tail;          // 解放済み位置 (consumerのみ更新)
+    uint32_t peekSize;         // Peek中のレコードサイズ (consumerのみ使用)
+} logRing_t;
+
+// リングと格納領域を静的に定義する。RING_BUFFER_DEFINEと同様
+#define LOG_RING_DEFINE(name, size)                                            \
+    _Static_assert(RING_BUFFER_IS_POWER_OF_2(size) && (size) >= 64,            \
+                   #name ": log ring size must be a power of 2");              \
+    static uint32_t name##_storage[(size) / sizeof(uint32_t)];                 \
+    static logRing_t name
+
+#define LOG_RING_INIT(name)                                                    \
+    logRingInit(&(name), (uint8_t *)name##_storage, sizeof(name##_storage))
+
+extern bool logRingInit(logRing_t *lr, uint8_t *buffer, size_t bufferSize);
+extern uint8_t *logRingReserve(logRing_t *lr, size_t len);
+extern uint8_t *logRingTryReserve(logRing_t *lr, size_t len);
+extern void logRingCommit(logRing_t *lr, uint8_t *payload, size_t len);
+extern bool logRingPeek(logRing_t *lr, const uint8_t **data, size_t *len);
+extern void logRingRelease(logRing_t *lr);
+
+#endif // LOG_RING_H
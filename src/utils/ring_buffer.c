@@ -5,58 +5,118 @@
 /****************************************************
  * forward declaration
  ****************************************************/
-bool ringBufferInit(ringBuffer_t *rb, uint8_t *buffer, size_t bufferSize);
+bool ringBufferInit(ringBuffer_t *rb, uint8_t *buffer, size_t bufferSize,
+                    ringBufferMode_t mode);
 size_t ringBufferAvailableSize(ringBuffer_t *rb);
 void ringBufferClear(ringBuffer_t *rb);
 int32_t ringBufferEnqueue(ringBuffer_t *rb, const uint8_t *data, size_t len);
 int32_t ringBufferDequeue(ringBuffer_t *rb, uint8_t *data, size_t len);
+size_t ringBufferPeekContiguous(ringBuffer_t *rb, ringBufferSpan_t *span);
+int32_t ringBufferConsume(ringBuffer_t *rb, size_t len);
+int32_t ringBufferEnqueueWait(ringBuffer_t *rb, const uint8_t *data,
+                              size_t len, rtos_time_ms_t timeout_ms);
+int32_t ringBufferDequeueWait(ringBuffer_t *rb, uint8_t *data, size_t len,
+                              rtos_time_ms_t timeout_ms);
+void ringBufferSetConsumerTask(ringBuffer_t *rb, rtos_task_handle_t task);
+static void ringBufferLock(ringBuffer_t *rb);
+static void ringBufferUnlock(ringBuffer_t *rb);
+static void ringBufferNotify(_Atomic(rtos_task_handle_t) *waiter);
+static bool ringBufferWaitRemaining(uint32_t startMs, rtos_time_ms_t timeout_ms,
+                                    rtos_time_ms_t *remaining);
 
-bool ringBufferInit(ringBuffer_t *rb, uint8_t *buffer, size_t bufferSize)
+bool ringBufferInit(ringBuffer_t *rb, uint8_t *buffer, size_t bufferSize,
+                    ringBufferMode_t mode)
 {
-    if (rb == NULL || buffer == NULL || bufferSize == 0)
+    if (rb == NULL || buffer == NULL || !RING_BUFFER_IS_POWER_OF_2(bufferSize))
     {
         return false;
     }
     rb->buffer = buffer;
     rb->bufferSize = bufferSize;
+    rb->mask = bufferSize - 1;
     rb->head = 0;
     rb->tail = 0;
-    rb->count = 0;
-    rb->mtx = rtos_mutex_create();
+    atomic_init(&rb->count, 0);
+    rb->mode = mode;
+    rb->mtx = NULL;
+    atomic_init(&rb->waitingProducer, NULL);
+    atomic_init(&rb->waitingConsumer, NULL);
+    if (mode == RING_BUFFER_MODE_MUTEX)
+    {
+        rb->mtx = rtos_mutex_create_static(&rb->mtxBuf);
+        if (rb->mtx == NULL)
+        {
+            return false;
+        }
+    }
     return true;
 }
 
+// SPSCモードではmtxを使わない
+static void ringBufferLock(ringBuffer_t *rb)
+{
+    if (rb->mode == RING_BUFFER_MODE_MUTEX)
+    {
+        rtos_mutex_take(rb->mtx);
+    }
+}
+
+static void ringBufferUnlock(ringBuffer_t *rb)
+{
+    if (rb->mode == RING_BUFFER_MODE_MUTEX)
+    {
+        rtos_mutex_give(rb->mtx);
+    }
+}
+
+// 待っているタスクがあれば起床させる
+static void ringBufferNotify(_Atomic(rtos_task_handle_t) *waiter)
+{
+    rtos_task_handle_t task =
+        atomic_load_explicit(waiter, memory_order_acquire);
+    if (task != NULL)
+    {
+        rtos_task_notify_give(task);
+    }
+}
+
 size_t ringBufferAvailableSize(ringBuffer_t *rb)
 {
     if (rb == NULL)
     {
         return 0;
     }
-    return rb->bufferSize - rb->count;
+    // consumerによるcount減算(release)以降にproducerが書き込むようacquire
+    return rb->bufferSize -
+           atomic_load_explicit(&rb->count, memory_order_acquire);
 }
 
+// SPSCモードではproducer/consumerが共に停止している時のみ呼び出すこと
 void ringBufferClear(ringBuffer_t *rb)
 {
-    rtos_mutex_take(rb->mtx);
+    if (rb == NULL)
+    {
+        return;
+    }
+    ringBufferLock(rb);
     rb->head = 0;
     rb->tail = 0;
-    rb->count = 0;
+    atomic_store_explicit(&rb->count, 0, memory_order_release);
     memset(rb->buffer, 0, rb->bufferSize);
-    rtos_mutex_give(rb->mtx);
+    ringBufferUnlock(rb);
 }
 
 int32_t ringBufferEnqueue(ringBuffer_t *rb, const uint8_t *data, size_t len)
 {
-    rtos_mutex_take(rb->mtx);
-    int32_t ret = E_OTHER;
-
     if (rb == NULL || data == NULL || len == 0)
     {
-        ret = E_ARGUMENT;
-        goto exit;
+        return E_ARGUMENT;
     }
-    size_t bytesToEnqueue =
-        (len < ringBufferAvailableSize(rb)) ? len : ringBufferAvailableSize(rb);
+    ringBufferLock(rb);
+    int32_t ret = E_OTHER;
+
+    size_t available = ringBufferAvailableSize(rb);
+    size_t bytesToEnqueue = (len < available) ? len : available;
 
     if (bytesToEnqueue == 0)
     {
@@ -71,41 +131,43 @@ int32_t ringBufferEnqueue(ringBuffer_t *rb, const uint8_t *data, size_t len)
                                    ? bytesToEnqueue
                                    : firstChunkRemaining;
     memcpy(&rb->buffer[rb->head], data, firstChunkWriting);
-    rb->head = (rb->head + firstChunkWriting) % rb->bufferSize;
-    rb->count += firstChunkWriting;
+    rb->head = (rb->head + firstChunkWriting) & rb->mask;
     bytesToEnqueue -= firstChunkWriting;
     bytesEnqueued += firstChunkWriting;
 
-    // 残りデータがなければ終了
-    if (bytesToEnqueue == 0)
+    // 残りのデータがある場合はBufferの先頭から書き込む
+    if (bytesToEnqueue > 0)
     {
-        ret = bytesEnqueued;
-        goto exit;
+        memcpy(&rb->buffer[rb->head], &data[bytesEnqueued], bytesToEnqueue);
+        rb->head = (rb->head + bytesToEnqueue) & rb->mask;
+        bytesEnqueued += bytesToEnqueue;
     }
 
-    // 残りのデータがある場合はBufferの先頭から書き込む
-    memcpy(&rb->buffer[rb->head], &data[bytesEnqueued], bytesToEnqueue);
-    rb->head = (rb->head + bytesToEnqueue) % rb->bufferSize;
-    rb->count += bytesToEnqueue;
-    bytesEnqueued += bytesToEnqueue;
+    // データ書き込み完了後にcountを公開する(consumerはacquireで読む)
+    atomic_fetch_add_explicit(&rb->count, bytesEnqueued, memory_order_release);
     ret = bytesEnqueued;
 
 exit:
-    rtos_mutex_give(rb->mtx);
+    ringBufferUnlock(rb);
+    if (ret > 0)
+    {
+        ringBufferNotify(&rb->waitingConsumer);
+    }
     return ret;
 }
 
 int32_t ringBufferDequeue(ringBuffer_t *rb, uint8_t *data, size_t len)
 {
-    rtos_mutex_take(rb->mtx);
-    int32_t ret = E_OTHER;
-
     if (rb == NULL || data == NULL || len == 0)
     {
-        ret = E_ARGUMENT;
-        goto exit;
+        return E_ARGUMENT;
     }
-    size_t bytesToDequeue = (len < rb->count) ? len : rb->count;
+    ringBufferLock(rb);
+    int32_t ret = E_OTHER;
+
+    // producerによるcount加算(release)以前の書き込みが見えるようacquire
+    size_t count = atomic_load_explicit(&rb->count, memory_order_acquire);
+    size_t bytesToDequeue = (len < count) ? len : count;
 
     if (bytesToDequeue == 0)
     {
@@ -114,34 +176,198 @@ int32_t ringBufferDequeue(ringBuffer_t *rb, uint8_t *data, size_t len)
     }
     size_t bytesDequeued = 0;
 
-    // tail --> head or tail --> buffer end
-    // まで読み込めるサイズを計算し、memcpyで読み込む
-    size_t firstChunkEndIdx = (rb->head > rb->tail) ? rb->head : rb->bufferSize;
-    size_t firstChunkRemaining = firstChunkEndIdx - rb->tail;
+    // tail --> buffer end まで読み込めるサイズを計算し、memcpyで読み込む
+    // (headはproducer側の変数なので参照しない。countで読み込み量を決める)
+    size_t firstChunkRemaining = rb->bufferSize - rb->tail;
     size_t firstChunkReading = (bytesToDequeue < firstChunkRemaining)
                                    ? bytesToDequeue
                                    : firstChunkRemaining;
     memcpy(data, &rb->buffer[rb->tail], firstChunkReading);
-    rb->tail = (rb->tail + firstChunkReading) % rb->bufferSize;
-    rb->count -= firstChunkReading;
+    rb->tail = (rb->tail + firstChunkReading) & rb->mask;
     bytesToDequeue -= firstChunkReading;
     bytesDequeued += firstChunkReading;
 
-    // 残りデータがなければ終了
-    if (bytesToDequeue == 0)
+    // 残りデータがある場合はBufferの先頭から読み込む
+    if (bytesToDequeue > 0)
+    {
+        memcpy(&data[bytesDequeued], &rb->buffer[rb->tail], bytesToDequeue);
+        rb->tail = (rb->tail + bytesToDequeue) & rb->mask;
+        bytesDequeued += bytesToDequeue;
+    }
+
+    // 読み出し完了後に領域を解放する(producerはacquireで読む)
+    atomic_fetch_sub_explicit(&rb->count, bytesDequeued, memory_order_release);
+    ret = bytesDequeued;
+
+exit:
+    ringBufferUnlock(rb);
+    if (ret > 0)
     {
-        ret = bytesDequeued;
+        ringBufferNotify(&rb->waitingProducer);
+    }
+    return ret;
+}
+
+// 読み出し可能な領域をコピーせずに返す。戻り値は読み出し可能な総バイト数
+// 返した領域はringBufferConsume()するまでproducerに上書きされない
+size_t ringBufferPeekContiguous(ringBuffer_t *rb, ringBufferSpan_t *span)
+{
+    if (rb == NULL || span == NULL)
+    {
+        return 0;
+    }
+    ringBufferLock(rb);
+
+    size_t count = atomic_load_explicit(&rb->count, memory_order_acquire);
+
+    // tail --> buffer end
+    size_t firstChunkRemaining = rb->bufferSize - rb->tail;
+    size_t firstChunkLen =
+        (count < firstChunkRemaining) ? count : firstChunkRemaining;
+    span->data[0] = &rb->buffer[rb->tail];
+    span->len[0] = firstChunkLen;
+
+    // 折り返している場合はBufferの先頭から
+    span->data[1] = rb->buffer;
+    span->len[1] = count - firstChunkLen;
+
+    ringBufferUnlock(rb);
+    return count;
+}
+
+// Peekで参照した領域のうち、先頭からlenバイトを解放する
+int32_t ringBufferConsume(ringBuffer_t *rb, size_t len)
+{
+    if (rb == NULL || len == 0)
+    {
+        return E_ARGUMENT;
+    }
+    ringBufferLock(rb);
+    int32_t ret = E_OTHER;
+
+    size_t count = atomic_load_explicit(&rb->count, memory_order_acquire);
+    if (len > count)
+    {
+        ret = E_ARGUMENT; // Peekした以上は解放できない
         goto exit;
     }
 
-    // 残りデータがある場合はBufferの先頭からheadまでの間を読み込む
-    size_t secondChunkReading = bytesToDequeue;
-    memcpy(&data[bytesDequeued], &rb->buffer[rb->tail], secondChunkReading);
-    rb->tail = (rb->tail + secondChunkReading) % rb->bufferSize;
-    rb->count -= secondChunkReading;
-    bytesDequeued += secondChunkReading;
+    rb->tail = (rb->tail + len) & rb->mask;
+    atomic_fetch_sub_explicit(&rb->count, len, memory_order_release);
+    ret = len;
 
 exit:
-    rtos_mutex_give(rb->mtx);
+    ringBufferUnlock(rb);
+    if (ret > 0)
+    {
+        ringBufferNotify(&rb->waitingProducer);
+    }
     return ret;
 }
+
+// 待ち始めてからの経過時間から、残りの待ち時間を求める
+// 戻り値: まだ待てる場合true
+static bool ringBufferWaitRemaining(uint32_t startMs, rtos_time_ms_t timeout_ms,
+                                    rtos_time_ms_t *remaining)
+{
+    if (timeout_ms == MAX_DELAY)
+    {
+        *remaining = MAX_DELAY;
+        return true;
+    }
+    uint32_t elapsed = (uint32_t)rtos_time_get_ms() - startMs;
+    if (elapsed >= timeout_ms)
+    {
+        return false;
+    }
+    *remaining = timeout_ms - elapsed;
+    return true;
+}
+
+// lenバイトすべてを書き込むまで待つ
+// 戻り値: 書き込んだバイト数。1byteも書き込めずにタイムアウトした場合E_TIMEOUT
+int32_t ringBufferEnqueueWait(ringBuffer_t *rb, const uint8_t *data,
+                              size_t len, rtos_time_ms_t timeout_ms)
+{
+    if (rb == NULL || data == NULL || len == 0)
+    {
+        return E_ARGUMENT;
+    }
+    uint32_t startMs = (uint32_t)rtos_time_get_ms();
+    rtos_time_ms_t remaining;
+    size_t bytesEnqueued = 0;
+    int32_t ret = E_OTHER;
+
+    // 空きの確認より先に登録しておき、確認後に解放された場合も通知を受ける
+    // 登録済みのタスクがあれば、終了時に元に戻す
+    rtos_task_handle_t prev = atomic_exchange_explicit(
+        &rb->waitingProducer, rtos_task_get_current(), memory_order_acq_rel);
+    while (bytesEnqueued < len)
+    {
+        ret = ringBufferEnqueue(rb, &data[bytesEnqueued], len - bytesEnqueued);
+        if (ret > 0)
+        {
+            bytesEnqueued += ret;
+            continue;
+        }
+        if (ret != E_WOULDBLOCK)
+        {
+            break; // エラー
+        }
+        if (!ringBufferWaitRemaining(startMs, timeout_ms, &remaining))
+        {
+            ret = E_TIMEOUT;
+            break;
+        }
+        // consumerが領域を解放すると通知される
+        rtos_task_notify_take(remaining);
+    }
+    atomic_store_explicit(&rb->waitingProducer, prev, memory_order_release);
+
+    return (bytesEnqueued > 0) ? (int32_t)bytesEnqueued : ret;
+}
+
+// 1byte以上のデータが来るまで待ち、最大lenバイト読み込む
+// 戻り値: 読み込んだバイト数。タイムアウトした場合E_TIMEOUT
+int32_t ringBufferDequeueWait(ringBuffer_t *rb, uint8_t *data, size_t len,
+                              rtos_time_ms_t timeout_ms)
+{
+    if (rb == NULL || data == NULL || len == 0)
+    {
+        return E_ARGUMENT;
+    }
+    uint32_t startMs = (uint32_t)rtos_time_get_ms();
+    rtos_time_ms_t remaining;
+    int32_t ret = E_OTHER;
+
+    // ringBufferSetConsumerTask()で登録済みのタスクがあれば、終了時に元に戻す
+    rtos_task_handle_t prev = atomic_exchange_explicit(
+        &rb->waitingConsumer, rtos_task_get_current(), memory_order_acq_rel);
+    while (1)
+    {
+        ret = ringBufferDequeue(rb, data, len);
+        if (ret != E_WOULDBLOCK)
+        {
+            break; // 読み込めた or エラー
+        }
+        if (!ringBufferWaitRemaining(startMs, timeout_ms, &remaining))
+        {
+            ret = E_TIMEOUT;
+            break;
+        }
+        // producerがデータを格納すると通知される
+        rtos_task_notify_take(remaining);
+    }
+    atomic_store_explicit(&rb->waitingConsumer, prev, memory_order_release);
+
+    return ret;
+}
+
+void ringBufferSetConsumerTask(ringBuffer_t *rb, rtos_task_handle_t task)
+{
+    if (rb == NULL)
+    {
+        return;
+    }
+    atomic_store_explicit(&rb->waitingConsumer, task, memory_order_release);
+}
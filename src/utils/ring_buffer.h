@@ -1,25 +1,81 @@
 #ifndef RING_BUFFER_H
 #define RING_BUFFER_H
 
+#include <stdatomic.h>
+
 #include "rtos_wrapper.h" // for mtx
 #include "typedef.h"
 
+// 排他方式
+// MUTEX: 複数のproducer/consumerからアクセス可能。毎回mtxを取得する
+// SPSC : producer/consumerがそれぞれ1つだけの場合に使用。mtxを使用せず、
+//        countのatomic操作(acquire/release)でproducer/consumer間を同期する
+typedef enum
+{
+    RING_BUFFER_MODE_MUTEX = 0,
+    RING_BUFFER_MODE_SPSC
+} ringBufferMode_t;
+
 typedef struct ringBuffer
 {
-    uint8_t *buffer;   // buffer pointer
-    size_t bufferSize; // size of the buffer
-    size_t head;       // head index of filled data
-    size_t tail;       // tail index of filled data
-    size_t count;      // number of filled data
-    rtos_mutex_t mtx;  // mtx resource
+    uint8_t *buffer;                // buffer pointer
+    size_t bufferSize;              // size of the buffer (2のべき乗)
+    size_t mask;                    // bufferSize - 1 (indexの折り返しに使用)
+    size_t head;                    // head index of filled data (producerのみ更新)
+    size_t tail;                    // tail index of filled data (consumerのみ更新)
+    atomic_size_t count;            // number of filled data
+    ringBufferMode_t mode;          // 排他方式
+    rtos_mutex_t mtx;               // mtx resource (MUTEXモードのみ)
+    rtos_static_mutex_buf_t mtxBuf; // mtxの静的領域(heapを使用しない)
+    _Atomic(rtos_task_handle_t) waitingProducer; // 空き待ちのタスク
+    _Atomic(rtos_task_handle_t) waitingConsumer; // データ待ちのタスク
 } ringBuffer_t;
 
+// バッファサイズは2のべき乗に限る(indexの折り返しを%ではなく&で行うため)
+#define RING_BUFFER_IS_POWER_OF_2(size)                                        \
+    (((size) != 0) && (((size) & ((size) - 1)) == 0))
+
+// リングバッファと格納領域を静的に定義する(.bssに配置される)
+// サイズが2のべき乗でない場合はコンパイルエラーになる
+// 使用前にRING_BUFFER_INIT()で初期化すること
+#define RING_BUFFER_DEFINE(name, size)                                         \
+    _Static_assert(RING_BUFFER_IS_POWER_OF_2(size),                            \
+                   #name ": ring buffer size must be a power of 2");           \
+    static uint8_t name##_storage[(size)];                                     \
+    static ringBuffer_t name
+
+#define RING_BUFFER_INIT(name, mode)                                           \
+    ringBufferInit(&(name), name##_storage, sizeof(name##_storage), (mode))
+
+// 読み出し可能な領域(コピーせずにバッファ内を直接参照する)
+// データが末尾で折り返している場合は2つの領域に分かれる
+#define RING_BUFFER_SPAN_MAX 2
+typedef struct
+{
+    const uint8_t *data[RING_BUFFER_SPAN_MAX]; // 領域の先頭
+    size_t len[RING_BUFFER_SPAN_MAX];          // 領域の長さ(未使用は0)
+} ringBufferSpan_t;
+
 extern bool ringBufferInit(ringBuffer_t *rb, uint8_t *buffer,
-                           size_t bufferSize);
+                           size_t bufferSize, ringBufferMode_t mode);
 extern size_t ringBufferAvailableSize(ringBuffer_t *rb);
 extern void ringBufferClear(ringBuffer_t *rb);
 extern int32_t ringBufferEnqueue(ringBuffer_t *rb, const uint8_t *data,
                                  size_t len);
 extern int32_t ringBufferDequeue(ringBuffer_t *rb, uint8_t *data, size_t len);
+// Peek/Consumeはconsumerが1つの場合のみ使用可能
+extern size_t ringBufferPeekContiguous(ringBuffer_t *rb,
+                                       ringBufferSpan_t *span);
+extern int32_t ringBufferConsume(ringBuffer_t *rb, size_t len);
+// 空き/データができるまで待つ(タスク通知で起床する。ポーリングしない)
+// 待てるのはproducer/consumerそれぞれ1タスクまで
+extern int32_t ringBufferEnqueueWait(ringBuffer_t *rb, const uint8_t *data,
+                                     size_t len, rtos_time_ms_t timeout_ms);
+extern int32_t ringBufferDequeueWait(ringBuffer_t *rb, uint8_t *data,
+                                     size_t len, rtos_time_ms_t timeout_ms);
+// データ格納時に通知するconsumerタスクを固定で登録する
+// (Peek/Consumeを使うconsumerがrtos_task_notify_take()で待つ場合に使用)
+extern void ringBufferSetConsumerTask(ringBuffer_t *rb,
+                                      rtos_task_handle_t task);
 
 #endif // RING_BUFFER_H
@@ -0,0 +1,51 @@
+#ifndef RPC_PROTO_H
+#define RPC_PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+
+// バイナリRPCの形式(デバイス/ホスト共通)
+// FRAME_CHANNEL_RPCのフレームのpayloadとして送る
+//
+// 要求: id(2) | method(1) | 引数
+// 応答: id(2) | status(1) | 結果
+//  - id    : ホストが付ける要求ID(little endian)。応答にそのまま返す
+//  - status: rpcStatus_t
+// ホストは応答を待たずに複数の要求を送ってよい(パイプライン)
+// デバイスは複数のワーカーで処理するため、応答の順序は要求の順序と異なりうる
+#define RPC_HEADER_SIZE 3
+#define RPC_PAYLOAD_MAX 240 // USB_FRAME_PAYLOAD_MAXと同じ
+#define RPC_DATA_MAX (RPC_PAYLOAD_MAX - RPC_HEADER_SIZE)
+
+typedef enum
+{
+    RPC_METHOD_PING = 0,      // 引数をそのまま返す
+    RPC_METHOD_DELAY,         // 引数: ms(2)。指定時間後に応答する
+    RPC_METHOD_GET_LOG_LEVEL, // 引数: module(1) / 結果: level(1)
+    RPC_METHOD_SET_LOG_LEVEL, // 引数: module(1) level(1)
+    RPC_METHOD_MAX
+} rpcMethod_t;
+
+typedef enum
+{
+    RPC_STATUS_OK = 0,
+    RPC_STATUS_NO_METHOD,    // 未対応のmethod
+    RPC_STATUS_BAD_ARGUMENT, // 引数の長さ/値が不正
+    RPC_STATUS_ERROR         // 処理に失敗した
+} rpcStatus_t;
+
+static inline void rpcPutHeader(uint8_t *payload, uint16_t id, uint8_t code)
+{
+    payload[0] = (uint8_t)id;
+    payload[1] = (uint8_t)(id >> 8);
+    payload[2] = code;
+}
+
+static inline uint16_t rpcGetId(const uint8_t *payload)
+{
+    return (uint16_t)(payload[0] | (payload[1] << 8));
+}
+
+#endif // RPC_PROTO_H
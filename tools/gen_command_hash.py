@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# コマンド表(src/app/command_list.h)から最小完全ハッシュの表を生成する
+# ビルド時にCMakeから実行される(build/CMakeLists.txt)
+#
+# 使い方:
+#   gen_command_hash.py <command_list.h> <command_hash.h>
+#
+# 方式: hash and displace (2段階)
+#   base   = FNV-1a(name)
+#   bucket = mix(base) & (BUCKET_NUM - 1)
+#   slot   = mix(base ^ displace[bucket] * 0x9E3779B9) & (SLOT_NUM - 1)
+# slotにはコマンド表の添字が入る。衝突しないdisplaceをバケットごとに探す
+# ハッシュ関数はsrc/app/command.cのcommandHashBase/commandHashMixと一致させること
+
+import re
+import sys
+
+MASK32 = 0xFFFFFFFF
+DISPLACE_MAX = 0xFFFF
+SLOT_EMPTY = 0xFFFF
+
+
+def hash_base(name):
+    h = 2166136261
+    for c in name.encode():
+        h ^= c
+        h = (h * 16777619) & MASK32
+    return h
+
+
+def hash_mix(h):
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & MASK32
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & MASK32
+    h ^= h >> 16
+    return h
+
+
+def slot_of(base, displace, slot_num):
+    return hash_mix(base ^ ((displace * 0x9E3779B9) & MASK32)) & (slot_num - 1)
+
+
+def next_pow2(n):
+    p = 1
+    while p < n:
+        p <<= 1
+    return p
+
+
+def parse(path):
+    pattern = re.compile(r'^\s*COMMAND\(\s*"([^"]+)"', re.MULTILINE)
+    with open(path, encoding="utf-8") as f:
+        names = pattern.findall(f.read())
+    if not names:
+        sys.exit(f"{path}: no COMMAND entries")
+    if len(set(names)) != len(names):
+        sys.exit(f"{path}: duplicate command name")
+    return names
+
+
+def build(names, slot_num):
+    bucket_num = max(1, slot_num // 2)
+    bases = [hash_base(n) for n in names]
+    buckets = [[] for _ in range(bucket_num)]
+    for i, base in enumerate(bases):
+        buckets[hash_mix(base) & (bucket_num - 1)].append(i)
+
+    displace = [0] * bucket_num
+    slots = [SLOT_EMPTY] * slot_num
+    # 要素の多いバケットから埋める
+    for b in sorted(range(bucket_num), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            break
+        for d in range(1, DISPLACE_MAX + 1):
+            cand = [slot_of(bases[i], d, slot_num) for i in buckets[b]]
+            if len(set(cand)) == len(cand) and all(
+                slots[s] == SLOT_EMPTY for s in cand
+            ):
+                break
+        else:
+            return None
+        displace[b] = d
+        for i, s in zip(buckets[b], cand):
+            slots[s] = i
+    return displace, slots
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: gen_command_hash.py <command_list.h> <command_hash.h>")
+    names = parse(sys.argv[1])
+
+    slot_num = next_pow2(len(names))
+    while (result := build(names, slot_num)) is None:
+        slot_num *= 2
+    displace, slots = result
+
+    def array(values):
+        return ",\n".join(
+            "    " + ", ".join(str(v) for v in values[i : i + 12])
+            for i in range(0, len(values), 12)
+        )
+
+    out = f"""\
+// このファイルはtools/gen_command_hash.pyが生成する。編集しないこと
+#ifndef COMMAND_HASH_H
+#define COMMAND_HASH_H
+
+#include <stdint.h>
+
+#define COMMAND_HASH_COMMAND_NUM {len(names)}
+#define COMMAND_HASH_BUCKET_NUM {len(displace)}
+#define COMMAND_HASH_SLOT_NUM {slot_num}
+#define COMMAND_HASH_SLOT_EMPTY 0x{SLOT_EMPTY:X}
+
+static const uint16_t command_hash_displace[COMMAND_HASH_BUCKET_NUM] = {{
+{array(displace)}
+}};
+
+static const uint16_t command_hash_slot[COMMAND_HASH_SLOT_NUM] = {{
+{array(slots)}
+}};
+
+#endif // COMMAND_HASH_H
+"""
+    with open(sys.argv[2], "w", encoding="utf-8") as f:
+        f.write(out)
+
+
+if __name__ == "__main__":
+    main()
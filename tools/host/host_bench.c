@@ -0,0 +1,1092 @@
+// ホストでのベンチマーク(src/utilsと、usb_comm/dbg_printの送信側)
+// 実機に書き込まずに処理時間を測り、結果をJSONで標準出力に出す
+// (結果を保存しておき、回帰の確認に使う)
+//
+// 使い方:
+//   ./host_bench [1ケースあたりの測定時間[ms](デフォルト200)]
+//   例) ./host_bench > bench.json
+//
+// 結果: {"benchmarks": [{"group", "name", "ops", "ns_per_op", "mb_per_s"}]}
+//  - ops      : 測定した操作の回数
+//  - ns_per_op: 1操作あたりの時間[ns]
+//  - mb_per_s : 1操作で扱うバイト数から求めたスループット[MB/s]
+//               (バイト数で測らないケースはnull)
+// 測定値: {"group", "name", "value", "unit"}
+//  - 時間あたりの回数で表せない値(1転送あたりのバイト数、滞留時間等)
+// 2つの実装の比較: {"group", "name", "ratio"}
+//  - ratio    : 基準の実装のns_per_op / 新しい実装のns_per_op
+//               (1より大きければ新しい実装が速い)
+// 時間はホストのCPUでの値であり、実機(RP2350)の値ではない。比較に使うこと
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "command.h"
+#include "command_hash.h" // ベンチマーク用の表(CMakeLists.txtで生成する)
+#include "dbg_print.h"
+#include "fmt.h"
+#include "frame.h"
+#include "host_rtos.h"
+#include "line_framer.h"
+#include "log_ring.h"
+#include "ring_buffer.h"
+#include "rtos_wrapper.h"
+#include "static_task.h"
+#include "usb_comm.h"
+
+#define BENCH_DURATION_MS_DEFAULT 200
+#define BENCH_RING_SIZE 1024
+#define BENCH_CONTENTION_BYTES (4 * 1024 * 1024)
+#define BENCH_CONTENTION_CHUNK 64
+#define BENCH_CONTENTION_PRODUCER_MAX 4
+#define BENCH_LOG_RING_SIZE 4096
+#define BENCH_LINE_STREAM_SIZE 4096
+#define BENCH_LINE_CHUNK 64 // 1回のFeedで渡す長さ(USBの1パケット)
+#define BENCH_COALESCE_LINES_MIN 100
+// USB Full Speedのバルク転送の実効速度(約1MB/s)
+#define BENCH_LANE_LINK_NS_PER_BYTE 1000
+#define BENCH_LANE_NORMAL_LINE 64
+#define BENCH_LANE_BULK_CHUNK 128
+#define BENCH_LANE_HIGH_LINES_MIN 10
+
+// 1回の呼び出しでn回の操作を行う測定対象
+typedef void (*benchFunc_t)(void *ctx, uint64_t n);
+
+static uint64_t s_benchDurationNs;
+static bool s_benchFirst = true;
+
+// 最適化で測定対象の処理が消えないよう、結果をここに書き込む
+static volatile uint32_t s_benchSink;
+
+/****************************************************
+ * common
+ ****************************************************/
+
+static uint64_t benchNowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 1件の結果を出力する。bytesPerOpが0の場合はmb_per_sをnullにする
+static void benchReport(const char *group, const char *name, uint64_t ops,
+                        uint64_t ns, size_t bytesPerOp)
+{
+    printf("%s\n    {\"group\": \"%s\", \"name\": \"%s\", \"ops\": %llu, "
+           "\"ns_per_op\": %.2f, \"mb_per_s\": ",
+           s_benchFirst ? "" : ",", group, name, (unsigned long long)ops,
+           (double)ns / ops);
+    if (bytesPerOp > 0)
+    {
+        printf("%.1f}", (double)ops * bytesPerOp * 1000.0 / ns);
+    }
+    else
+    {
+        printf("null}");
+    }
+    s_benchFirst = false;
+    fflush(stdout);
+}
+
+// 比較の結果を出力する
+static void benchReportRatio(const char *group, const char *name,
+                             double ratio)
+{
+    printf("%s\n    {\"group\": \"%s\", \"name\": \"%s\", \"ratio\": %.3f}",
+           s_benchFirst ? "" : ",", group, name, ratio);
+    s_benchFirst = false;
+    fflush(stdout);
+}
+
+// 測定値を出力する
+static void benchReportValue(const char *group, const char *name,
+                             double value, const char *unit)
+{
+    printf("%s\n    {\"group\": \"%s\", \"name\": \"%s\", \"value\": %.1f, "
+           "\"unit\": \"%s\"}",
+           s_benchFirst ? "" : ",", group, name, value, unit);
+    s_benchFirst = false;
+    fflush(stdout);
+}
+
+// 測定時間に達するまで、回数を倍にしながらfuncを呼ぶ
+// 戻り値は1操作あたりの時間[ns]
+static double benchRun(const char *group, const char *name, benchFunc_t func,
+                       void *ctx, size_t bytesPerOp)
+{
+    uint64_t ops = 0;
+    uint64_t n = 1;
+    uint64_t start = benchNowNs();
+    uint64_t elapsed = 0;
+    while (elapsed < s_benchDurationNs)
+    {
+        func(ctx, n);
+        ops += n;
+        n *= 2;
+        elapsed = benchNowNs() - start;
+    }
+    benchReport(group, name, ops, elapsed, bytesPerOp);
+    return (double)elapsed / ops;
+}
+
+/****************************************************
+ * ring_buffer
+ ****************************************************/
+
+typedef struct
+{
+    ringBuffer_t *rb;
+    size_t chunk;
+} benchRingCtx_t;
+
+static uint8_t s_benchRingData[BENCH_RING_SIZE];
+static uint8_t s_benchRingOut[BENCH_RING_SIZE];
+
+// 1操作 = chunkバイトのEnqueueとDequeue
+static void benchRingPair(void *ctx, uint64_t n)
+{
+    benchRingCtx_t *c = ctx;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        ringBufferEnqueue(c->rb, s_benchRingData, c->chunk);
+        s_benchSink += ringBufferDequeue(c->rb, s_benchRingOut, c->chunk);
+    }
+}
+
+// 1スレッドでのEnqueue/Dequeueのコスト
+// chunkがリングのサイズの約数でない場合、ほぼ毎回末尾で折り返す(wrap)
+static void benchRingBuffer(void)
+{
+    static const size_t chunks[] = {1, 16, 64, 512};
+    static const ringBufferMode_t modes[] = {RING_BUFFER_MODE_SPSC,
+                                             RING_BUFFER_MODE_MUTEX};
+    RING_BUFFER_DEFINE(rb, BENCH_RING_SIZE);
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        const char *mode = (modes[m] == RING_BUFFER_MODE_SPSC) ? "spsc"
+                                                               : "mutex";
+        RING_BUFFER_INIT(rb, modes[m]);
+        for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "%s/chunk=%zu", mode, chunks[i]);
+            benchRingCtx_t ctx = {&rb, chunks[i]};
+            ringBufferClear(&rb);
+            benchRun("ring_buffer", name, benchRingPair, &ctx, chunks[i]);
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "%s/wrap/chunk=1000", mode);
+        benchRingCtx_t ctx = {&rb, 1000};
+        ringBufferClear(&rb);
+        benchRun("ring_buffer", name, benchRingPair, &ctx, 1000);
+    }
+}
+
+// indexの折り返しの比較
+// ring_buffer.cのEnqueue/Dequeue(SPSC)と同じ処理で、折り返しだけを
+// 以前の% bufferSizeと現在の& maskで切り替える
+// bufferSizeは実行時の値のため、%は除算命令になる
+static inline __attribute__((always_inline)) size_t
+benchIndexWrap(const ringBuffer_t *rb, size_t index, bool modulo)
+{
+    return modulo ? index % rb->bufferSize : index & rb->mask;
+}
+
+static inline __attribute__((always_inline)) int32_t
+benchIndexEnqueue(ringBuffer_t *rb, const uint8_t *data, size_t len,
+                  bool modulo)
+{
+    size_t available = rb->bufferSize -
+                       atomic_load_explicit(&rb->count, memory_order_acquire);
+    size_t bytesToEnqueue = (len < available) ? len : available;
+    if (bytesToEnqueue == 0)
+    {
+        return E_WOULDBLOCK;
+    }
+    size_t firstChunkRemaining = rb->bufferSize - rb->head;
+    size_t firstChunkWriting = (bytesToEnqueue < firstChunkRemaining)
+                                   ? bytesToEnqueue
+                                   : firstChunkRemaining;
+    memcpy(&rb->buffer[rb->head], data, firstChunkWriting);
+    rb->head = benchIndexWrap(rb, rb->head + firstChunkWriting, modulo);
+    if (bytesToEnqueue > firstChunkWriting)
+    {
+        memcpy(&rb->buffer[rb->head], &data[firstChunkWriting],
+               bytesToEnqueue - firstChunkWriting);
+        rb->head = benchIndexWrap(
+            rb, rb->head + bytesToEnqueue - firstChunkWriting, modulo);
+    }
+    atomic_fetch_add_explicit(&rb->count, bytesToEnqueue,
+                              memory_order_release);
+    return bytesToEnqueue;
+}
+
+static inline __attribute__((always_inline)) int32_t
+benchIndexDequeue(ringBuffer_t *rb, uint8_t *data, size_t len, bool modulo)
+{
+    size_t count = atomic_load_explicit(&rb->count, memory_order_acquire);
+    size_t bytesToDequeue = (len < count) ? len : count;
+    if (bytesToDequeue == 0)
+    {
+        return E_WOULDBLOCK;
+    }
+    size_t firstChunkRemaining = rb->bufferSize - rb->tail;
+    size_t firstChunkReading = (bytesToDequeue < firstChunkRemaining)
+                                   ? bytesToDequeue
+                                   : firstChunkRemaining;
+    memcpy(data, &rb->buffer[rb->tail], firstChunkReading);
+    rb->tail = benchIndexWrap(rb, rb->tail + firstChunkReading, modulo);
+    if (bytesToDequeue > firstChunkReading)
+    {
+        memcpy(&data[firstChunkReading], &rb->buffer[rb->tail],
+               bytesToDequeue - firstChunkReading);
+        rb->tail = benchIndexWrap(
+            rb, rb->tail + bytesToDequeue - firstChunkReading, modulo);
+    }
+    atomic_fetch_sub_explicit(&rb->count, bytesToDequeue,
+                              memory_order_release);
+    return bytesToDequeue;
+}
+
+static void benchIndexPairMask(void *ctx, uint64_t n)
+{
+    benchRingCtx_t *c = ctx;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        benchIndexEnqueue(c->rb, s_benchRingData, c->chunk, false);
+        s_benchSink +=
+            benchIndexDequeue(c->rb, s_benchRingOut, c->chunk, false);
+    }
+}
+
+static void benchIndexPairModulo(void *ctx, uint64_t n)
+{
+    benchRingCtx_t *c = ctx;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        benchIndexEnqueue(c->rb, s_benchRingData, c->chunk, true);
+        s_benchSink +=
+            benchIndexDequeue(c->rb, s_benchRingOut, c->chunk, true);
+    }
+}
+
+// 1操作 = chunkバイトのEnqueueとDequeue。同じchunkで%と&を交互に測り、
+// 比(modulo/mask)を出す。バイトあたりの時間は1000 / mb_per_s [ns]
+static void benchRingIndex(void)
+{
+    static const size_t chunks[] = {1, 16, 64, 512, 1000};
+    RING_BUFFER_DEFINE(rb, BENCH_RING_SIZE);
+    RING_BUFFER_INIT(rb, RING_BUFFER_MODE_SPSC);
+
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    {
+        benchRingCtx_t ctx = {&rb, chunks[i]};
+        char name[64];
+
+        ringBufferClear(&rb);
+        snprintf(name, sizeof(name), "modulo/chunk=%zu", chunks[i]);
+        double modulo = benchRun("ring_buffer_index", name,
+                                 benchIndexPairModulo, &ctx, chunks[i]);
+
+        ringBufferClear(&rb);
+        snprintf(name, sizeof(name), "mask/chunk=%zu", chunks[i]);
+        double mask = benchRun("ring_buffer_index", name, benchIndexPairMask,
+                               &ctx, chunks[i]);
+
+        snprintf(name, sizeof(name), "modulo_over_mask/chunk=%zu", chunks[i]);
+        benchReportRatio("ring_buffer_index", name, modulo / mask);
+    }
+}
+
+// producerとconsumerを別スレッドで動かす(競合)
+typedef struct
+{
+    ringBuffer_t *rb;
+    size_t bytes; // このスレッドが送受信するバイト数
+} benchContentionCtx_t;
+
+static void *benchContentionProducer(void *arg)
+{
+    benchContentionCtx_t *c = arg;
+    size_t sent = 0;
+    while (sent < c->bytes)
+    {
+        int32_t ret = ringBufferEnqueue(c->rb, s_benchRingData,
+                                        BENCH_CONTENTION_CHUNK);
+        if (ret > 0)
+        {
+            sent += ret;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *benchContentionConsumer(void *arg)
+{
+    benchContentionCtx_t *c = arg;
+    uint8_t buf[BENCH_CONTENTION_CHUNK];
+    size_t received = 0;
+    while (received < c->bytes)
+    {
+        int32_t ret = ringBufferDequeue(c->rb, buf, sizeof(buf));
+        if (ret > 0)
+        {
+            received += ret;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// 1操作 = BENCH_CONTENTION_CHUNKバイトの受け渡し
+// SPSCはproducer 1つのみ。MUTEXはproducerの数を変えて競合を増やす
+static void benchRingContention(void)
+{
+    RING_BUFFER_DEFINE(rb, BENCH_RING_SIZE);
+    static const struct
+    {
+        ringBufferMode_t mode;
+        int producers;
+    } cases[] = {
+        {RING_BUFFER_MODE_SPSC, 1},
+        {RING_BUFFER_MODE_MUTEX, 1},
+        {RING_BUFFER_MODE_MUTEX, 2},
+        {RING_BUFFER_MODE_MUTEX, BENCH_CONTENTION_PRODUCER_MAX},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        RING_BUFFER_INIT(rb, cases[i].mode);
+        int producers = cases[i].producers;
+        benchContentionCtx_t consumer = {&rb, BENCH_CONTENTION_BYTES};
+        benchContentionCtx_t producer = {&rb,
+                                         BENCH_CONTENTION_BYTES / producers};
+        pthread_t threads[BENCH_CONTENTION_PRODUCER_MAX + 1];
+
+        uint64_t start = benchNowNs();
+        pthread_create(&threads[0], NULL, benchContentionConsumer, &consumer);
+        for (int p = 0; p < producers; p++)
+        {
+            pthread_create(&threads[p + 1], NULL, benchContentionProducer,
+                           &producer);
+        }
+        for (int p = 0; p <= producers; p++)
+        {
+            pthread_join(threads[p], NULL);
+        }
+        uint64_t elapsed = benchNowNs() - start;
+
+        char name[64];
+        snprintf(name, sizeof(name), "%s/%dp1c/chunk=%d",
+                 (cases[i].mode == RING_BUFFER_MODE_SPSC) ? "spsc" : "mutex",
+                 producers, BENCH_CONTENTION_CHUNK);
+        benchReport("ring_buffer_contention", name,
+                    BENCH_CONTENTION_BYTES / BENCH_CONTENTION_CHUNK, elapsed,
+                    BENCH_CONTENTION_CHUNK);
+    }
+}
+
+/****************************************************
+ * log_ring
+ ****************************************************/
+
+typedef struct
+{
+    logRing_t *lr;
+    size_t len;
+} benchLogRingCtx_t;
+
+// 1操作 = lenバイトのレコードのReserve/Commit/Peek/Release
+static void benchLogRingRecord(void *ctx, uint64_t n)
+{
+    benchLogRingCtx_t *c = ctx;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        uint8_t *record = logRingReserve(c->lr, c->len);
+        memcpy(record, s_benchRingData, c->len);
+        logRingCommit(c->lr, record, c->len);
+
+        const uint8_t *data;
+        size_t len;
+        if (logRingPeek(c->lr, &data, &len))
+        {
+            s_benchSink += data[0];
+            logRingRelease(c->lr);
+        }
+    }
+}
+
+static void benchLogRing(void)
+{
+    static const size_t lens[] = {16, 64, 240};
+    LOG_RING_DEFINE(lr, BENCH_LOG_RING_SIZE);
+    LOG_RING_INIT(lr);
+
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "record=%zu", lens[i]);
+        benchLogRingCtx_t ctx = {&lr, lens[i]};
+        benchRun("log_ring", name, benchLogRingRecord, &ctx, lens[i]);
+    }
+}
+
+/****************************************************
+ * fmt
+ ****************************************************/
+
+typedef struct
+{
+    bool libc; // trueならsnprintfで書式化する
+    int kind;
+} benchFmtCtx_t;
+
+// dbgPrintでよく使う書式
+static const char *const s_benchFmtNames[] = {"int", "log_line", "hex_width"};
+
+static void benchFmtCall(void *ctx, uint64_t n)
+{
+    benchFmtCtx_t *c = ctx;
+    char buf[128];
+    for (uint64_t i = 0; i < n; i++)
+    {
+        int32_t len = 0;
+        switch (c->kind)
+        {
+        case 0:
+            len = c->libc ? snprintf(buf, sizeof(buf), "%d", (int)i)
+                          : fmtFormat(buf, sizeof(buf), "%d", (int)i);
+            break;
+        case 1:
+            len = c->libc ? snprintf(buf, sizeof(buf),
+                                     "[%s][%06u] Task %d is running. %d\r\n",
+                                     "INFO ", (unsigned)i, 1, (int)i)
+                          : fmtFormat(buf, sizeof(buf),
+                                      "[%s][%06u] Task %d is running. %d\r\n",
+                                      "INFO ", (unsigned)i, 1, (int)i);
+            break;
+        default:
+            len = c->libc ? snprintf(buf, sizeof(buf), "%08x %-10s %5d",
+                                     (unsigned)i, "usb", -(int)(i & 0xFFF))
+                          : fmtFormat(buf, sizeof(buf), "%08x %-10s %5d",
+                                      (unsigned)i, "usb", -(int)(i & 0xFFF));
+            break;
+        }
+        s_benchSink += len;
+    }
+}
+
+static void benchFmt(void)
+{
+    for (int kind = 0; kind < 3; kind++)
+    {
+        for (int libc = 0; libc <= 1; libc++)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "%s/%s",
+                     libc ? "snprintf" : "fmtFormat", s_benchFmtNames[kind]);
+            benchFmtCtx_t ctx = {libc, kind};
+            benchRun("fmt", name, benchFmtCall, &ctx, 0);
+        }
+    }
+}
+
+/****************************************************
+ * frame
+ ****************************************************/
+
+typedef struct
+{
+    size_t payloadLen;
+    uint8_t encoded[FRAME_ENCODED_MAX(USB_FRAME_PAYLOAD_MAX)];
+    size_t encodedLen;
+} benchFrameCtx_t;
+
+static void benchFrameEncode(void *ctx, uint64_t n)
+{
+    benchFrameCtx_t *c = ctx;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        s_benchSink += frameEncode(USB_CHANNEL_TELEMETRY, (uint8_t)i,
+                                   s_benchRingData, c->payloadLen, c->encoded,
+                                   sizeof(c->encoded));
+    }
+}
+
+// 1操作 = エンコード済みの1フレームのデコード(CRCの確認を含む)
+static void benchFrameDecode(void *ctx, uint64_t n)
+{
+    benchFrameCtx_t *c = ctx;
+    uint8_t buffer[FRAME_ENCODED_MAX(USB_FRAME_PAYLOAD_MAX)];
+    frameDecoder_t dec;
+    frameDecoderInit(&dec, buffer, sizeof(buffer));
+    for (uint64_t i = 0; i < n; i++)
+    {
+        size_t pos = 0;
+        while (pos < c->encodedLen)
+        {
+            frame_t frame;
+            frameStatus_t status;
+            pos += frameDecoderFeed(&dec, &c->encoded[pos],
+                                    c->encodedLen - pos, &frame, &status);
+            if (status == FRAME_STATUS_ERROR)
+            {
+                fprintf(stderr, "host_bench: frame decode error\n");
+                exit(1);
+            }
+            s_benchSink += status;
+        }
+    }
+}
+
+// payloadのサイズごとのエンコード/デコードの時間とオーバーヘッド
+// nameのwireは区切りを含めたエンコード後のバイト数
+// mb_per_sはpayloadのバイト数で求める(オーバーヘッドを含まない実効値)
+static void benchFrame(void)
+{
+    static const size_t payloads[] = {1, 8, 64, USB_FRAME_PAYLOAD_MAX};
+    for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++)
+    {
+        benchFrameCtx_t ctx = {.payloadLen = payloads[i]};
+        ctx.encodedLen = frameEncode(USB_CHANNEL_TELEMETRY, 0, s_benchRingData,
+                                     ctx.payloadLen, ctx.encoded,
+                                     sizeof(ctx.encoded));
+
+        char name[64];
+        snprintf(name, sizeof(name), "encode/payload=%zu/wire=%zu",
+                 ctx.payloadLen, ctx.encodedLen);
+        benchRun("frame", name, benchFrameEncode, &ctx, ctx.payloadLen);
+        snprintf(name, sizeof(name), "decode/payload=%zu/wire=%zu",
+                 ctx.payloadLen, ctx.encodedLen);
+        benchRun("frame", name, benchFrameDecode, &ctx, ctx.payloadLen);
+    }
+}
+
+/****************************************************
+ * line_framer
+ ****************************************************/
+
+// 一定の長さごとに"\r\n"を置いたテキスト
+static uint8_t s_benchLineStream[BENCH_LINE_STREAM_SIZE];
+
+// 1操作 = s_benchLineStream全体をBENCH_LINE_CHUNKバイトずつFeedする
+static void benchLineFramerFeed(void *ctx, uint64_t n)
+{
+    char buffer[64];
+    lineFramer_t lf;
+    lineFramerInit(&lf, buffer, sizeof(buffer), LINE_OVERFLOW_DISCARD);
+    for (uint64_t i = 0; i < n; i++)
+    {
+        for (size_t off = 0; off < sizeof(s_benchLineStream);
+             off += BENCH_LINE_CHUNK)
+        {
+            const uint8_t *chunk = &s_benchLineStream[off];
+            size_t pos = 0;
+            while (pos < BENCH_LINE_CHUNK)
+            {
+                line_t line;
+                lineStatus_t status;
+                pos += lineFramerFeed(&lf, &chunk[pos],
+                                      BENCH_LINE_CHUNK - pos, &line, &status);
+                s_benchSink += (status == LINE_STATUS_OK) ? line.len : 0;
+            }
+        }
+    }
+}
+
+// 比較用: line_framer導入前のtask2と同じ、1バイトずつ判定してコピーする処理
+static void benchLineByteLoop(void *ctx, uint64_t n)
+{
+    uint8_t command_buf[64] = {0};
+    uint8_t *pbuf = command_buf;
+    size_t len = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        for (size_t off = 0; off < sizeof(s_benchLineStream);
+             off += BENCH_LINE_CHUNK)
+        {
+            const uint8_t *chunk = &s_benchLineStream[off];
+            for (int j = 0; j < BENCH_LINE_CHUNK; j++)
+            {
+                if (chunk[j] == '\r')
+                {
+                    continue;
+                }
+                if (chunk[j] == '\n' || len > sizeof(command_buf) - 1)
+                {
+                    s_benchSink += len;
+                    memset(command_buf, 0, sizeof(command_buf));
+                    len = 0;
+                    pbuf = command_buf;
+                    continue;
+                }
+                memcpy(pbuf, &chunk[j], 1);
+                pbuf++;
+                len++;
+            }
+        }
+    }
+}
+
+// 行の長さ("\r\n"を含む)ごとに、line_framerと1バイトずつの処理を比べる
+static void benchLineFramer(void)
+{
+    static const size_t lineLens[] = {8, 32, 60};
+    for (size_t l = 0; l < sizeof(lineLens) / sizeof(lineLens[0]); l++)
+    {
+        size_t lineLen = lineLens[l];
+        for (size_t i = 0; i < sizeof(s_benchLineStream); i++)
+        {
+            size_t col = i % lineLen;
+            s_benchLineStream[i] = (col == lineLen - 1)   ? '\n'
+                                   : (col == lineLen - 2) ? '\r'
+                                                          : 'a' + col % 26;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "lineFramerFeed/line=%zu/chunk=%d",
+                 lineLen, BENCH_LINE_CHUNK);
+        benchRun("line_framer", name, benchLineFramerFeed, NULL,
+                 sizeof(s_benchLineStream));
+        snprintf(name, sizeof(name), "byte_loop/line=%zu/chunk=%d", lineLen,
+                 BENCH_LINE_CHUNK);
+        benchRun("line_framer", name, benchLineByteLoop, NULL,
+                 sizeof(s_benchLineStream));
+    }
+}
+
+/****************************************************
+ * command
+ ****************************************************/
+
+// ベンチマーク用のコマンド(引数の数を返すだけ)
+int32_t cmdBench(int argc, char **argv)
+{
+    return argc;
+}
+
+// 表のコマンド名(command_list.hの順)
+#define COMMAND(name, handler, help) name,
+static const char *const s_benchCommandNames[] = {
+#include "command_list.h"
+};
+#undef COMMAND
+#define BENCH_COMMAND_TABLE_NUM                                                \
+    (sizeof(s_benchCommandNames) / sizeof(s_benchCommandNames[0]))
+_Static_assert(BENCH_COMMAND_TABLE_NUM == COMMAND_HASH_COMMAND_NUM,
+               "bench command list and hash differ");
+
+typedef struct
+{
+    const char *names[BENCH_COMMAND_TABLE_NUM];
+    size_t lens[BENCH_COMMAND_TABLE_NUM];
+} benchCommandCtx_t;
+
+// 1操作 = 1回の検索。表の全ての名前を順に引く
+static void benchCommandLookup(void *ctx, uint64_t n)
+{
+    benchCommandCtx_t *c = ctx;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        size_t k = i % BENCH_COMMAND_TABLE_NUM;
+        s_benchSink += (commandLookup(c->names[k], c->lens[k]) != NULL);
+    }
+}
+
+// 比較用: 表を先頭からstrcmpで探す
+static void benchCommandStrcmpChain(void *ctx, uint64_t n)
+{
+    benchCommandCtx_t *c = ctx;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        const char *name = c->names[i % BENCH_COMMAND_TABLE_NUM];
+        for (size_t k = 0; k < BENCH_COMMAND_TABLE_NUM; k++)
+        {
+            if (strcmp(s_benchCommandNames[k], name) == 0)
+            {
+                s_benchSink += k;
+                break;
+            }
+        }
+    }
+}
+
+// 1操作 = 1行の分割、検索、ハンドラの呼び出し
+static void benchCommandExecute(void *ctx, uint64_t n)
+{
+    static const char line[] = "bench100 arg1 arg2 arg3";
+    char buf[sizeof(line)];
+    for (uint64_t i = 0; i < n; i++)
+    {
+        memcpy(buf, line, sizeof(line));
+        s_benchSink += commandExecute(buf);
+    }
+}
+
+// 登録済み(hit)/未登録(miss)の名前の検索と、コマンド実行全体の時間
+static void benchCommand(void)
+{
+    static char missNames[BENCH_COMMAND_TABLE_NUM][16];
+    benchCommandCtx_t hit;
+    benchCommandCtx_t miss;
+    for (size_t k = 0; k < BENCH_COMMAND_TABLE_NUM; k++)
+    {
+        hit.names[k] = s_benchCommandNames[k];
+        hit.lens[k] = strlen(s_benchCommandNames[k]);
+        snprintf(missNames[k], sizeof(missNames[k]), "unknown%zu", k);
+        miss.names[k] = missNames[k];
+        miss.lens[k] = strlen(missNames[k]);
+    }
+    // firmware_hostの表(実際のコマンドのみ)とリンクしていないことを確認する
+    if (commandLookup("bench100", 8) == NULL)
+    {
+        fprintf(stderr, "host_bench: bench command table is not linked\n");
+        exit(1);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "commandLookup/hit/commands=%zu",
+             BENCH_COMMAND_TABLE_NUM);
+    benchRun("command", name, benchCommandLookup, &hit, 0);
+    snprintf(name, sizeof(name), "commandLookup/miss/commands=%zu",
+             BENCH_COMMAND_TABLE_NUM);
+    benchRun("command", name, benchCommandLookup, &miss, 0);
+    snprintf(name, sizeof(name), "strcmp_chain/hit/commands=%zu",
+             BENCH_COMMAND_TABLE_NUM);
+    benchRun("command", name, benchCommandStrcmpChain, &hit, 0);
+    snprintf(name, sizeof(name), "commandExecute/commands=%zu",
+             BENCH_COMMAND_TABLE_NUM);
+    benchRun("command", name, benchCommandExecute, NULL, 0);
+}
+
+/****************************************************
+ * usb_comm / dbg_print (送信側)
+ ****************************************************/
+
+// 0以外の場合、送信経路はUSBの帯域を模擬し、1バイトあたりこの時間だけ
+// 送信に時間がかかる(経路が空くまでwrite()が戻らない)
+static atomic_uint s_benchLinkNsPerByte;
+static uint64_t s_benchLinkFreeNs; // 経路が空く時刻(usbFlush_taskのみ使用)
+
+// 送信したデータを捨てる経路(usbFlush_taskの送信コストを除くため)
+static bool benchNullOpen(void)
+{
+    return true;
+}
+
+static void benchNullWrite(const uint8_t *data, size_t len)
+{
+    uint32_t nsPerByte =
+        atomic_load_explicit(&s_benchLinkNsPerByte, memory_order_relaxed);
+    if (nsPerByte == 0)
+    {
+        return;
+    }
+    uint64_t now = benchNowNs();
+    uint64_t start = (s_benchLinkFreeNs > now) ? s_benchLinkFreeNs : now;
+    s_benchLinkFreeNs = start + (uint64_t)len * nsPerByte;
+    struct timespec ts = {s_benchLinkFreeNs / 1000000000,
+                          s_benchLinkFreeNs % 1000000000};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static int32_t benchNullRead(uint8_t *buf, size_t len)
+{
+    return 0;
+}
+
+static void benchNullSetRxCallback(void (*callback)(void *), void *params)
+{
+}
+
+static const usbTransport_t s_benchNullTransport = {
+    .name = "null",
+    .open = benchNullOpen,
+    .write = benchNullWrite,
+    .read = benchNullRead,
+    .setRxCallback = benchNullSetRxCallback,
+    .rxCallbackFromIsr = false,
+};
+
+static void benchUsbTx(void *ctx, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        usbTx((const char *)s_benchRingData, 64);
+    }
+}
+
+static void benchUsbTxFrame(void *ctx, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        usbTxFrame(USB_CHANNEL_TELEMETRY, s_benchRingData, 64);
+    }
+}
+
+static void benchDbgPrint(void *ctx, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_INFO, "Task %d is running. %d\r\n",
+                  1, (int)i);
+    }
+}
+
+static void benchDbgPrintDeferred(void *ctx, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        DBG_PRINT_DEFERRED(DBG_MODULE_APP, DBG_LEVEL_INFO,
+                           "Task %d is running. %d\r\n", 1, (int)i);
+    }
+}
+
+// 送信が止まる(前のケースの出力を送り終える)まで待つ
+static void benchUsbIdle(void)
+{
+    usbTxFlushStats_t prev;
+    usbTxFlushStats_t now;
+    usbTxGetFlushStats(&now);
+    do
+    {
+        prev = now;
+        rtos_task_delay(20);
+        usbTxGetFlushStats(&now);
+    } while (now.bytes != prev.bytes);
+}
+
+static void benchBusyWaitNs(uint64_t ns)
+{
+    uint64_t end = benchNowNs() + ns;
+    while (benchNowNs() < end)
+    {
+    }
+}
+
+// 集約(usbTxSetCoalesce)の有無で、1転送あたりのバイト数とスループットを比べる
+// 1操作 = 32バイトの1行のusbTx。gapUsの間隔で行を出す
+// (実際のログのように、行が少しずつ出る場合に集約の効果が出る)
+// スループットは最初のusbTxから全ての行を送り終えるまでの時間で求める
+static void benchUsbCoalesce(void)
+{
+    static const struct
+    {
+        const char *name;
+        size_t bytes;
+        uint32_t us;
+    } settings[] = {
+        {"off", 0, 0},
+        {"default", USB_TX_COALESCE_BYTES_DEFAULT, USB_TX_COALESCE_US_DEFAULT},
+    };
+    static const uint32_t gapsUs[] = {0, 20, 100};
+    static const char line[] = "[INFO ][000000] coalesce bench.\r\n";
+    const size_t lineLen = sizeof(line) - 1;
+
+    for (size_t g = 0; g < sizeof(gapsUs) / sizeof(gapsUs[0]); g++)
+    {
+        // 行の間隔に関わらず、おおよそ測定時間で終わる行数にする
+        uint64_t lines = s_benchDurationNs / (gapsUs[g] * 1000 + 2000);
+        lines = (lines < BENCH_COALESCE_LINES_MIN) ? BENCH_COALESCE_LINES_MIN
+                                                   : lines;
+        for (size_t c = 0; c < sizeof(settings) / sizeof(settings[0]); c++)
+        {
+            benchUsbIdle();
+            usbTxSetCoalesce(settings[c].bytes, settings[c].us);
+            usbTxFlushStats_t before;
+            usbTxFlushStats_t after;
+            usbTxGetFlushStats(&before);
+
+            uint64_t start = benchNowNs();
+            for (uint64_t i = 0; i < lines; i++)
+            {
+                usbTx(line, lineLen);
+                benchBusyWaitNs(gapsUs[g] * 1000);
+            }
+            uint64_t expected = lines * lineLen;
+            do
+            {
+                sched_yield();
+                usbTxGetFlushStats(&after);
+            } while ((uint32_t)(after.bytes - before.bytes) < expected);
+            uint64_t elapsed = benchNowNs() - start;
+
+            char name[64];
+            snprintf(name, sizeof(name), "coalesce=%s/gap_us=%u",
+                     settings[c].name, gapsUs[g]);
+            benchReport("usb_tx_coalesce", name, lines, elapsed, lineLen);
+            snprintf(name, sizeof(name),
+                     "coalesce=%s/gap_us=%u/bytes_per_transfer",
+                     settings[c].name, gapsUs[g]);
+            uint32_t transfers = after.transfers - before.transfers;
+            benchReportValue("usb_tx_coalesce", name,
+                             (double)(after.bytes - before.bytes) /
+                                 (transfers ? transfers : 1),
+                             "bytes");
+        }
+    }
+    usbTxSetCoalesce(USB_TX_COALESCE_BYTES_DEFAULT,
+                     USB_TX_COALESCE_US_DEFAULT);
+}
+
+// NORMAL/BULKを送り続けるproducer
+typedef struct
+{
+    atomic_bool stop;
+    bool bulk; // trueならusbBufferEnqueue、falseならusbTx
+} benchLaneFloodCtx_t;
+
+static void *benchLaneFlood(void *arg)
+{
+    benchLaneFloodCtx_t *c = arg;
+    while (!atomic_load_explicit(&c->stop, memory_order_relaxed))
+    {
+        if (c->bulk)
+        {
+            // 空きがなければ少し待つ(BULKは空き待ちをしない)
+            if (usbBufferEnqueue((const char *)s_benchRingData,
+                                 BENCH_LANE_BULK_CHUNK) <= 0)
+            {
+                rtos_task_delay(1);
+            }
+        }
+        else
+        {
+            usbTx((const char *)s_benchRingData, BENCH_LANE_NORMAL_LINE);
+        }
+    }
+    return NULL;
+}
+
+// 送信経路が飽和している間のレーンごとの滞留時間
+// 帯域を制限した経路(BENCH_LANE_LINK_NS_PER_BYTE)にNORMALとBULKを送り続け、
+// 1msごとにERRORレベルのログ(HIGHレーン)を出す
+// HIGHの滞留はNORMAL/BULKのbudget 1巡分の送信時間程度に収まるはず
+static void benchUsbLanes(void)
+{
+    static const char *const laneNames[USB_TX_LANE_MAX] = {"high", "normal",
+                                                           "bulk"};
+    benchUsbIdle();
+    atomic_store(&s_benchLinkNsPerByte, BENCH_LANE_LINK_NS_PER_BYTE);
+
+    benchLaneFloodCtx_t flood[2] = {{.bulk = false}, {.bulk = true}};
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++)
+    {
+        atomic_init(&flood[i].stop, false);
+        pthread_create(&threads[i], NULL, benchLaneFlood, &flood[i]);
+    }
+
+    // 送信バッファが埋まってから計測を始める
+    rtos_task_delay(20);
+    usbTxResetLaneLatency();
+    uint64_t lines = s_benchDurationNs / 1000000;
+    lines = (lines < BENCH_LANE_HIGH_LINES_MIN) ? BENCH_LANE_HIGH_LINES_MIN
+                                                : lines;
+    for (uint64_t i = 0; i < lines; i++)
+    {
+        DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_ERROR, "lane bench %u\r\n",
+                  (unsigned)i);
+        rtos_task_delay(1);
+    }
+
+    usbTxLaneLatency_t latency[USB_TX_LANE_MAX];
+    for (int l = 0; l < USB_TX_LANE_MAX; l++)
+    {
+        usbTxGetLaneLatency((usbTxLane_t)l, &latency[l]);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        atomic_store(&flood[i].stop, true);
+        pthread_join(threads[i], NULL);
+    }
+    benchUsbIdle();
+    atomic_store(&s_benchLinkNsPerByte, 0);
+
+    for (int l = 0; l < USB_TX_LANE_MAX; l++)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "saturated/%s/max", laneNames[l]);
+        benchReportValue("usb_tx_lane", name, latency[l].maxUs, "us");
+        snprintf(name, sizeof(name), "saturated/%s/avg", laneNames[l]);
+        benchReportValue("usb_tx_lane", name,
+                         (double)latency[l].totalUs /
+                             (latency[l].count ? latency[l].count : 1),
+                         "us");
+    }
+}
+
+// 呼び出し側のコスト(書式化、送信リングへの格納、送信待ち)を測る
+// 送信はusbFlush_taskが行い、データはbenchNullWriteで捨てる
+// DBG_PRINT_DEFERREDはトークンのリングがいっぱいの間は待たずに破棄するため、
+// 書式化が追いつかない分は破棄のコストになる(実機と同じ動作)
+static void benchUsb(void)
+{
+    if (usbCommSetTransport(&s_benchNullTransport) != E_SUCCESS ||
+        !usbCommInit() || !init_dbgPrint() ||
+        rtos_task_create(usbFlush_task, "usbFlush", 512, NULL,
+                         RTOS_PRIORITY_NORMAL, RTOS_CORE_ANY,
+                         NULL) != RTOS_OK ||
+        rtos_task_create(dbgFormat_task, "dbgFormat", 256, NULL,
+                         RTOS_PRIORITY_LOW, RTOS_CORE_ANY, NULL) != RTOS_OK)
+    {
+        fprintf(stderr, "host_bench: usb_comm init failed\n");
+        exit(1);
+    }
+    hostRtosStart();
+
+    benchRun("usb_tx", "usbTx/64", benchUsbTx, NULL, 64);
+    benchRun("usb_tx", "usbTxFrame/64", benchUsbTxFrame, NULL, 64);
+    benchRun("usb_tx", "DBG_PRINT/2args", benchDbgPrint, NULL, 0);
+    benchRun("usb_tx", "DBG_PRINT_DEFERRED/2args", benchDbgPrintDeferred,
+             NULL, 0);
+    benchUsbCoalesce();
+    benchUsbLanes();
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t durationMs = BENCH_DURATION_MS_DEFAULT;
+    if (argc > 1)
+    {
+        durationMs = strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 2 || durationMs == 0)
+    {
+        fprintf(stderr, "usage: %s [duration_ms]\n", argv[0]);
+        return 1;
+    }
+    s_benchDurationNs = durationMs * 1000000;
+
+    // 送信データ。0x00を含め、COBSの符号化が偏らない値にする
+    for (size_t i = 0; i < sizeof(s_benchRingData); i++)
+    {
+        s_benchRingData[i] = (uint8_t)(i * 31 + 7);
+    }
+
+    printf("{\"benchmarks\": [");
+    benchRingBuffer();
+    benchRingIndex();
+    benchRingContention();
+    benchLogRing();
+    benchFmt();
+    benchFrame();
+    benchLineFramer();
+    benchCommand();
+    benchUsb();
+    printf("\n]}\n");
+    return 0;
+}
@@ -0,0 +1,45 @@
+// ファームウェアをホスト(Linux)で動かす
+// systemInit()以降は実機と同じソースを使い、USB CDCの代わりに
+// usbCommSetTransport()でpty/ループバックの経路を使う
+//
+// 使い方:
+//   ./host_device [pty|loopback]
+//   pty(デフォルト): 表示されたslave側(/dev/pts/N)にscreenやtools/の
+//                    ツール(rpc_bench, usb_upload等)から接続する
+//   loopback: 送信したフレームをそのまま受信する(USBホストなしで動かす)
+#include <stdio.h>
+#include <string.h>
+
+#include "dbg_print.h"
+#include "rtos_wrapper.h"
+#include "system_init.h"
+#include "typedef.h"
+#include "usb_comm.h"
+
+int main(int argc, char **argv)
+{
+    const usbTransport_t *transport = &usbTransportPty;
+    if (argc > 1 && strcmp(argv[1], "loopback") == 0)
+    {
+        transport = &usbTransportLoopback;
+    }
+    else if (argc > 1 && strcmp(argv[1], "pty") != 0)
+    {
+        fprintf(stderr, "usage: %s [pty|loopback]\n", argv[0]);
+        return 1;
+    }
+
+    if (usbCommSetTransport(transport) != E_SUCCESS)
+    {
+        return 1;
+    }
+    if (!systemInit())
+    {
+        fprintf(stderr, "systemInit failed\n");
+        return 1;
+    }
+
+    DBG_PRINT(DBG_MODULE_SYSTEM, DBG_LEVEL_INFO, "Starting scheduler...\r\n");
+    rtos_schedule_start();
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef HOST_RTOS_H
+#define HOST_RTOS_H
+
+// ホストビルドのみのRTOS API(rtos_wrapper_host.c)
+// rtos_task_create()したタスクは、実機のvTaskStartScheduler()と同じく
+// スケジューラの開始まで動かない
+// rtos_schedule_start()は戻らないため、テストはこちらで開始してmainを続ける
+extern void hostRtosStart(void);
+
+#endif // HOST_RTOS_H
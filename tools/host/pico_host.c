@@ -0,0 +1,69 @@
+// ホストビルド用: pico-sdkの関数の代用(宣言はshim/pico/*.h)
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+
+#include "pico/cyw43_arch.h"
+#include "pico/stdlib.h"
+
+static uint64_t hostClockUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 起動からの経過時間にするため、最初の呼び出し時刻を基準にする
+uint64_t time_us_64(void)
+{
+    static uint64_t boot = 0;
+    if (boot == 0)
+    {
+        boot = hostClockUs();
+    }
+    return hostClockUs() - boot;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+absolute_time_t get_absolute_time(void)
+{
+    return time_us_64();
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t)
+{
+    return (uint32_t)(t / 1000);
+}
+
+bool stdio_init_all(void)
+{
+    return true;
+}
+
+// USB CDCはないため、デフォルトのstdio経路は開けない
+bool stdio_usb_init(void)
+{
+    return false;
+}
+
+void stdio_put_string(const char *s, int len, bool newline,
+                      bool cr_translation)
+{
+}
+
+int stdio_get_until(char *buf, int len, absolute_time_t until)
+{
+    return 0;
+}
+
+void stdio_set_chars_available_callback(void (*fn)(void *), void *param)
+{
+}
+
+int cyw43_arch_init(void)
+{
+    return 0;
+}
@@ -0,0 +1,553 @@
+// rtos_wrapper.hのホスト(pthread)実装
+// タスクは1スレッドずつ起動し、優先度は扱わない(OSのスケジューラに任せる)
+// コアの番号はアフィニティから決める(RTOS_CORE_1のみならコア1、他はコア0)
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host_rtos.h"
+#include "pico/time.h"
+#include "rtos_wrapper.h"
+
+struct hostTask
+{
+    pthread_t thread;
+    rtos_task_func_t func;
+    void *params;
+    rtos_core_mask_t affinity;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify; // タスク通知の値
+};
+
+struct hostMutex
+{
+    pthread_mutex_t lock;
+};
+
+struct hostFlag
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    rtos_bit_t bits;
+};
+
+struct hostQueue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t *storage;
+    size_t itemSize;
+    size_t length;
+    size_t head;
+    size_t count;
+};
+
+// スケジューラ開始までタスクを止めておく
+static pthread_mutex_t s_hostStartLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_hostStartCond = PTHREAD_COND_INITIALIZER;
+static bool s_hostStarted = false;
+
+static _Thread_local struct hostTask *s_hostCurrentTask = NULL;
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+static void hostCondInit(pthread_cond_t *cond);
+static bool hostDeadline(rtos_time_ms_t timeout_ms, struct timespec *ts);
+static int hostCondWait(pthread_cond_t *cond, pthread_mutex_t *lock,
+                        bool timed, const struct timespec *deadline);
+static struct hostTask *hostTaskAlloc(rtos_task_func_t func, void *params,
+                                      rtos_core_mask_t affinity);
+static void *hostTaskEntry(void *arg);
+
+/****************************************************
+ * common
+ ****************************************************/
+
+// 待ち時間の計測はCLOCK_MONOTONICで行う
+static void hostCondInit(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// timeout_msの期限をtsに返す。MAX_DELAY(無期限)の場合はfalse
+static bool hostDeadline(rtos_time_ms_t timeout_ms, struct timespec *ts)
+{
+    if (timeout_ms >= MAX_DELAY)
+    {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+    return true;
+}
+
+// 期限付きで待つ。期限を過ぎた場合はETIMEDOUT
+static int hostCondWait(pthread_cond_t *cond, pthread_mutex_t *lock,
+                        bool timed, const struct timespec *deadline)
+{
+    return timed ? pthread_cond_timedwait(cond, lock, deadline)
+                 : pthread_cond_wait(cond, lock);
+}
+
+/****************************************************
+ * Task Implementation
+ ****************************************************/
+
+static struct hostTask *hostTaskAlloc(rtos_task_func_t func, void *params,
+                                      rtos_core_mask_t affinity)
+{
+    struct hostTask *task = calloc(1, sizeof(*task));
+    if (task == NULL)
+    {
+        return NULL;
+    }
+    task->func = func;
+    task->params = params;
+    task->affinity = affinity;
+    pthread_mutex_init(&task->lock, NULL);
+    hostCondInit(&task->cond);
+    return task;
+}
+
+static void *hostTaskEntry(void *arg)
+{
+    struct hostTask *task = arg;
+    s_hostCurrentTask = task;
+
+    pthread_mutex_lock(&s_hostStartLock);
+    while (!s_hostStarted)
+    {
+        pthread_cond_wait(&s_hostStartCond, &s_hostStartLock);
+    }
+    pthread_mutex_unlock(&s_hostStartLock);
+
+    task->func(task->params);
+    return NULL;
+}
+
+rtos_result_t rtos_task_create(rtos_task_func_t func, const char *name,
+                               rtos_stack_size_t stack_size, void *params,
+                               rtos_priority_t priority,
+                               rtos_core_mask_t affinity,
+                               rtos_task_handle_t *handle)
+{
+    if (func == NULL || affinity == 0)
+    {
+        return RTOS_ERROR;
+    }
+
+    struct hostTask *task = hostTaskAlloc(func, params, affinity);
+    if (task == NULL)
+    {
+        return RTOS_ERROR;
+    }
+    if (handle != NULL)
+    {
+        *handle = task;
+    }
+    if (pthread_create(&task->thread, NULL, hostTaskEntry, task) != 0)
+    {
+        free(task);
+        return RTOS_ERROR;
+    }
+    pthread_detach(task->thread);
+    if (name != NULL)
+    {
+        char threadName[16];
+        strncpy(threadName, name, sizeof(threadName) - 1);
+        threadName[sizeof(threadName) - 1] = '\0';
+        pthread_setname_np(task->thread, threadName);
+    }
+    return RTOS_OK;
+}
+
+// スタックとTCBはホストでは使わない(スレッドのスタックを使う)
+rtos_result_t rtos_task_create_static(rtos_task_func_t func, const char *name,
+                                      rtos_stack_size_t stack_size,
+                                      void *params, rtos_priority_t priority,
+                                      rtos_core_mask_t affinity,
+                                      rtos_stack_t *stack_buf,
+                                      rtos_tcb_t *tcb_buf,
+                                      rtos_task_handle_t *handle)
+{
+    if (stack_buf == NULL || tcb_buf == NULL || handle == NULL)
+    {
+        return RTOS_ERROR;
+    }
+    return rtos_task_create(func, name, stack_size, params, priority,
+                            affinity, handle);
+}
+
+rtos_result_t rtos_task_set_affinity(rtos_task_handle_t handle,
+                                     rtos_core_mask_t affinity)
+{
+    if (handle == NULL || affinity == 0)
+    {
+        return RTOS_ERROR;
+    }
+    __atomic_store_n(&handle->affinity, affinity, __ATOMIC_RELAXED);
+    return RTOS_OK;
+}
+
+rtos_core_mask_t rtos_task_get_affinity(rtos_task_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        handle = rtos_task_get_current();
+    }
+    return __atomic_load_n(&handle->affinity, __ATOMIC_RELAXED);
+}
+
+uint32_t rtos_core_get_id(void)
+{
+    return (rtos_task_get_affinity(NULL) == RTOS_CORE_1) ? 1 : 0;
+}
+
+// 自タスクの削除のみ対応する
+void rtos_task_delete(rtos_task_handle_t handle)
+{
+    if (handle == NULL || handle == s_hostCurrentTask)
+    {
+        pthread_exit(NULL);
+    }
+}
+
+void rtos_task_delay(uint32_t delay_ms)
+{
+    struct timespec ts = {delay_ms / 1000, (delay_ms % 1000) * 1000000};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    {
+    }
+}
+
+// 作成済みのタスクを動かし、戻らない
+void rtos_schedule_start(void)
+{
+    hostRtosStart();
+    while (1)
+    {
+        pause();
+    }
+}
+
+void hostRtosStart(void)
+{
+    pthread_mutex_lock(&s_hostStartLock);
+    s_hostStarted = true;
+    pthread_cond_broadcast(&s_hostStartCond);
+    pthread_mutex_unlock(&s_hostStartLock);
+}
+
+// rtos_task_create()以外で作られたスレッド(main等)も1つのタスクとして扱う
+rtos_task_handle_t rtos_task_get_current(void)
+{
+    if (s_hostCurrentTask == NULL)
+    {
+        s_hostCurrentTask = hostTaskAlloc(NULL, NULL, RTOS_CORE_ANY);
+        if (s_hostCurrentTask != NULL)
+        {
+            s_hostCurrentTask->thread = pthread_self();
+        }
+    }
+    return s_hostCurrentTask;
+}
+
+void rtos_task_notify_give(rtos_task_handle_t handle)
+{
+    if (handle != NULL)
+    {
+        pthread_mutex_lock(&handle->lock);
+        handle->notify++;
+        pthread_cond_signal(&handle->cond);
+        pthread_mutex_unlock(&handle->lock);
+    }
+}
+
+// ホストには割り込みがないため、タスクからの通知と同じ
+void rtos_task_notify_give_from_isr(rtos_task_handle_t handle)
+{
+    rtos_task_notify_give(handle);
+}
+
+// ulTaskNotifyTake(pdTRUE, ...)と同じく、値を返して0にする
+uint32_t rtos_task_notify_take(rtos_time_ms_t timeout_ms)
+{
+    struct hostTask *task = rtos_task_get_current();
+    struct timespec deadline;
+    bool timed = hostDeadline(timeout_ms, &deadline);
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && timeout_ms > 0)
+    {
+        if (hostCondWait(&task->cond, &task->lock, timed, &deadline) ==
+            ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    uint32_t value = task->notify;
+    task->notify = 0;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+rtos_time_ms_t rtos_time_get_ms(void)
+{
+    return time_us_64() / 1000;
+}
+
+/****************************************************
+ * Mutex Implementation
+ ****************************************************/
+
+rtos_mutex_t rtos_mutex_create(void)
+{
+    struct hostMutex *mutex = calloc(1, sizeof(*mutex));
+    if (mutex != NULL)
+    {
+        pthread_mutex_init(&mutex->lock, NULL);
+    }
+    return mutex;
+}
+
+// 静的確保の版もヒープから確保する(ホストでは区別しない)
+rtos_mutex_t rtos_mutex_create_static(rtos_static_mutex_buf_t *buffer)
+{
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+    return rtos_mutex_create();
+}
+
+rtos_result_t rtos_mutex_take(rtos_mutex_t mutex)
+{
+    if (mutex == NULL)
+    {
+        return RTOS_ERROR;
+    }
+    return (pthread_mutex_lock(&mutex->lock) == 0) ? RTOS_OK : RTOS_ERROR;
+}
+
+rtos_result_t rtos_mutex_give(rtos_mutex_t mutex)
+{
+    if (mutex == NULL)
+    {
+        return RTOS_ERROR;
+    }
+    return (pthread_mutex_unlock(&mutex->lock) == 0) ? RTOS_OK : RTOS_ERROR;
+}
+
+void rtos_mutex_delete(rtos_mutex_t mutex)
+{
+    if (mutex != NULL)
+    {
+        pthread_mutex_destroy(&mutex->lock);
+        free(mutex);
+    }
+}
+
+/****************************************************
+ * Event flag Implementation
+ ****************************************************/
+
+rtos_flag_t rtos_flag_create(void)
+{
+    struct hostFlag *flag = calloc(1, sizeof(*flag));
+    if (flag != NULL)
+    {
+        pthread_mutex_init(&flag->lock, NULL);
+        hostCondInit(&flag->cond);
+    }
+    return flag;
+}
+
+rtos_flag_t rtos_flag_create_static(rtos_static_flag_buf_t *buf)
+{
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+    return rtos_flag_create();
+}
+
+rtos_bit_t rtos_flag_set(rtos_flag_t flag, rtos_bit_t setBit)
+{
+    pthread_mutex_lock(&flag->lock);
+    flag->bits |= setBit;
+    rtos_bit_t bits = flag->bits;
+    pthread_cond_broadcast(&flag->cond);
+    pthread_mutex_unlock(&flag->lock);
+    return bits;
+}
+
+// ホストには割り込みがないため、タスクからのセットと同じ
+rtos_result_t rtos_flag_set_from_isr(rtos_flag_t flag, rtos_bit_t setBit)
+{
+    rtos_flag_set(flag, setBit);
+    return RTOS_OK;
+}
+
+// xEventGroupWaitBits()と同じく、条件成立時(またはタイムアウト時)の値を返す
+rtos_bit_t rtos_flag_wait(rtos_flag_t flag, rtos_bit_t waitBit,
+                          rtos_base_t clearOnExit, rtos_base_t waitAllBits,
+                          rtos_time_ms_t timeout_ms)
+{
+    struct timespec deadline;
+    bool timed = hostDeadline(timeout_ms, &deadline);
+
+    pthread_mutex_lock(&flag->lock);
+    while (1)
+    {
+        rtos_bit_t hit = flag->bits & waitBit;
+        bool satisfied = waitAllBits ? (hit == waitBit) : (hit != 0);
+        if (satisfied)
+        {
+            rtos_bit_t bits = flag->bits;
+            if (clearOnExit)
+            {
+                flag->bits &= ~waitBit;
+            }
+            pthread_mutex_unlock(&flag->lock);
+            return bits;
+        }
+        if (timeout_ms == 0 ||
+            hostCondWait(&flag->cond, &flag->lock, timed, &deadline) ==
+                ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    rtos_bit_t bits = flag->bits;
+    pthread_mutex_unlock(&flag->lock);
+    return bits;
+}
+
+/****************************************************
+ * Queue Implementation
+ ****************************************************/
+
+rtos_queue_t rtos_queue_create(rtos_queue_size_t item_count,
+                               rtos_queue_size_t item_size)
+{
+    if (item_count == 0 || item_size == 0)
+    {
+        return NULL;
+    }
+    struct hostQueue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->storage = calloc(item_count, item_size);
+    if (queue->storage == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->itemSize = item_size;
+    queue->length = item_count;
+    pthread_mutex_init(&queue->lock, NULL);
+    hostCondInit(&queue->cond);
+    return queue;
+}
+
+rtos_queue_t rtos_queue_create_static(rtos_queue_size_t item_count,
+                                      rtos_queue_size_t item_size,
+                                      uint8_t *queueStrage,
+                                      rtos_static_queue_buf_t *buffer)
+{
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+    return rtos_queue_create(item_count, item_size);
+}
+
+rtos_result_t rtos_queue_send(rtos_queue_t queue, const void *item,
+                              rtos_time_ms_t timeout_ms)
+{
+    if (queue == NULL || item == NULL)
+    {
+        return RTOS_ERROR;
+    }
+
+    struct timespec deadline;
+    bool timed = hostDeadline(timeout_ms, &deadline);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length)
+    {
+        if (timeout_ms == 0 ||
+            hostCondWait(&queue->cond, &queue->lock, timed, &deadline) ==
+                ETIMEDOUT)
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return RTOS_TIMEOUT;
+        }
+    }
+    size_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->storage[tail * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return RTOS_OK;
+}
+
+rtos_result_t rtos_queue_receive(rtos_queue_t queue, void *item,
+                                 rtos_time_ms_t timeout_ms)
+{
+    if (queue == NULL || item == NULL)
+    {
+        return RTOS_ERROR;
+    }
+
+    struct timespec deadline;
+    bool timed = hostDeadline(timeout_ms, &deadline);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0)
+    {
+        if (timeout_ms == 0 ||
+            hostCondWait(&queue->cond, &queue->lock, timed, &deadline) ==
+                ETIMEDOUT)
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return RTOS_TIMEOUT;
+        }
+    }
+    memcpy(item, &queue->storage[queue->head * queue->itemSize],
+           queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return RTOS_OK;
+}
+
+rtos_queue_size_t rtos_queue_spaces_available(rtos_queue_t queue)
+{
+    if (queue == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&queue->lock);
+    rtos_queue_size_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
@@ -0,0 +1,45 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// ホストビルド用: rtos_wrapper.hが使うFreeRTOSの型だけを定義する
+// 実装はtools/host/rtos_wrapper_host.c(pthread)
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+typedef uint32_t EventBits_t;
+typedef void (*TaskFunction_t)(void *);
+#define configSTACK_DEPTH_TYPE uint32_t
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFu)
+
+// ハンドルの実体はrtos_wrapper_host.cで定義する
+typedef struct hostTask *TaskHandle_t;
+typedef struct hostMutex *SemaphoreHandle_t;
+typedef struct hostFlag *EventGroupHandle_t;
+typedef struct hostQueue *QueueHandle_t;
+
+// 静的確保用のバッファ(ホストでは使わない)
+typedef struct
+{
+    int unused;
+} TaskStatus_t;
+typedef struct
+{
+    int unused;
+} StaticTask_t;
+typedef struct
+{
+    int unused;
+} StaticSemaphore_t;
+typedef struct
+{
+    int unused;
+} StaticEventGroup_t;
+typedef struct
+{
+    int unused;
+} StaticQueue_t;
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,7 @@
+#ifndef HOST_PICO_CYW43_ARCH_H
+#define HOST_PICO_CYW43_ARCH_H
+
+// ホストビルド用: Wi-Fiチップはないため初期化は常に成功する
+extern int cyw43_arch_init(void);
+
+#endif // HOST_PICO_CYW43_ARCH_H
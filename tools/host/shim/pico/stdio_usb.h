@@ -0,0 +1,2 @@
+// ホストビルド用: stdioの関数はpico/stdlib.hにまとめて宣言している
+#include "pico/stdlib.h"
@@ -0,0 +1,24 @@
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+// ホストビルド用: pico-sdkのうちsrc/が使う関数だけを宣言する
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/time.h"
+
+#ifndef PICO_ON_DEVICE
+#define PICO_ON_DEVICE 0
+#endif
+
+// USB CDCはホストにはない。usbCommSetTransport()でpty/ループバックを使う
+extern bool stdio_init_all(void);
+extern bool stdio_usb_init(void);
+extern void stdio_put_string(const char *s, int len, bool newline,
+                             bool cr_translation);
+extern int stdio_get_until(char *buf, int len, absolute_time_t until);
+extern void stdio_set_chars_available_callback(void (*fn)(void *),
+                                               void *param);
+
+#endif // HOST_PICO_STDLIB_H
@@ -0,0 +1,15 @@
+#ifndef HOST_PICO_TIME_H
+#define HOST_PICO_TIME_H
+
+// ホストビルド用: pico-sdkの時刻APIをCLOCK_MONOTONICで代用する
+// 実装はtools/host/pico_host.c
+#include <stdint.h>
+
+typedef uint64_t absolute_time_t; // 起動からの経過時間[us]
+
+extern absolute_time_t get_absolute_time(void);
+extern uint32_t to_ms_since_boot(absolute_time_t t);
+extern uint32_t time_us_32(void);
+extern uint64_t time_us_64(void);
+
+#endif // HOST_PICO_TIME_H
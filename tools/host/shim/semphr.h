@@ -0,0 +1,2 @@
+// ホストビルド用: 型はFreeRTOS.hにまとめて定義している
+#include "FreeRTOS.h"
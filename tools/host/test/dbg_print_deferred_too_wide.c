@@ -0,0 +1,10 @@
+// DBG_PRINT_DEFERREDはuintptr_tより広い引数をコンパイルエラーにする
+// (CMakeLists.txtでビルドが失敗することを確認する)
+#include "dbg_print.h"
+
+int main(void)
+{
+    __int128 wide = 1;
+    DBG_PRINT_DEFERRED(DBG_MODULE_APP, DBG_LEVEL_INFO, "%d\r\n", wide);
+    return 0;
+}
@@ -0,0 +1,15 @@
+// RING_BUFFER_DEFINE/LOG_RING_DEFINEは2のべき乗でないサイズを
+// コンパイルエラーにする(CMakeLists.txtでビルドが失敗することを確認する)
+#include "log_ring.h"
+#include "ring_buffer.h"
+
+#ifdef TEST_LOG_RING
+LOG_RING_DEFINE(s_testLogRing, 96);
+#else
+RING_BUFFER_DEFINE(s_testRingBuffer, 100);
+#endif
+
+int main(void)
+{
+    return 0;
+}
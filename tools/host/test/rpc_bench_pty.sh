@@ -0,0 +1,27 @@
+#!/bin/sh
+# host_deviceをptyで起動し、表示されたslave側にrpc_benchを接続する
+# 使い方: rpc_bench_pty.sh <host_device> <rpc_bench> [秒数]
+set -u
+HOST_DEVICE=$1
+RPC_BENCH=$2
+SECONDS_EACH=${3:-2}
+
+LOG=$(mktemp)
+"$HOST_DEVICE" pty 2>"$LOG" >/dev/null &
+PID=$!
+trap 'kill $PID 2>/dev/null; rm -f "$LOG"' EXIT
+
+# slave側のパスが表示されるまで待つ
+PTY=
+for i in $(seq 50); do
+    PTY=$(sed -n 's/^\[usb_transport\] pty: //p' "$LOG")
+    [ -n "$PTY" ] && break
+    sleep 0.1
+done
+if [ -z "$PTY" ]; then
+    echo "host_device did not open a pty" >&2
+    cat "$LOG" >&2
+    exit 1
+fi
+
+"$RPC_BENCH" "$PTY" "$SECONDS_EACH"
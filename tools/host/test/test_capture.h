@@ -0,0 +1,124 @@
+#ifndef TEST_CAPTURE_H
+#define TEST_CAPTURE_H
+
+// 送信されたバイト列を記録する経路(usb_commの送信側のテスト用)
+// testCaptureInit()でusb_commとdbg_printを初期化し、送信タスクを起動する
+// 記録した内容はtestCaptureWait()で待って確認する
+// s_testCaptureStallをtrueにすると、usbFlush_taskが送信の途中で止まる
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "dbg_print.h"
+#include "host_rtos.h"
+#include "rtos_wrapper.h"
+#include "static_task.h"
+#include "usb_comm.h"
+
+#define TEST_CAPTURE_SIZE (1024 * 1024)
+
+static uint8_t s_testCapture[TEST_CAPTURE_SIZE];
+static size_t s_testCaptureLen;
+static pthread_mutex_t s_testCaptureLock = PTHREAD_MUTEX_INITIALIZER;
+// trueの間、write()は戻らない(送信が止まった状態を作る)
+static atomic_bool s_testCaptureStall;
+static atomic_bool s_testCaptureStalled; // write()が止まっている
+
+static bool testCaptureOpen(void)
+{
+    return true;
+}
+
+// 入りきらない分は捨てる(テストは記録できた範囲で確認する)
+static void testCaptureWrite(const uint8_t *data, size_t len)
+{
+    while (atomic_load(&s_testCaptureStall))
+    {
+        atomic_store(&s_testCaptureStalled, true);
+        rtos_task_delay(1);
+    }
+    atomic_store(&s_testCaptureStalled, false);
+
+    pthread_mutex_lock(&s_testCaptureLock);
+    if (len > TEST_CAPTURE_SIZE - s_testCaptureLen)
+    {
+        len = TEST_CAPTURE_SIZE - s_testCaptureLen;
+    }
+    memcpy(&s_testCapture[s_testCaptureLen], data, len);
+    s_testCaptureLen += len;
+    pthread_mutex_unlock(&s_testCaptureLock);
+}
+
+static int32_t testCaptureRead(uint8_t *buf, size_t len)
+{
+    return 0;
+}
+
+static void testCaptureSetRxCallback(void (*callback)(void *), void *params)
+{
+}
+
+static const usbTransport_t s_testCaptureTransport = {
+    .name = "capture",
+    .open = testCaptureOpen,
+    .write = testCaptureWrite,
+    .read = testCaptureRead,
+    .setRxCallback = testCaptureSetRxCallback,
+    .rxCallbackFromIsr = false,
+};
+
+static inline bool testCaptureInit(void)
+{
+    return usbCommSetTransport(&s_testCaptureTransport) == E_SUCCESS &&
+           usbCommInit() && init_dbgPrint() &&
+           rtos_task_create(usbFlush_task, "usbFlush", 512, NULL,
+                            RTOS_PRIORITY_NORMAL, RTOS_CORE_ANY,
+                            NULL) == RTOS_OK &&
+           rtos_task_create(dbgFormat_task, "dbgFormat", 256, NULL,
+                            RTOS_PRIORITY_LOW, RTOS_CORE_ANY, NULL) == RTOS_OK;
+}
+
+// 記録した内容をbufにコピーし、その長さを返す
+static inline size_t testCaptureCopy(uint8_t *buf, size_t size)
+{
+    pthread_mutex_lock(&s_testCaptureLock);
+    size_t len = (s_testCaptureLen < size) ? s_testCaptureLen : size;
+    memcpy(buf, s_testCapture, len);
+    pthread_mutex_unlock(&s_testCaptureLock);
+    return len;
+}
+
+// 記録した内容に含まれるneedleの数
+static inline size_t testCaptureCount(const char *needle)
+{
+    size_t len = strlen(needle);
+    size_t count = 0;
+    pthread_mutex_lock(&s_testCaptureLock);
+    for (size_t i = 0; i + len <= s_testCaptureLen; i++)
+    {
+        count += memcmp(&s_testCapture[i], needle, len) == 0;
+    }
+    pthread_mutex_unlock(&s_testCaptureLock);
+    return count;
+}
+
+static inline bool testCaptureContains(const char *needle)
+{
+    return testCaptureCount(needle) > 0;
+}
+
+// needleが記録されるまで最大timeoutMs待つ。見つかればtrue
+static inline bool testCaptureWait(const char *needle, uint32_t timeoutMs)
+{
+    for (uint32_t waited = 0; waited <= timeoutMs; waited++)
+    {
+        if (testCaptureContains(needle))
+        {
+            return true;
+        }
+        rtos_task_delay(1);
+    }
+    return false;
+}
+
+#endif // TEST_CAPTURE_H
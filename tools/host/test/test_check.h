@@ -0,0 +1,23 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+// ホストのテスト用の確認マクロ
+// 失敗した条件を表示して数え、mainはTEST_RESULT()を返す
+#include <stdio.h>
+
+static int s_testFailures = 0;
+
+#define CHECK(cond)                                                            \
+    do                                                                         \
+    {                                                                          \
+        if (!(cond))                                                           \
+        {                                                                      \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,   \
+                    #cond);                                                    \
+            s_testFailures++;                                                  \
+        }                                                                      \
+    } while (0)
+
+#define TEST_RESULT() ((s_testFailures == 0) ? 0 : 1)
+
+#endif // TEST_CHECK_H
@@ -0,0 +1,52 @@
+// DBG_PRINT_DEFERREDのテスト
+//  - 引数はuintptr_tで記録するため、64bitのホストでも%s/%pのポインタや
+//    64bit整数が切り詰められず、DBG_PRINTと同じ行になる
+//  - uintptr_tより広い引数のコンパイルエラーはdbg_print_deferred_too_wide.c
+#include <stdio.h>
+
+#include "test_capture.h"
+#include "test_check.h"
+
+static const char s_testName[] = "deferred";
+
+int main(void)
+{
+    CHECK(testCaptureInit());
+    CHECK(dbgSetModuleLevel(DBG_MODULE_APP, DBG_LEVEL_DEBUG) == E_SUCCESS);
+    hostRtosStart();
+
+    // 引数6個: 文字列、負の整数、ポインタ、符号なし最大値、16進数、文字
+    int32_t negative = -123456;
+    uint32_t max = UINT32_MAX;
+    DBG_PRINT_DEFERRED(DBG_MODULE_APP, DBG_LEVEL_INFO,
+                       "%s n=%d p=%p u=%u x=%#x c=%c\r\n", s_testName,
+                       negative, (void *)&negative, max, 0xbeefu, 'Z');
+    char expected[128];
+    snprintf(expected, sizeof(expected), "%s n=%d p=%p u=%u x=%#x c=%c\r\n",
+             s_testName, negative, (void *)&negative, max, 0xbeefu, 'Z');
+    CHECK(testCaptureWait(expected, 1000));
+
+    // ポインタ幅の整数(64bitのホストでは64bit)は切り詰められない
+    long long wide = -1234567890123LL;
+    if (sizeof(wide) <= sizeof(uintptr_t))
+    {
+        DBG_PRINT_DEFERRED(DBG_MODULE_APP, DBG_LEVEL_INFO, "wide=%lld\r\n",
+                           wide);
+        CHECK(testCaptureWait("wide=-1234567890123\r\n", 1000));
+    }
+
+    // 引数なしと、直接のDBG_PRINTとの混在
+    DBG_PRINT_DEFERRED(DBG_MODULE_APP, DBG_LEVEL_WARN, "no args\r\n");
+    DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_INFO, "direct %s\r\n", s_testName);
+    CHECK(testCaptureWait("no args\r\n", 1000));
+    CHECK(testCaptureWait("direct deferred\r\n", 1000));
+
+    // レベルで除外された行は出力されない
+    CHECK(dbgSetModuleLevel(DBG_MODULE_APP, DBG_LEVEL_ERROR) == E_SUCCESS);
+    DBG_PRINT_DEFERRED(DBG_MODULE_APP, DBG_LEVEL_INFO, "filtered\r\n");
+    DBG_PRINT_DEFERRED(DBG_MODULE_APP, DBG_LEVEL_ERROR, "error %d\r\n", 1);
+    CHECK(testCaptureWait("error 1\r\n", 1000));
+    CHECK(!testCaptureWait("filtered", 0));
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,205 @@
+// fmt.cのテスト: 同じ書式と引数をglibcのvsnprintfと比べる
+// 出力(バッファ全体)と戻り値が一致すること
+// Cの規格で未定義の組み合わせ(%dに#等)と、%pのNULL("(nil)")は比べない
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "fmt.h"
+#include "test_check.h"
+
+#define TEST_BUF_SIZE 256
+#define TEST_BUF_FILL 0x5A // 終端より後ろに書き込んでいないかの確認用
+
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+
+// sizeバイトのバッファに書式化し、libcと比べる。一致すればtrue
+static bool testFormat(size_t size, const char *format, ...)
+{
+    char expected[TEST_BUF_SIZE];
+    char actual[TEST_BUF_SIZE];
+    memset(expected, TEST_BUF_FILL, sizeof(expected));
+    memset(actual, TEST_BUF_FILL, sizeof(actual));
+
+    va_list args;
+    va_list copy;
+    va_start(args, format);
+    va_copy(copy, args);
+    int expectedLen = vsnprintf((size > 0) ? expected : NULL, size, format,
+                                args);
+    int32_t actualLen =
+        fmtFormatV((size > 0) ? actual : NULL, size, format, copy);
+    va_end(copy);
+    va_end(args);
+
+    if (expectedLen != actualLen ||
+        memcmp(expected, actual, sizeof(expected)) != 0)
+    {
+        fprintf(stderr, "format \"%s\" (size %zu): libc %d \"%.*s\", "
+                        "fmt %d \"%.*s\"\n",
+                format, size, expectedLen, (int)size, expected, (int)actualLen,
+                (int)size, actual);
+        return false;
+    }
+    return true;
+}
+
+// 整数の変換: フラグ x 幅 x 精度 x 値の全ての組み合わせ
+static void testIntegers(void)
+{
+    static const char *const flags[] = {"", "-", "0", "+", " ", "#",
+                                        "-0", "+0", " -", "#0", "#-"};
+    static const char *const widths[] = {"", "1", "8", "*"};
+    static const char *const precisions[] = {"", ".", ".0", ".3", ".*"};
+    static const char convs[] = {'d', 'i', 'u', 'x', 'X'};
+    static const int values[] = {0, 1, -1, 7, -42, 255, 65536, 123456789,
+                                 INT_MAX, INT_MIN};
+    static const int stars[] = {-12, 0, 5, 12};
+
+    for (size_t c = 0; c < sizeof(convs); c++)
+    {
+        bool isSigned = (convs[c] == 'd' || convs[c] == 'i');
+        for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            // 符号付きの#、符号なしの+/スペースは未定義のため比べない
+            if ((isSigned && strchr(flags[f], '#') != NULL) ||
+                (!isSigned && strpbrk(flags[f], "+ ") != NULL))
+            {
+                continue;
+            }
+            for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+            {
+                for (size_t p = 0;
+                     p < sizeof(precisions) / sizeof(precisions[0]); p++)
+                {
+                    char format[32];
+                    snprintf(format, sizeof(format), "[%%%s%s%s%c]", flags[f],
+                             widths[w], precisions[p], convs[c]);
+                    bool starW = (widths[w][0] == '*');
+                    bool starP = (precisions[p][1] == '*');
+                    // *がなければ幅/精度の引数は渡さないため1回だけ
+                    size_t starNum = (starW || starP)
+                                         ? sizeof(stars) / sizeof(stars[0])
+                                         : 1;
+                    for (size_t v = 0; v < sizeof(values) / sizeof(values[0]);
+                         v++)
+                    {
+                        for (size_t s = 0; s < starNum; s++)
+                        {
+                            int star = stars[s];
+                            if (starW && starP)
+                            {
+                                CHECK(testFormat(TEST_BUF_SIZE, format, star,
+                                                 star, values[v]));
+                            }
+                            else if (starW || starP)
+                            {
+                                CHECK(testFormat(TEST_BUF_SIZE, format, star,
+                                                 values[v]));
+                            }
+                            else
+                            {
+                                CHECK(testFormat(TEST_BUF_SIZE, format,
+                                                 values[v]));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// 長さ修飾子: 各型の境界値
+static void testLengthModifiers(void)
+{
+    CHECK(testFormat(TEST_BUF_SIZE, "%hhd %hhu %hhx", 300, 300, -1));
+    CHECK(testFormat(TEST_BUF_SIZE, "%hhd %hhd", SCHAR_MIN, SCHAR_MAX));
+    CHECK(testFormat(TEST_BUF_SIZE, "%hd %hu %hx", 70000, 70000, -1));
+    CHECK(testFormat(TEST_BUF_SIZE, "%hd %hd", SHRT_MIN, SHRT_MAX));
+    CHECK(testFormat(TEST_BUF_SIZE, "%ld %lu %lx", LONG_MIN, ULONG_MAX,
+                     ULONG_MAX));
+    CHECK(testFormat(TEST_BUF_SIZE, "%lld %lld %llu %llX", LLONG_MIN,
+                     LLONG_MAX, ULLONG_MAX, 0x0123456789ABCDEFull));
+    CHECK(testFormat(TEST_BUF_SIZE, "%zu %zx %zd", SIZE_MAX, (size_t)4096,
+                     (ssize_t)-5));
+    CHECK(testFormat(TEST_BUF_SIZE, "%td %jd %ju", (ptrdiff_t)-7, INTMAX_MIN,
+                     UINTMAX_MAX));
+    CHECK(testFormat(TEST_BUF_SIZE, "%020lld|%-+20lld|%.25llu", LLONG_MIN,
+                     LLONG_MAX, ULLONG_MAX));
+}
+
+static void testStringsAndChars(void)
+{
+    static const char *const formats[] = {
+        "%s", "%10s", "%-10s", "%.3s", "%10.3s", "%-10.3s", "%.0s", "%.20s",
+        "[%1s]",
+    };
+    static const char *const strings[] = {"", "a", "hello", "hello world!"};
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+    {
+        for (size_t s = 0; s < sizeof(strings) / sizeof(strings[0]); s++)
+        {
+            CHECK(testFormat(TEST_BUF_SIZE, formats[f], strings[s]));
+        }
+    }
+    CHECK(testFormat(TEST_BUF_SIZE, "%*.*s|%-*s", 8, 2, "abcdef", 6, "xy"));
+    CHECK(testFormat(TEST_BUF_SIZE, "%*s", -6, "ab"));
+    CHECK(testFormat(TEST_BUF_SIZE, "%s|%10s", (char *)NULL, (char *)NULL));
+
+    CHECK(testFormat(TEST_BUF_SIZE, "%c%c%c", 'a', 'b', 'c'));
+    CHECK(testFormat(TEST_BUF_SIZE, "[%5c][%-5c][%1c]", 'x', 'y', 'z'));
+    CHECK(testFormat(TEST_BUF_SIZE, "100%% %5%|%-5%|"));
+    CHECK(testFormat(TEST_BUF_SIZE, "no conversion"));
+    CHECK(testFormat(TEST_BUF_SIZE, ""));
+}
+
+// %pはglibcと同じく0xと16進数(NULLの表記だけが異なる)
+static void testPointers(void)
+{
+    int local;
+    static const char *const formats[] = {"%p", "%20p", "%-20p"};
+    void *const pointers[] = {&local, (void *)testPointers, (void *)0x1,
+                              (void *)UINTPTR_MAX};
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+    {
+        for (size_t p = 0; p < sizeof(pointers) / sizeof(pointers[0]); p++)
+        {
+            CHECK(testFormat(TEST_BUF_SIZE, formats[f], pointers[p]));
+        }
+    }
+}
+
+// 切り詰め: 戻り値は切り詰めなかった場合の長さ、必ずnull終端する
+static void testTruncation(void)
+{
+    static const size_t sizes[] = {0, 1, 2, 5, 11, 12, 13};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        CHECK(testFormat(sizes[i], "hello world"));
+        CHECK(testFormat(sizes[i], "%s=%08x", "key", 0xBEEF));
+        CHECK(testFormat(sizes[i], "[%-6d|%6s]", -12, "ab"));
+    }
+}
+
+// 引数の誤り(libcとは比べない)
+static void testArguments(void)
+{
+    char buf[8];
+    CHECK(fmtFormat(NULL, 8, "%d", 1) == E_ARGUMENT);
+    CHECK(fmtFormat(buf, sizeof(buf), NULL) == E_ARGUMENT);
+    CHECK(fmtFormat(NULL, 0, "%d", 12345) == 5);
+}
+
+int main(void)
+{
+    testIntegers();
+    testLengthModifiers();
+    testStringsAndChars();
+    testPointers();
+    testTruncation();
+    testArguments();
+    return TEST_RESULT();
+}
@@ -0,0 +1,197 @@
+// log_ring.cのテスト
+//  - 折り返し: 末尾に収まらないレコードはパディングを挟んで先頭に置かれ、
+//    consumerはパディングを読み飛ばす
+//  - 複数producer: TEST_PRODUCER_NUM個のスレッドが同時に確保/確定し、
+//    1つのconsumerがレコードの内容と、producerごとの順序を確認する
+//    レコードサイズはリングのサイズを割り切れない長さにして、
+//    折り返しとパディングを頻繁に起こす
+#include <pthread.h>
+#include <sched.h>
+
+#include "log_ring.h"
+#include "test_check.h"
+
+#define TEST_RING_SIZE 1024
+#define TEST_PRODUCER_NUM 4
+#define TEST_RECORDS_PER_PRODUCER 200000
+// レコードの先頭: producer id(1) | 連番(4, little endian)
+#define TEST_RECORD_TAG_SIZE 5
+#define TEST_RECORD_LEN_MAX 123
+
+typedef struct
+{
+    logRing_t *lr;
+    uint8_t id;
+} testProducer_t;
+
+// 連番ごとに長さを変える(5..123バイト。4の倍数以外も含める)
+static size_t testRecordLen(uint8_t id, uint32_t seq)
+{
+    return TEST_RECORD_TAG_SIZE +
+           (seq * 7u + id * 13u) %
+               (TEST_RECORD_LEN_MAX - TEST_RECORD_TAG_SIZE + 1);
+}
+
+// 長さと位置から決まるpayloadのバイト
+static uint8_t testRecordByte(uint8_t id, uint32_t seq, size_t len, size_t i)
+{
+    return (uint8_t)(id * 31u + seq + len * 7u + i);
+}
+
+static void *testProducer(void *arg)
+{
+    testProducer_t *p = arg;
+    for (uint32_t seq = 0; seq < TEST_RECORDS_PER_PRODUCER; seq++)
+    {
+        size_t len = testRecordLen(p->id, seq);
+        // 確定サイズより多めに確保する場合も含める
+        size_t reserveLen = len + (seq % 3);
+
+        // 奇数のproducerは割り込みハンドラ用のTryReserveを使う
+        uint8_t *record;
+        while ((record = (p->id & 1) ? logRingTryReserve(p->lr, reserveLen)
+                                     : logRingReserve(p->lr, reserveLen)) ==
+               NULL)
+        {
+            sched_yield();
+        }
+
+        record[0] = p->id;
+        record[1] = (uint8_t)seq;
+        record[2] = (uint8_t)(seq >> 8);
+        record[3] = (uint8_t)(seq >> 16);
+        record[4] = (uint8_t)(seq >> 24);
+        for (size_t i = TEST_RECORD_TAG_SIZE; i < len; i++)
+        {
+            record[i] = testRecordByte(p->id, seq, len, i);
+        }
+        logRingCommit(p->lr, record, len);
+    }
+    return NULL;
+}
+
+// 末尾に収まらないレコードはパディングの後、バッファ先頭に置かれる
+static void testPadding(void)
+{
+    LOG_RING_DEFINE(lr, 64);
+    CHECK(LOG_RING_INIT(lr));
+
+    // 24バイトのレコードを2つ確保/解放し、次の確保位置を48にする
+    for (int i = 0; i < 2; i++)
+    {
+        uint8_t *record = logRingReserve(&lr, 20);
+        CHECK(record == &lr.buffer[i * 24 + LOG_RING_HEADER_SIZE]);
+        logRingCommit(&lr, record, 20);
+        const uint8_t *data;
+        size_t len;
+        CHECK(logRingPeek(&lr, &data, &len) && data == record && len == 20);
+        logRingRelease(&lr);
+    }
+
+    // 残り16バイトには入らないため、先頭から確保する
+    uint8_t *record = logRingReserve(&lr, 18);
+    CHECK(record == &lr.buffer[LOG_RING_HEADER_SIZE]);
+    memset(record, 0xA5, 18);
+    logRingCommit(&lr, record, 11);
+
+    const uint8_t *data;
+    size_t len;
+    CHECK(logRingPeek(&lr, &data, &len));
+    CHECK(data == record && len == 11 && data[10] == 0xA5);
+    logRingRelease(&lr);
+    CHECK(!logRingPeek(&lr, &data, &len));
+
+    // パディング(16) + レコード(24)の分だけ進み、解放した領域は0に戻る
+    CHECK(atomic_load(&lr.tail) == 48 + 16 + 24);
+    CHECK(atomic_load(&lr.reserveHead) == atomic_load(&lr.tail));
+    for (size_t i = 0; i < sizeof(lr_storage); i++)
+    {
+        CHECK(lr.buffer[i] == 0);
+    }
+
+    // 1レコードはバッファの半分まで
+    CHECK(logRingReserve(&lr, 32 - LOG_RING_HEADER_SIZE) != NULL);
+    CHECK(logRingReserve(&lr, 32 - LOG_RING_HEADER_SIZE + 1) == NULL);
+    CHECK(logRingReserve(&lr, 0) == NULL);
+}
+
+static void testMultiProducer(void)
+{
+    LOG_RING_DEFINE(lr, TEST_RING_SIZE);
+    CHECK(LOG_RING_INIT(lr));
+
+    testProducer_t producers[TEST_PRODUCER_NUM];
+    pthread_t threads[TEST_PRODUCER_NUM];
+    for (uint8_t i = 0; i < TEST_PRODUCER_NUM; i++)
+    {
+        producers[i] = (testProducer_t){&lr, i};
+        CHECK(pthread_create(&threads[i], NULL, testProducer, &producers[i]) ==
+              0);
+    }
+
+    // consumer: 内容と、producerごとに連番が1ずつ増えることを確認する
+    uint32_t nextSeq[TEST_PRODUCER_NUM] = {0};
+    size_t received = 0;
+    size_t errors = 0;
+    while (received < (size_t)TEST_PRODUCER_NUM * TEST_RECORDS_PER_PRODUCER)
+    {
+        const uint8_t *data;
+        size_t len;
+        if (!logRingPeek(&lr, &data, &len))
+        {
+            sched_yield();
+            continue;
+        }
+
+        uint8_t id = data[0];
+        uint32_t seq = data[1] | (data[2] << 8) | (data[3] << 16) |
+                       ((uint32_t)data[4] << 24);
+        if (len < TEST_RECORD_TAG_SIZE || id >= TEST_PRODUCER_NUM ||
+            seq != nextSeq[id] || len != testRecordLen(id, seq))
+        {
+            errors++;
+        }
+        else
+        {
+            for (size_t i = TEST_RECORD_TAG_SIZE; i < len; i++)
+            {
+                if (data[i] != testRecordByte(id, seq, len, i))
+                {
+                    errors++;
+                    break;
+                }
+            }
+            nextSeq[id] = seq + 1;
+        }
+        logRingRelease(&lr);
+        received++;
+        if (errors > 100)
+        {
+            break; // 表示が増えすぎないよう打ち切る(スレッドは残したまま)
+        }
+    }
+    CHECK(errors == 0);
+    if (errors != 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < TEST_PRODUCER_NUM; i++)
+    {
+        pthread_join(threads[i], NULL);
+        CHECK(nextSeq[i] == TEST_RECORDS_PER_PRODUCER);
+    }
+    const uint8_t *data;
+    size_t len;
+    CHECK(!logRingPeek(&lr, &data, &len));
+    CHECK(atomic_load(&lr.reserveHead) == atomic_load(&lr.tail));
+    // 折り返しを何度も繰り返している
+    CHECK(atomic_load(&lr.tail) > 100 * TEST_RING_SIZE);
+}
+
+int main(void)
+{
+    testPadding();
+    testMultiProducer();
+    return TEST_RESULT();
+}
@@ -0,0 +1,244 @@
+// ring_buffer.cのテスト
+//  - SPSCモード: producer/consumerを別スレッドで同時に動かし、
+//    折り返しや部分的な書き込み/読み出しを含めてデータの欠落や順序の
+//    入れ替わりがないことを確認する
+//  - サイズ: 2のべき乗のみ受け付け、indexはマスクで折り返す
+//    RING_BUFFER_DEFINEは静的な格納領域を定義する
+//    (2のべき乗でないサイズのコンパイルエラーはring_buffer_define_not_pow2.c)
+#include <pthread.h>
+#include <sched.h>
+
+#include "ring_buffer.h"
+#include "test_check.h"
+
+// 折り返しが頻繁に起きるよう小さくする
+#define TEST_RING_SIZE 256
+#define TEST_STRESS_BYTES (8 * 1024 * 1024)
+// 1回に渡す最大長(リングのサイズを超える長さも含める)
+#define TEST_CHUNK_MAX (TEST_RING_SIZE + 13)
+
+typedef enum
+{
+    TEST_SPSC_NONBLOCK = 0, // Enqueue/Dequeue(空き/データがなければ再試行)
+    TEST_SPSC_PEEK,         // consumerはPeekContiguous/Consume
+    TEST_SPSC_WAIT          // EnqueueWait/DequeueWait(タスク通知で待つ)
+} testSpscKind_t;
+
+typedef struct
+{
+    ringBuffer_t *rb;
+    testSpscKind_t kind;
+    size_t errors; // consumerが検出した不一致の数
+} testSpscCtx_t;
+
+// 位置ごとに異なるバイト列(リングのサイズの周期で同じ値にならない)
+static uint8_t testStreamByte(size_t pos)
+{
+    return (uint8_t)((pos * 2654435761u) >> 24);
+}
+
+// 1回に渡す長さを変える(xorshift)
+static size_t testChunkLen(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return 1 + (*state % TEST_CHUNK_MAX);
+}
+
+static void *testSpscProducer(void *arg)
+{
+    testSpscCtx_t *c = arg;
+    uint8_t chunk[TEST_CHUNK_MAX];
+    uint32_t state = 0x12345678;
+    size_t sent = 0;
+    while (sent < TEST_STRESS_BYTES)
+    {
+        size_t len = testChunkLen(&state);
+        if (len > TEST_STRESS_BYTES - sent)
+        {
+            len = TEST_STRESS_BYTES - sent;
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            chunk[i] = testStreamByte(sent + i);
+        }
+
+        size_t done = 0;
+        while (done < len)
+        {
+            int32_t ret;
+            if (c->kind == TEST_SPSC_WAIT)
+            {
+                ret = ringBufferEnqueueWait(c->rb, &chunk[done], len - done,
+                                            MAX_DELAY);
+            }
+            else
+            {
+                ret = ringBufferEnqueue(c->rb, &chunk[done], len - done);
+            }
+            if (ret > 0)
+            {
+                done += ret;
+            }
+            else
+            {
+                sched_yield();
+            }
+        }
+        sent += len;
+    }
+    return NULL;
+}
+
+// 受け取ったバイトを位置ごとの期待値と比べる
+static void testSpscVerify(testSpscCtx_t *c, const uint8_t *data, size_t len,
+                           size_t pos)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (data[i] != testStreamByte(pos + i))
+        {
+            c->errors++;
+        }
+    }
+}
+
+static void *testSpscConsumer(void *arg)
+{
+    testSpscCtx_t *c = arg;
+    uint8_t chunk[TEST_CHUNK_MAX];
+    uint32_t state = 0x9ABCDEF0;
+    size_t received = 0;
+    while (received < TEST_STRESS_BYTES)
+    {
+        int32_t ret = 0;
+        if (c->kind == TEST_SPSC_PEEK)
+        {
+            ringBufferSpan_t span;
+            if (ringBufferPeekContiguous(c->rb, &span) > 0)
+            {
+                size_t pos = received;
+                for (int i = 0; i < RING_BUFFER_SPAN_MAX; i++)
+                {
+                    testSpscVerify(c, span.data[i], span.len[i], pos);
+                    pos += span.len[i];
+                }
+                ret = ringBufferConsume(c->rb, pos - received);
+            }
+        }
+        else
+        {
+            size_t len = testChunkLen(&state);
+            ret = (c->kind == TEST_SPSC_WAIT)
+                      ? ringBufferDequeueWait(c->rb, chunk, len, MAX_DELAY)
+                      : ringBufferDequeue(c->rb, chunk, len);
+            if (ret > 0)
+            {
+                testSpscVerify(c, chunk, ret, received);
+            }
+        }
+
+        if (ret > 0)
+        {
+            received += ret;
+        }
+        else if (c->kind != TEST_SPSC_WAIT)
+        {
+            sched_yield();
+        }
+        else
+        {
+            c->errors++; // MAX_DELAYで待つため、0以下は返らない
+        }
+    }
+    return NULL;
+}
+
+static void testSpscStress(testSpscKind_t kind)
+{
+    RING_BUFFER_DEFINE(rb, TEST_RING_SIZE);
+    CHECK(RING_BUFFER_INIT(rb, RING_BUFFER_MODE_SPSC));
+
+    testSpscCtx_t ctx = {&rb, kind, 0};
+    pthread_t producer;
+    pthread_t consumer;
+    CHECK(pthread_create(&consumer, NULL, testSpscConsumer, &ctx) == 0);
+    CHECK(pthread_create(&producer, NULL, testSpscProducer, &ctx) == 0);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    CHECK(ctx.errors == 0);
+    CHECK(ringBufferAvailableSize(&rb) == TEST_RING_SIZE);
+}
+
+// ringBufferInitは2のべき乗でないサイズを受け付けない
+static void testInitSize(void)
+{
+    static uint8_t storage[1024];
+    static const size_t valid[] = {1, 2, 64, 1024};
+    static const size_t invalid[] = {0, 3, 100, 1000};
+    ringBuffer_t rb;
+
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++)
+    {
+        CHECK(ringBufferInit(&rb, storage, valid[i], RING_BUFFER_MODE_SPSC));
+        CHECK(rb.mask == valid[i] - 1);
+    }
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        CHECK(!ringBufferInit(&rb, storage, invalid[i],
+                              RING_BUFFER_MODE_SPSC));
+    }
+    CHECK(!ringBufferInit(&rb, NULL, 64, RING_BUFFER_MODE_SPSC));
+}
+
+// RING_BUFFER_DEFINEの格納領域は静的で、指定したサイズになる
+RING_BUFFER_DEFINE(s_testDefined, 8);
+
+static void testDefine(void)
+{
+    CHECK(sizeof(s_testDefined_storage) == 8);
+    CHECK(RING_BUFFER_IS_POWER_OF_2(8) && !RING_BUFFER_IS_POWER_OF_2(12) &&
+          !RING_BUFFER_IS_POWER_OF_2(0));
+
+    static const ringBufferMode_t modes[] = {RING_BUFFER_MODE_SPSC,
+                                             RING_BUFFER_MODE_MUTEX};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        CHECK(RING_BUFFER_INIT(s_testDefined, modes[m]));
+        CHECK(s_testDefined.buffer == s_testDefined_storage);
+        CHECK(s_testDefined.bufferSize == 8);
+        CHECK((s_testDefined.mtx != NULL) ==
+              (modes[m] == RING_BUFFER_MODE_MUTEX));
+
+        // 3バイトずつ送受信し、indexが末尾で0に戻ることを確認する
+        for (uint8_t i = 0; i < 16; i++)
+        {
+            const uint8_t in[3] = {i, (uint8_t)(i + 1), (uint8_t)(i + 2)};
+            uint8_t out[3] = {0};
+            CHECK(ringBufferEnqueue(&s_testDefined, in, sizeof(in)) == 3);
+            CHECK(s_testDefined.head < 8);
+            CHECK(ringBufferDequeue(&s_testDefined, out, sizeof(out)) == 3);
+            CHECK(s_testDefined.tail == s_testDefined.head);
+            CHECK(memcmp(in, out, sizeof(in)) == 0);
+        }
+
+        // いっぱいの場合は入る分だけ書き込み、それ以上はE_WOULDBLOCK
+        static const uint8_t fill[10] = {0};
+        CHECK(ringBufferEnqueue(&s_testDefined, fill, sizeof(fill)) == 8);
+        CHECK(ringBufferEnqueue(&s_testDefined, fill, 1) == E_WOULDBLOCK);
+        ringBufferClear(&s_testDefined);
+        CHECK(ringBufferAvailableSize(&s_testDefined) == 8);
+    }
+}
+
+int main(void)
+{
+    testInitSize();
+    testDefine();
+    testSpscStress(TEST_SPSC_NONBLOCK);
+    testSpscStress(TEST_SPSC_PEEK);
+    testSpscStress(TEST_SPSC_WAIT);
+    return TEST_RESULT();
+}
@@ -0,0 +1,68 @@
+// ループバック経路でusb_commの送受信全体を動かす
+//  - 送信したフレームは同じチャネルの購読者に届く
+//  - ログ等のフレーム外のバイト列は返らない(RAWの購読者に届かない)
+#include "dbg_print.h"
+#include "host_rtos.h"
+#include "rtos_wrapper.h"
+#include "static_task.h"
+#include "test_check.h"
+#include "usb_comm.h"
+
+#define TEST_QUEUE_LENGTH 4
+
+static rtos_queue_t s_telemetryQueue;
+static rtos_queue_t s_rawQueue;
+
+// queueから1件受け取り、dataと一致するか確認する
+static void checkReceived(rtos_queue_t queue, const char *data, size_t len)
+{
+    usbRxData_t *p_data = NULL;
+    CHECK(rtos_queue_receive(queue, &p_data, 1000) == RTOS_OK);
+    if (p_data == NULL)
+    {
+        return;
+    }
+    CHECK(p_data->id == USB_CHANNEL_TELEMETRY);
+    CHECK(p_data->dataLen == len);
+    CHECK(memcmp(p_data->data, data, len) == 0);
+    usbRxDataRelease(p_data);
+}
+
+int main(void)
+{
+    CHECK(usbCommSetTransport(&usbTransportLoopback) == E_SUCCESS);
+    CHECK(usbCommInit());
+    CHECK(init_dbgPrint());
+    CHECK(rtos_task_create(usbFlush_task, "usbFlush", 512, NULL,
+                           RTOS_PRIORITY_NORMAL, RTOS_CORE_ANY,
+                           NULL) == RTOS_OK);
+    CHECK(rtos_task_create(usbDrain_task, "usbDrain", 512, NULL,
+                           RTOS_PRIORITY_NORMAL, RTOS_CORE_ANY,
+                           NULL) == RTOS_OK);
+
+    s_telemetryQueue =
+        rtos_queue_create(TEST_QUEUE_LENGTH, sizeof(usbRxData_t *));
+    s_rawQueue = rtos_queue_create(TEST_QUEUE_LENGTH, sizeof(usbRxData_t *));
+    CHECK(registerUsbRxChannelQueue(USB_CHANNEL_TELEMETRY,
+                                    &s_telemetryQueue) == E_SUCCESS);
+    CHECK(registerUsbRxChannelQueue(USB_RX_CHANNEL_RAW, &s_rawQueue) ==
+          E_SUCCESS);
+    hostRtosStart();
+
+    // フレームは返る。ログと混ざっていても、フレームだけが届く
+    CHECK(usbTxFrame(USB_CHANNEL_TELEMETRY, "hello", 5) == 5);
+    usbFlushUrgent();
+    checkReceived(s_telemetryQueue, "hello", 5);
+
+    DBG_PRINT(DBG_MODULE_APP, DBG_LEVEL_INFO, "log line %d\r\n", 1);
+    CHECK(usbTx("text\r\n", 6) >= 0);
+    CHECK(usbTxFrame(USB_CHANNEL_TELEMETRY, "world!", 6) == 6);
+    usbFlushUrgent();
+    checkReceived(s_telemetryQueue, "world!", 6);
+
+    // ログ/テキストは返らない
+    usbRxData_t *p_data = NULL;
+    CHECK(rtos_queue_receive(s_rawQueue, &p_data, 200) == RTOS_TIMEOUT);
+
+    return TEST_RESULT();
+}
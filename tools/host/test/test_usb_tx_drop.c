@@ -0,0 +1,125 @@
+// 送信バッファがいっぱいの場合のDROP_NEW(usbTxSetOverflowPolicy)のテスト
+//  - 送信を止めてNORMALレーンを埋めると、usbTxは待たずにE_WOULDBLOCKを返す
+//  - 破棄したバイト数/メッセージ数を数える(複数レコードのメッセージは1件)
+//  - 送信が再開すると、破棄したバイト数の通知が1度だけストリームに出る
+//  - usbtxコマンドで設定と統計を確認できる
+#include <stdio.h>
+#include <time.h>
+
+#include "command.h"
+#include "test_capture.h"
+#include "test_check.h"
+
+#define TEST_LINE_LEN 100
+#define TEST_LONG_LEN (USB_TX_RECORD_MAX * 2 + 88) // 3レコードに分かれる長さ
+#define TEST_DROP_LINES 5
+// 待たずに戻ったと見なす時間(送信が止まっている間、待てば戻らない)
+#define TEST_NONBLOCK_MS 50
+
+static uint64_t testNowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void testLine(char *line, uint32_t n)
+{
+    memset(line, '.', TEST_LINE_LEN);
+    snprintf(line, TEST_LINE_LEN, "line %05u", (unsigned)n);
+    line[strlen(line)] = ' ';
+    line[TEST_LINE_LEN - 2] = '\r';
+    line[TEST_LINE_LEN - 1] = '\n';
+}
+
+// 待たずに戻り、E_WOULDBLOCKであること
+static void checkDropped(const char *data, size_t len)
+{
+    uint64_t start = testNowMs();
+    CHECK(usbTx(data, len) == E_WOULDBLOCK);
+    CHECK(testNowMs() - start < TEST_NONBLOCK_MS);
+}
+
+int main(void)
+{
+    CHECK(testCaptureInit());
+    hostRtosStart();
+
+    // コマンドで設定する
+    char command[] = "usbtx drop";
+    CHECK(commandExecute(command) == E_SUCCESS);
+    CHECK(usbTxGetOverflowPolicy() == USB_TX_OVERFLOW_DROP_NEW);
+    CHECK(testCaptureWait("usbtx: drop, dropped 0 bytes 0 records", 1000));
+
+    // 送信を止める(usbFlush_taskがwrite()の中で止まるまで待つ)
+    atomic_store(&s_testCaptureStall, true);
+    CHECK(usbTx("stall\r\n", 7) == 7);
+    usbFlushUrgent();
+    for (int i = 0; i < 1000 && !atomic_load(&s_testCaptureStalled); i++)
+    {
+        rtos_task_delay(1);
+    }
+    CHECK(atomic_load(&s_testCaptureStalled));
+
+    // NORMALレーンがいっぱいになるまで書き込む
+    char line[TEST_LINE_LEN];
+    uint32_t accepted = 0;
+    int32_t ret;
+    while (1)
+    {
+        testLine(line, accepted);
+        uint64_t start = testNowMs();
+        ret = usbTx(line, sizeof(line));
+        CHECK(testNowMs() - start < TEST_NONBLOCK_MS);
+        if (ret != TEST_LINE_LEN)
+        {
+            break;
+        }
+        accepted++;
+    }
+    CHECK(ret == E_WOULDBLOCK);
+    CHECK(accepted > 0);
+
+    // 以降の書き込みも待たずに破棄される
+    for (int i = 0; i < TEST_DROP_LINES; i++)
+    {
+        checkDropped(line, sizeof(line));
+    }
+    static char longMessage[TEST_LONG_LEN];
+    memset(longMessage, 'L', sizeof(longMessage));
+    checkDropped(longMessage, sizeof(longMessage));
+
+    const uint32_t droppedBytes =
+        TEST_LINE_LEN * (1 + TEST_DROP_LINES) + TEST_LONG_LEN;
+    const uint32_t droppedRecords = 1 + TEST_DROP_LINES + 1;
+    usbTxDropStats_t stats;
+    usbTxGetDropStats(&stats);
+    CHECK(stats.droppedBytes == droppedBytes);
+    CHECK(stats.droppedRecords == droppedRecords);
+
+    // 送信を再開する。書き込めた行は全て届き、破棄の通知は1度だけ出る
+    char marker[64];
+    snprintf(marker, sizeof(marker), "\r\n[usb_comm] %u bytes dropped\r\n",
+             (unsigned)droppedBytes);
+    atomic_store(&s_testCaptureStall, false);
+    CHECK(testCaptureWait(marker, 1000));
+    testLine(line, accepted - 1);
+    line[TEST_LINE_LEN - 2] = '\0';
+    CHECK(testCaptureWait(line, 1000));
+
+    CHECK(usbTx("after\r\n", 7) == 7);
+    CHECK(testCaptureWait("after\r\n", 1000));
+    CHECK(testCaptureCount("bytes dropped") == 1);
+    CHECK(testCaptureCount(marker) == 1);
+
+    // 統計はコマンドでも確認できる。blockに戻す
+    char status[64];
+    snprintf(status, sizeof(status), "dropped %u bytes %u records",
+             (unsigned)droppedBytes, (unsigned)droppedRecords);
+    char block[] = "usbtx block";
+    CHECK(commandExecute(block) == E_SUCCESS);
+    CHECK(usbTxGetOverflowPolicy() == USB_TX_OVERFLOW_BLOCK);
+    CHECK(testCaptureWait(status, 1000));
+
+    return TEST_RESULT();
+}
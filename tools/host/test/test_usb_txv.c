@@ -0,0 +1,140 @@
+// usbTxv(複数の断片を1レコードとして送信)のテスト
+//  - 引数の確認: NULL、長さ0、USB_TX_RECORD_MAXを超える合計(E_BUFSIZE)
+//  - 別のスレッドがusbTxで送信している間も、断片は連続して順に届き、
+//    他の出力と混ざらない
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test_capture.h"
+#include "test_check.h"
+
+#define TEST_RECORDS 2000
+#define TEST_OTHER_LINES 4000
+#define TEST_PAYLOAD_MAX 200
+
+// 断片: "<v" + 連番5桁 + "|" / payload / ">\r\n"
+#define TEST_HEADER_LEN 8
+
+static atomic_bool s_testOtherDone;
+
+static size_t testPayloadLen(uint32_t seq)
+{
+    return 1 + seq % TEST_PAYLOAD_MAX;
+}
+
+static char testPayloadByte(uint32_t seq, size_t i)
+{
+    return (char)('a' + (seq + i) % 26);
+}
+
+// 他のタスクの出力("[b" + 連番5桁 + "]\r\n")
+static void *testOtherProducer(void *arg)
+{
+    for (uint32_t i = 0; i < TEST_OTHER_LINES; i++)
+    {
+        char line[16];
+        int len = snprintf(line, sizeof(line), "[b%05u]\r\n", (unsigned)i);
+        usbTx(line, len);
+    }
+    atomic_store(&s_testOtherDone, true);
+    return NULL;
+}
+
+static void testArguments(void)
+{
+    static char data[USB_TX_RECORD_MAX + 1];
+    memset(data, 'x', sizeof(data));
+
+    CHECK(usbTxv(NULL, 1) == E_ARGUMENT);
+    CHECK(usbTxv(NULL, 0) == 0);
+
+    usbTxVec_t nullData[] = {{"a", 1}, {NULL, 1}};
+    CHECK(usbTxv(nullData, 2) == E_ARGUMENT);
+
+    // 長さ0の断片はNULLでもよく、合計が0なら何も送らない
+    usbTxVec_t empty[] = {{NULL, 0}, {"", 0}};
+    CHECK(usbTxv(empty, 2) == 0);
+
+    // 1レコードにできない合計はE_BUFSIZE。ちょうどUSB_TX_RECORD_MAXは送る
+    usbTxVec_t tooLong[] = {{data, USB_TX_RECORD_MAX}, {"y", 1}};
+    CHECK(usbTxv(tooLong, 2) == E_BUFSIZE);
+    usbTxVec_t single[] = {{data, USB_TX_RECORD_MAX}};
+    CHECK(usbTxv(single, 1) == USB_TX_RECORD_MAX);
+}
+
+int main(void)
+{
+    CHECK(testCaptureInit());
+    hostRtosStart();
+    testArguments();
+
+    pthread_t other;
+    CHECK(pthread_create(&other, NULL, testOtherProducer, NULL) == 0);
+    for (uint32_t seq = 0; seq < TEST_RECORDS; seq++)
+    {
+        char header[TEST_HEADER_LEN + 1];
+        snprintf(header, sizeof(header), "<v%05u|", (unsigned)seq);
+        char payload[TEST_PAYLOAD_MAX];
+        size_t payloadLen = testPayloadLen(seq);
+        for (size_t i = 0; i < payloadLen; i++)
+        {
+            payload[i] = testPayloadByte(seq, i);
+        }
+        usbTxVec_t vec[] = {
+            {header, TEST_HEADER_LEN}, {payload, payloadLen}, {">\r\n", 3}};
+        CHECK(usbTxv(vec, 3) == (int32_t)(TEST_HEADER_LEN + payloadLen + 3));
+    }
+    pthread_join(other, NULL);
+    CHECK(usbTx("end\r\n", 5) == 5);
+    CHECK(testCaptureWait("end\r\n", 1000));
+
+    // 届いた順に、各レコードと他の出力が分断されていないことを確認する
+    static uint8_t out[TEST_CAPTURE_SIZE];
+    size_t len = testCaptureCopy(out, sizeof(out));
+    uint32_t nextSeq = 0;
+    uint32_t nextOther = 0;
+    size_t errors = 0;
+    size_t interleaved = 0; // レコードの間に入った他の出力の数
+    for (size_t pos = 0; pos + 2 <= len; pos++)
+    {
+        if (out[pos] == '<' && out[pos + 1] == 'v')
+        {
+            char expected[TEST_HEADER_LEN + TEST_PAYLOAD_MAX + 3];
+            snprintf(expected, sizeof(expected), "<v%05u|",
+                     (unsigned)nextSeq);
+            size_t payloadLen = testPayloadLen(nextSeq);
+            for (size_t i = 0; i < payloadLen; i++)
+            {
+                expected[TEST_HEADER_LEN + i] = testPayloadByte(nextSeq, i);
+            }
+            memcpy(&expected[TEST_HEADER_LEN + payloadLen], ">\r\n", 3);
+            size_t recordLen = TEST_HEADER_LEN + payloadLen + 3;
+            if (pos + recordLen > len ||
+                memcmp(&out[pos], expected, recordLen) != 0)
+            {
+                errors++;
+            }
+            nextSeq++;
+        }
+        else if (out[pos] == '[' && out[pos + 1] == 'b')
+        {
+            char expected[16];
+            int lineLen = snprintf(expected, sizeof(expected), "[b%05u]\r\n",
+                                   (unsigned)nextOther);
+            if (pos + lineLen > len ||
+                memcmp(&out[pos], expected, lineLen) != 0)
+            {
+                errors++;
+            }
+            nextOther++;
+            interleaved += (nextSeq > 0 && nextSeq < TEST_RECORDS);
+        }
+    }
+    CHECK(errors == 0);
+    CHECK(nextSeq == TEST_RECORDS);
+    CHECK(nextOther == TEST_OTHER_LINES);
+    CHECK(atomic_load(&s_testOtherDone));
+    CHECK(interleaved > 0); // 実際に並行して送信している
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,143 @@
+// バイナリRPCのスループット測定(パイプラインの深さ 1, 8, 64)
+//
+// ビルド:
+//   gcc -O2 -I../src/utils -o rpc_bench rpc_bench.c rpc_client.c
+//       ../src/utils/frame.c
+//   (tools/hostのホストビルドでもrpc_benchとしてビルドされる)
+// 使い方:
+//   ./rpc_bench <tty> [秒数]
+//   例) ./rpc_bench /dev/ttyACM0 2
+// 実機がない場合は、ホストビルドのhost_deviceのptyに対して測る
+// (rpc.c, usb_commは実機と同じソースで、USBの遅延と帯域は含まない)
+//   ./host_device pty        ← "[usb_transport] pty: /dev/pts/N"を表示する
+//   ./rpc_bench /dev/pts/N 2
+
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rpc_client.h"
+
+#define BENCH_ARG_SIZE 8
+
+/****************************************************
+ * 測定
+ ****************************************************/
+
+static double nowSec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int openTty(const char *path)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+typedef struct
+{
+    unsigned completed;
+    unsigned errors;
+} benchStats_t;
+
+static void benchDone(void *ctx, uint16_t id, uint8_t status,
+                      const uint8_t *result, size_t len)
+{
+    benchStats_t *stats = ctx;
+    stats->completed++;
+    if (status != RPC_STATUS_OK || len != BENCH_ARG_SIZE)
+    {
+        stats->errors++;
+    }
+}
+
+static int bench(rpcClient_t *client, size_t depth, double seconds)
+{
+    benchStats_t stats = {0};
+    uint8_t arg[BENCH_ARG_SIZE] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+    double start = nowSec();
+    double end = start + seconds;
+    while (1)
+    {
+        bool running = nowSec() < end;
+        while (running && client->inFlight < depth)
+        {
+            if (rpcClientSend(client, RPC_METHOD_PING, arg, sizeof(arg),
+                              benchDone, &stats) < 0)
+            {
+                break;
+            }
+        }
+        if (!running && client->inFlight == 0)
+        {
+            break;
+        }
+        if (rpcClientPoll(client, 1000) < 0)
+        {
+            fprintf(stderr, "connection lost\n");
+            return -1;
+        }
+        if (!running && nowSec() > end + 2.0)
+        {
+            fprintf(stderr, "depth %zu: %zu replies missing\n", depth,
+                    client->inFlight);
+            return -1;
+        }
+    }
+    double elapsed = nowSec() - start;
+
+    printf("depth %3zu: %8.0f req/s  (%u requests, %u errors)\n", depth,
+           stats.completed / elapsed, stats.completed, stats.errors);
+    return (stats.errors == 0) ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <tty> [seconds]\n", argv[0]);
+        return 1;
+    }
+    const char *target = argv[1];
+    double seconds = (argc > 2) ? atof(argv[2]) : 2.0;
+
+    int fd = openTty(target);
+    if (fd < 0)
+    {
+        return 1;
+    }
+
+    static rpcClient_t client;
+    rpcClientInit(&client, fd);
+    printf("target: %s, ping %d bytes, %.1f s each\n", target, BENCH_ARG_SIZE,
+           seconds);
+    const size_t depths[] = {1, 8, 64};
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++)
+    {
+        if (bench(&client, depths[i], seconds) < 0)
+        {
+            return 1;
+        }
+    }
+    close(fd);
+    return 0;
+}
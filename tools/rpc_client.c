@@ -0,0 +1,222 @@
+#define _DEFAULT_SOURCE
+#include "rpc_client.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/****************************************************
+ * forward declaration
+ ****************************************************/
+void rpcClientInit(rpcClient_t *client, int fd);
+int rpcClientSend(rpcClient_t *client, uint8_t method, const void *arg,
+                  size_t len, rpcCallback_t callback, void *ctx);
+int rpcClientFlush(rpcClient_t *client);
+int rpcClientPoll(rpcClient_t *client, int timeoutMs);
+int rpcClientCall(rpcClient_t *client, uint8_t method, const void *arg,
+                  size_t len, void *result, size_t *resultLen, int timeoutMs);
+static int rpcClientHandleFrame(rpcClient_t *client, const frame_t *frame);
+
+void rpcClientInit(rpcClient_t *client, int fd)
+{
+    memset(client, 0, sizeof(*client));
+    client->fd = fd;
+    frameDecoderInit(&client->decoder, client->decoderBuffer,
+                     sizeof(client->decoderBuffer));
+}
+
+// 要求を送信バッファに追加し、要求IDを返す
+// 応答待ちがRPC_CLIENT_WINDOW_MAX件ある、または送信バッファが一杯なら-1
+// 実際の送信はrpcClientFlush()/rpcClientPoll()で、まとめて行う
+int rpcClientSend(rpcClient_t *client, uint8_t method, const void *arg,
+                  size_t len, rpcCallback_t callback, void *ctx)
+{
+    if (len > RPC_DATA_MAX || client->inFlight >= RPC_CLIENT_WINDOW_MAX ||
+        client->txLen + FRAME_ENCODED_MAX(RPC_PAYLOAD_MAX) >
+            sizeof(client->txBuffer))
+    {
+        return -1;
+    }
+
+    // 順不同で完了するため、まだ応答待ちのIDと同じ場所は飛ばす
+    while (client->pending[client->nextId % RPC_CLIENT_WINDOW_MAX].used)
+    {
+        client->nextId++;
+    }
+    uint16_t id = client->nextId++;
+
+    uint8_t payload[RPC_PAYLOAD_MAX];
+    rpcPutHeader(payload, id, method);
+    memcpy(&payload[RPC_HEADER_SIZE], arg, len);
+    client->txLen += frameEncode(FRAME_CHANNEL_RPC, client->seq++, payload,
+                                 RPC_HEADER_SIZE + len,
+                                 &client->txBuffer[client->txLen],
+                                 sizeof(client->txBuffer) - client->txLen);
+
+    rpcPending_t *pending = &client->pending[id % RPC_CLIENT_WINDOW_MAX];
+    pending->used = true;
+    pending->id = id;
+    pending->callback = callback;
+    pending->ctx = ctx;
+    client->inFlight++;
+    return id;
+}
+
+// 送信バッファのフレームを送る。FLOW_OFF中は送らない
+int rpcClientFlush(rpcClient_t *client)
+{
+    size_t pos = 0;
+    while (pos < client->txLen && !client->flowOff)
+    {
+        ssize_t n = write(client->fd, &client->txBuffer[pos],
+                          client->txLen - pos);
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return -1;
+        }
+        pos += n;
+    }
+    memmove(client->txBuffer, &client->txBuffer[pos], client->txLen - pos);
+    client->txLen -= pos;
+    return 0;
+}
+
+static int rpcClientHandleFrame(rpcClient_t *client, const frame_t *frame)
+{
+    if (frame->channel == FRAME_CHANNEL_CONTROL &&
+        frame->len >= FRAME_CONTROL_FLOW_SIZE)
+    {
+        client->flowOff = (frame->payload[0] == FRAME_CONTROL_FLOW_OFF);
+        return 0;
+    }
+    if (frame->channel != FRAME_CHANNEL_RPC || frame->len < RPC_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    uint16_t id = rpcGetId(frame->payload);
+    rpcPending_t *pending = &client->pending[id % RPC_CLIENT_WINDOW_MAX];
+    if (!pending->used || pending->id != id)
+    {
+        return 0; // 応答待ちでない(タイムアウト後の応答等)
+    }
+    pending->used = false;
+    client->inFlight--;
+    if (pending->callback != NULL)
+    {
+        pending->callback(pending->ctx, id, frame->payload[2],
+                          &frame->payload[RPC_HEADER_SIZE],
+                          frame->len - RPC_HEADER_SIZE);
+    }
+    return 1;
+}
+
+// 送信バッファを送り、受信した応答をコールバックに渡す
+// timeoutMs: 受信を待つ時間(0は待たない、-1は無期限)
+// 完了した要求の数を返す。エラーは-1
+int rpcClientPoll(rpcClient_t *client, int timeoutMs)
+{
+    if (rpcClientFlush(client) < 0)
+    {
+        return -1;
+    }
+
+    struct pollfd pfd = {.fd = client->fd, .events = POLLIN};
+    int ret = poll(&pfd, 1, timeoutMs);
+    if (ret <= 0)
+    {
+        return (ret < 0 && errno != EINTR) ? -1 : 0;
+    }
+
+    uint8_t buf[4096];
+    ssize_t n = read(client->fd, buf, sizeof(buf));
+    if (n <= 0)
+    {
+        return -1;
+    }
+
+    int completed = 0;
+    size_t pos = 0;
+    while (pos < (size_t)n)
+    {
+        frame_t frame;
+        frameStatus_t status;
+        pos += frameDecoderFeed(&client->decoder, &buf[pos], n - pos, &frame,
+                                &status);
+        if (status == FRAME_STATUS_OK)
+        {
+            completed += rpcClientHandleFrame(client, &frame);
+        }
+    }
+
+    // FLOW_ONを受け取っていれば、貯めていた要求を送る
+    if (rpcClientFlush(client) < 0)
+    {
+        return -1;
+    }
+    return completed;
+}
+
+typedef struct
+{
+    bool done;
+    uint8_t status;
+    void *result;
+    size_t *resultLen;
+} rpcCallResult_t;
+
+static void rpcClientCallDone(void *ctx, uint16_t id, uint8_t status,
+                              const uint8_t *result, size_t len)
+{
+    rpcCallResult_t *call = ctx;
+    call->done = true;
+    call->status = status;
+    if (call->result != NULL && call->resultLen != NULL)
+    {
+        size_t n = (len < *call->resultLen) ? len : *call->resultLen;
+        memcpy(call->result, result, n);
+        *call->resultLen = n;
+    }
+}
+
+static long long rpcClientNowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// 1件の要求を送り、応答を待つ。rpcStatus_tを返す。タイムアウト/エラーは-1
+// resultLen: 入力はresultのサイズ、出力は結果の長さ
+// 待っている間に届いた他の要求の応答もコールバックに渡す
+int rpcClientCall(rpcClient_t *client, uint8_t method, const void *arg,
+                  size_t len, void *result, size_t *resultLen, int timeoutMs)
+{
+    rpcCallResult_t call = {
+        .done = false, .result = result, .resultLen = resultLen};
+    int id = rpcClientSend(client, method, arg, len, rpcClientCallDone, &call);
+    if (id < 0)
+    {
+        return -1;
+    }
+
+    long long deadline = rpcClientNowMs() + timeoutMs;
+    while (!call.done)
+    {
+        long long remain = deadline - rpcClientNowMs();
+        if (remain <= 0 || rpcClientPoll(client, (int)remain) < 0)
+        {
+            // 応答待ちから外し、後から届いた応答は捨てる
+            client->pending[id % RPC_CLIENT_WINDOW_MAX].used = false;
+            client->inFlight--;
+            return -1;
+        }
+    }
+    return call.status;
+}
@@ -0,0 +1,57 @@
+#ifndef RPC_CLIENT_H
+#define RPC_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+#include "rpc_proto.h"
+
+// ホスト(Linux)側のバイナリRPCクライアント(形式はrpc_proto.h)
+// 応答を待たずにRPC_CLIENT_WINDOW_MAX件まで要求を送れる
+// 応答はrpcClientPoll()の中で、要求ごとのコールバックに届く(順不同)
+// デバイスのFLOW_OFFを受け取っている間は要求を送らず、送信バッファに貯める
+//
+// ビルド: gcc -I../src/utils rpc_client.c ../src/utils/frame.c ...
+
+#define RPC_CLIENT_WINDOW_MAX 256
+#define RPC_CLIENT_TX_BUFFER_SIZE 8192
+#define RPC_CLIENT_RX_BUFFER_SIZE 512
+
+// 応答のコールバック。statusはrpcStatus_t
+typedef void (*rpcCallback_t)(void *ctx, uint16_t id, uint8_t status,
+                              const uint8_t *result, size_t len);
+
+typedef struct
+{
+    bool used;
+    uint16_t id;
+    rpcCallback_t callback;
+    void *ctx;
+} rpcPending_t;
+
+typedef struct
+{
+    int fd;
+    frameDecoder_t decoder;
+    uint8_t decoderBuffer[RPC_CLIENT_RX_BUFFER_SIZE];
+    uint8_t txBuffer[RPC_CLIENT_TX_BUFFER_SIZE]; // 未送信のフレーム
+    size_t txLen;
+    uint8_t seq;
+    uint16_t nextId;
+    bool flowOff;                // デバイスがFLOW_OFF中
+    size_t inFlight;             // 応答待ちの要求数
+    rpcPending_t pending[RPC_CLIENT_WINDOW_MAX]; // id % WINDOW_MAXで引く
+} rpcClient_t;
+
+extern void rpcClientInit(rpcClient_t *client, int fd);
+extern int rpcClientSend(rpcClient_t *client, uint8_t method, const void *arg,
+                         size_t len, rpcCallback_t callback, void *ctx);
+extern int rpcClientFlush(rpcClient_t *client);
+extern int rpcClientPoll(rpcClient_t *client, int timeoutMs);
+extern int rpcClientCall(rpcClient_t *client, uint8_t method, const void *arg,
+                         size_t len, void *result, size_t *resultLen,
+                         int timeoutMs);
+
+#endif // RPC_CLIENT_H
@@ -0,0 +1,196 @@
+// ホスト(Linux)からデバイスへファイルをフレーム(frame.h)で送信するツール
+// デバイスの制御チャネルのFLOW_OFF/FLOW_ONに従って送信を止める/再開するため、
+// デバイス側のアプリケーションが処理できる速度で、データを失わずに送信できる
+//
+// ビルド:
+//   gcc -O2 -I../src/utils -o usb_upload usb_upload.c ../src/utils/frame.c
+// 使い方:
+//   ./usb_upload <tty> <file> [channel]
+//   例) ./usb_upload /dev/ttyACM0 config.bin
+//
+// デバイス側はUSB_CHANNEL_UPLOADをupload_task(src/app/upload.c)が受け取る
+// 送信後に表示するバイト数とCRCを、デバイスの"upload"コマンドの表示と比べると
+// 欠落がないことを確認できる("upload reset"で0に戻してから送信する)
+//
+// フレーム以外の受信データ(dbgPrintのテキスト等)は標準エラー出力に表示する
+
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame.h"
+
+#define UPLOAD_PAYLOAD_MAX 240 // デバイスのUSB_FRAME_PAYLOAD_MAXと同じ
+#define UPLOAD_CHANNEL_DEFAULT 5 // USB_CHANNEL_UPLOAD
+#define UPLOAD_RX_BUFFER_SIZE 1024
+
+typedef struct
+{
+    int fd;
+    frameDecoder_t decoder;
+    uint8_t decoderBuffer[UPLOAD_RX_BUFFER_SIZE];
+    int flowOff;         // デバイスがFLOW_OFF中
+    unsigned pauseCount; // FLOW_OFFを受け取った回数
+} upload_t;
+
+static double nowSec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int openTty(const char *path)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+// 受信データを読み、制御チャネルのフレームでフロー制御の状態を更新する
+// timeoutMs: 受信を待つ時間(-1は無期限)
+static int pollDevice(upload_t *up, int timeoutMs)
+{
+    struct pollfd pfd = {.fd = up->fd, .events = POLLIN};
+    int ret = poll(&pfd, 1, timeoutMs);
+    if (ret <= 0)
+    {
+        return ret;
+    }
+
+    uint8_t buf[UPLOAD_RX_BUFFER_SIZE];
+    ssize_t n = read(up->fd, buf, sizeof(buf));
+    if (n <= 0)
+    {
+        return -1;
+    }
+
+    size_t pos = 0;
+    while (pos < (size_t)n)
+    {
+        frame_t frame;
+        frameStatus_t status;
+        size_t start = pos;
+        pos += frameDecoderFeed(&up->decoder, &buf[pos], n - pos, &frame,
+                                &status);
+        if (status == FRAME_STATUS_OK)
+        {
+            if (frame.channel == FRAME_CHANNEL_CONTROL &&
+                frame.len >= FRAME_CONTROL_FLOW_SIZE)
+            {
+                up->flowOff = (frame.payload[0] == FRAME_CONTROL_FLOW_OFF);
+                up->pauseCount += up->flowOff;
+            }
+            continue;
+        }
+        // フレーム以外(テキスト)はそのまま表示する
+        fwrite(&buf[start], 1, pos - start, stderr);
+    }
+    return 1;
+}
+
+static int writeAll(int fd, const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s <tty> <file> [channel]\n", argv[0]);
+        return 1;
+    }
+    uint8_t channel =
+        (argc > 3) ? (uint8_t)atoi(argv[3]) : UPLOAD_CHANNEL_DEFAULT;
+
+    FILE *fp = fopen(argv[2], "rb");
+    if (fp == NULL)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    upload_t up = {0};
+    up.fd = openTty(argv[1]);
+    if (up.fd < 0)
+    {
+        fclose(fp);
+        return 1;
+    }
+    frameDecoderInit(&up.decoder, up.decoderBuffer, sizeof(up.decoderBuffer));
+
+    uint8_t payload[UPLOAD_PAYLOAD_MAX];
+    uint8_t encoded[FRAME_ENCODED_MAX(UPLOAD_PAYLOAD_MAX)];
+    uint8_t seq = 0;
+    size_t total = 0;
+    uint16_t crc = 0xFFFF; // デバイスのupload_taskと同じCRC-16/CCITT-FALSE
+    double start = nowSec();
+    size_t len;
+    while ((len = fread(payload, 1, sizeof(payload), fp)) > 0)
+    {
+        // 受信済みの制御フレームを処理し、FLOW_OFF中はFLOW_ONまで待つ
+        while (pollDevice(&up, 0) > 0)
+        {
+        }
+        while (up.flowOff)
+        {
+            if (pollDevice(&up, -1) < 0)
+            {
+                fprintf(stderr, "device closed\n");
+                return 1;
+            }
+        }
+
+        size_t n = frameEncode(channel, seq++, payload, len, encoded,
+                               sizeof(encoded));
+        if (writeAll(up.fd, encoded, n) < 0)
+        {
+            perror("write");
+            return 1;
+        }
+        total += len;
+        crc = frameCrc16(crc, payload, len);
+    }
+    tcdrain(up.fd);
+    double elapsed = nowSec() - start;
+
+    fprintf(stderr,
+            "sent %zu bytes in %.3f s (%.1f KiB/s), crc16 0x%04x, "
+            "paused %u times\n",
+            total, elapsed, (elapsed > 0) ? total / elapsed / 1024 : 0.0, crc,
+            up.pauseCount);
+    fclose(fp);
+    close(up.fd);
+    return 0;
+}